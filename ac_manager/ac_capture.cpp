@@ -0,0 +1,85 @@
+#include "application.h"
+#include "ac_capture.h"
+
+static const uint8_t CAPTURE_MAGIC[4] = {'A', 'C', 'C', 'P'};
+
+namespace AcManager {
+
+int encodeCaptureHeader(uint8_t dest[], int unit) {
+  memcpy(dest, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+  dest[4] = CAPTURE_VERSION;
+  dest[5] = unit;
+  return CAPTURE_HEADER_LEN;
+}
+
+int encodeCaptureByte(uint8_t dest[], uint8_t value, uint16_t sinceLast) {
+  dest[0] = CAPTURE_BYTE;
+  dest[1] = value;
+  dest[2] = sinceLast & 0xFF;
+  dest[3] = sinceLast >> 8;
+  return 4;
+}
+
+int encodeCaptureModel(uint8_t dest[], uint8_t model) {
+  dest[0] = CAPTURE_MODEL;
+  dest[1] = model;
+  return 2;
+}
+
+int encodeCaptureTime(uint8_t dest[], uint32_t millis) {
+  dest[0] = CAPTURE_TIME;
+  for (int i = 0; i < 4; i++) {
+    dest[1 + i] = (millis >> (i * 8)) & 0xFF;
+  }
+  return 5;
+}
+
+CaptureDecoder::CaptureDecoder(const uint8_t data[], size_t len) :
+  data(data), len(len), offset(0), valid(false), unit(-1) {
+  if (len >= CAPTURE_HEADER_LEN && memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0 &&
+      data[4] == CAPTURE_VERSION) {
+    valid = true;
+    unit = data[5];
+    offset = CAPTURE_HEADER_LEN;
+  }
+}
+
+bool CaptureDecoder::next(struct CaptureRecord* record) {
+  if (!valid || offset >= len) {
+    return false;
+  }
+
+  const uint8_t* at = &data[offset];
+  size_t left = len - offset;
+  switch (at[0]) {
+    case CAPTURE_BYTE:
+      if (left < 4) {
+        return false;
+      }
+      record->type = CAPTURE_BYTE;
+      record->value = at[1];
+      record->sinceLast = at[2] | (at[3] << 8);
+      offset += 4;
+      return true;
+    case CAPTURE_MODEL:
+      if (left < 2) {
+        return false;
+      }
+      record->type = CAPTURE_MODEL;
+      record->value = at[1];
+      offset += 2;
+      return true;
+    case CAPTURE_TIME:
+      if (left < 5) {
+        return false;
+      }
+      record->type = CAPTURE_TIME;
+      record->millis = at[1] | (at[2] << 8) | (at[3] << 16) | ((uint32_t) at[4] << 24);
+      offset += 5;
+      return true;
+    default:
+      return false;
+  }
+}
+
+}
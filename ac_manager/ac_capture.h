@@ -0,0 +1,77 @@
+#include "application.h"
+
+#ifndef AC_CAPTURE_H
+#define AC_CAPTURE_H
+
+/**
+ * Capture format for the raw shift register byte stream, written by DisplayReader's recorder and
+ * read back by tools/ac_replay. Multi-byte fields are little endian.
+ *
+ *  header  'A' 'C' 'C' 'P' version unit
+ *  'B'     value sinceLast(2)  one byte off the register, sinceLast is micros from the start of the
+ *                              byte before it, 0xFFFF if that was longer ago or is unknown
+ *  'M'     model               the bytes after this were decoded as AcModels model
+ *  'T'     millis(4)           the device's millis() when the next byte was read, written at the
+ *                              start and whenever bytes were lost or sinceLast saturated
+ */
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_LEN 6
+#define CAPTURE_RECORD_MAX 5 // longest record, sizes encode buffers
+#define CAPTURE_GAP_UNKNOWN 0xFFFF
+
+namespace AcManager {
+
+enum CaptureRecordType {
+  CAPTURE_BYTE = 'B',
+  CAPTURE_MODEL = 'M',
+  CAPTURE_TIME = 'T'
+};
+
+struct CaptureRecord {
+  enum CaptureRecordType type;
+  uint8_t value; // CAPTURE_BYTE value or CAPTURE_MODEL model
+  uint16_t sinceLast; // CAPTURE_BYTE only
+  uint32_t millis; // CAPTURE_TIME only
+};
+
+// Each writes one record to dest and returns its length
+int encodeCaptureHeader(uint8_t dest[], int unit);
+int encodeCaptureByte(uint8_t dest[], uint8_t value, uint16_t sinceLast);
+int encodeCaptureModel(uint8_t dest[], uint8_t model);
+int encodeCaptureTime(uint8_t dest[], uint32_t millis);
+
+/**
+ * Walks the records of a capture held in memory, data must outlive the decoder
+ */
+class CaptureDecoder {
+  public:
+    CaptureDecoder(const uint8_t data[], size_t len);
+
+    /**
+     * False if the header is missing or from another version, next() returns nothing then
+     */
+    bool isValid() const { return valid; }
+    int getUnit() const { return unit; }
+
+    /**
+     * Decode the next record into record, false at the end of the data or at the first record
+     * that is unknown or cut short, see isTruncated
+     */
+    bool next(struct CaptureRecord* record);
+
+    /**
+     * True if next() stopped before the end of the data
+     */
+    bool isTruncated() const { return offset < len; }
+
+  private:
+    const uint8_t* data;
+    size_t len;
+    size_t offset;
+    bool valid;
+    int unit;
+};
+
+}
+
+#endif
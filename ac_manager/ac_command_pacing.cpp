@@ -0,0 +1,63 @@
+#include "application.h"
+#include "ac_command_pacing.h"
+#include "ac_ir_controller_p.h"
+
+#define MAX_BACKOFF 4
+
+namespace AcManager {
+
+CommandPacing::CommandPacing() {
+  reset();
+}
+
+void CommandPacing::reset() {
+  srtt8 = 0;
+  rttvar4 = 0;
+  samples = 0;
+  backoff = 0;
+  frameSpacing = IR_FRAME_SPACING;
+}
+
+void CommandPacing::recordAck(unsigned long millis) {
+  backoff = 0;
+  if (samples == 0) {
+    srtt8 = millis * 8;
+    rttvar4 = millis * 2; // half the first sample
+  } else {
+    // srtt += (m - srtt) / 8, rttvar += (|m - srtt| - rttvar) / 4
+    long err = (long) millis - (long) (srtt8 / 8);
+    srtt8 += err;
+    rttvar4 += (unsigned long) abs(err) - rttvar4 / 4;
+  }
+  if (samples < 0x7FFF) {
+    samples++;
+  }
+}
+
+void CommandPacing::recordMiss() {
+  if (backoff < MAX_BACKOFF) {
+    backoff++;
+  }
+}
+
+void CommandPacing::recordPresses(int sent, int landed) {
+  if (sent < 2 || landed <= 0) {
+    // Spacing only matters between presses, and nothing landing at all isn't a spacing problem
+    return;
+  }
+
+  if (landed < sent) {
+    frameSpacing += frameSpacing / 4;
+  } else {
+    frameSpacing -= SPACING_STEP;
+  }
+  frameSpacing = constrain(frameSpacing, (unsigned long) IR_FRAME_SPACING_MIN, (unsigned long) IR_FRAME_SPACING_MAX);
+}
+
+unsigned long CommandPacing::getSettleMillis() const {
+  unsigned long wait = samples == 0 ? DEFAULT_SETTLE_MILLIS : srtt8 / 8 + rttvar4;
+  wait = constrain(wait, MIN_SETTLE_MILLIS, MAX_SETTLE_MILLIS);
+  return min(wait << backoff, MAX_SETTLE_MILLIS);
+}
+
+}
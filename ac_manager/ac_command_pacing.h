@@ -0,0 +1,63 @@
+#include "application.h"
+
+#ifndef AC_COMMAND_PACING_H
+#define AC_COMMAND_PACING_H
+
+namespace AcManager {
+
+/**
+ * Learns how fast a model takes IR presses and how long its display takes to show them.
+ *
+ * Ack latency is the time from the first frame of a batch to the first display change after it.
+ * It is smoothed the way TCP smooths round trip times, a mean and a mean deviation, and the wait
+ * before re-checking the display is the mean plus four deviations. A batch the display never
+ * reacts to doubles the wait until the next ack.
+ *
+ * Frame spacing is additive decrease, multiplicative increase: shaved a little after every batch
+ * of presses that all landed, raised by a quarter when some were dropped.
+ */
+class CommandPacing {
+  public:
+    static const unsigned long DEFAULT_SETTLE_MILLIS = 2000; // until the first ack is measured
+    static const unsigned long MIN_SETTLE_MILLIS = 300;
+    static const unsigned long MAX_SETTLE_MILLIS = 8000;
+    static const unsigned long SPACING_STEP = 2000; // micros taken off the spacing per clean batch
+
+    CommandPacing();
+    void reset();
+
+    /**
+     * The display changed millis after the first frame of a batch
+     */
+    void recordAck(unsigned long millis);
+
+    /**
+     * The display didn't change within getSettleMillis of a batch
+     */
+    void recordMiss();
+
+    /**
+     * A batch of sent presses of the same button moved the display landed steps
+     */
+    void recordPresses(int sent, int landed);
+
+    /**
+     * Millis to wait after the last frame of a batch before re-checking the display
+     */
+    unsigned long getSettleMillis() const;
+    unsigned long getFrameSpacing() const { return frameSpacing; }
+    unsigned long getAckMillis() const { return srtt8 / 8; }
+    unsigned long getAckDeviationMillis() const { return rttvar4 / 4; }
+    int getSamples() const { return samples; }
+
+  private:
+    unsigned long srtt8; // smoothed ack latency, 1/8ths of a milli
+    unsigned long rttvar4; // smoothed mean deviation, 1/4ths of a milli
+    int samples;
+    int backoff; // doublings of the wait since the last ack
+    unsigned long frameSpacing; // micros
+};
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "application.h"
+#include "ac_command_planner.h"
+
+#define SPEED_BIT(speed) ((uint8_t) (1 << (speed)))
+#define ANY_MANUAL_SPEED (SPEED_BIT(FAN_LOW) | SPEED_BIT(FAN_MEDIUM) | SPEED_BIT(FAN_HIGH))
+#define ANY_SPEED (ANY_MANUAL_SPEED | SPEED_BIT(FAN_AUTO))
+#define SPEED_MASKS (1 << CommandPlanner::FAN_SPEED_COUNT) // every set of speeds fits below this
+
+namespace AcManager {
+
+// Up/down step through low, medium and high and stop at the ends. Which manual speed the unit
+// drops to when leaving auto isn't known, so those transitions could be any of them.
+#define FAN_SPEED_UP {AC_CMD_FAN_SPEED_U, {0, SPEED_BIT(FAN_MEDIUM), SPEED_BIT(FAN_HIGH), SPEED_BIT(FAN_HIGH), ANY_MANUAL_SPEED}}
+#define FAN_SPEED_DOWN {AC_CMD_FAN_SPEED_D, {0, SPEED_BIT(FAN_LOW), SPEED_BIT(FAN_LOW), SPEED_BIT(FAN_MEDIUM), ANY_MANUAL_SPEED}}
+#define FAN_SPEED_AUTO {AC_CMD_AUTO_FAN, {0, SPEED_BIT(FAN_AUTO), SPEED_BIT(FAN_AUTO), SPEED_BIT(FAN_AUTO), SPEED_BIT(FAN_AUTO)}}
+
+// V1_4 has no medium speed, up and down go straight between low and high
+#define LOW_OR_HIGH (SPEED_BIT(FAN_LOW) | SPEED_BIT(FAN_HIGH))
+#define FAN_SPEED_UP_NO_MEDIUM {AC_CMD_FAN_SPEED_U, {0, SPEED_BIT(FAN_HIGH), SPEED_BIT(FAN_HIGH), SPEED_BIT(FAN_HIGH), LOW_OR_HIGH}}
+#define FAN_SPEED_DOWN_NO_MEDIUM {AC_CMD_FAN_SPEED_D, {0, SPEED_BIT(FAN_LOW), SPEED_BIT(FAN_LOW), SPEED_BIT(FAN_LOW), LOW_OR_HIGH}}
+
+// Every mode has its own button
+#define MODE_BUTTONS {AC_CMD_COUNT, AC_CMD_FAN_ONLY, AC_CMD_ENERGY_SAVER, AC_CMD_COOL}
+
+// Indexed by AcModels
+const CommandPlanner::ModelControls CommandPlanner::MODEL_CONTROLS[3] = {
+  {{FAN_SPEED_UP, FAN_SPEED_DOWN, FAN_SPEED_AUTO}, MODE_BUTTONS}, // V1_2
+  {{FAN_SPEED_UP_NO_MEDIUM, FAN_SPEED_DOWN_NO_MEDIUM, FAN_SPEED_AUTO}, MODE_BUTTONS}, // V1_4
+  {{FAN_SPEED_UP, FAN_SPEED_DOWN, FAN_SPEED_AUTO}, MODE_BUTTONS}  // V1_8
+};
+
+CommandPlanner::CommandPlanner(enum AcModels model) : controls(MODEL_CONTROLS[model]) {
+}
+
+bool CommandPlanner::plan(const struct AcState& current, const struct AcState& target, const HoldCalibration& hold,
+    unsigned long maxHoldMicros, struct CommandPlan* dest) const {
+  *dest = CommandPlan();
+  bool reachable = true;
+
+  enum AcModes mode = target.getMode();
+  if (mode != current.getMode()) {
+    enum AcCommands button = mode < MODE_INVALID ? controls.modeButtons[mode] : AC_CMD_COUNT;
+    if (button == AC_CMD_COUNT) {
+      reachable = false;
+    } else {
+      dest->changesMode = true;
+      reachable &= addPress(dest, button, 0);
+    }
+  }
+
+  if (target.getSpeed() != current.getSpeed()) {
+    enum AcCommands presses[MAX_FAN_PRESSES];
+    int count = planFanSpeed(current.getSpeed(), target.getSpeed(), presses, MAX_FAN_PRESSES);
+    if (count < 0) {
+      reachable = false;
+    } else {
+      dest->changesSpeed = true;
+      for (int i = 0; i < count; i++) {
+        reachable &= addPress(dest, presses[i], 0);
+      }
+    }
+  }
+
+  int tempDiff = target.getTemp() - current.getTemp();
+  if (mode != MODE_FAN && tempDiff != 0) {
+    dest->changesTemp = true;
+    enum AcCommands button = tempDiff < 0 ? AC_CMD_TEMP_TIMER_D : AC_CMD_TEMP_TIMER_U;
+    int steps = abs(tempDiff);
+    dest->tempDirection = tempDiff < 0 ? -1 : 1;
+    if (hold.shouldHold(steps, maxHoldMicros)) {
+      // One press and repeat codes instead of a full frame per degree
+      dest->holdRepeats = hold.repeatsFor(steps);
+      reachable &= addPress(dest, button, dest->holdRepeats);
+    } else {
+      dest->tempPresses = steps;
+      for (int i = 0; i < steps; i++) {
+        reachable &= addPress(dest, button, 0);
+      }
+    }
+  }
+
+  return reachable;
+}
+
+bool CommandPlanner::canReach(const struct AcState& target) const {
+  enum AcModes mode = target.getMode();
+  if (mode >= MODE_INVALID || controls.modeButtons[mode] == AC_CMD_COUNT) {
+    return false;
+  }
+  // From a speed that isn't known, so the target is reachable from whatever is displayed
+  enum AcCommands presses[MAX_FAN_PRESSES];
+  return planFanSpeed(FAN_INVALID, target.getSpeed(), presses, MAX_FAN_PRESSES) >= 0;
+}
+
+int CommandPlanner::planFanSpeed(enum FanSpeeds from, enum FanSpeeds to, enum AcCommands dest[], int maxPresses) const {
+  if (to <= FAN_OFF || to >= FAN_SPEED_COUNT) {
+    return -1;
+  }
+
+  // A speed the display couldn't decode could be any of them
+  uint8_t start = (from > FAN_OFF && from < FAN_SPEED_COUNT) ? SPEED_BIT(from) : ANY_SPEED;
+  uint8_t goal = SPEED_BIT(to);
+  if (start == goal) {
+    return 0;
+  }
+
+  // Breadth first over the sets of speeds the unit could be at, remembering how each set was
+  // first reached
+  int8_t pressIndex[SPEED_MASKS];
+  uint8_t parent[SPEED_MASKS];
+  uint8_t depth[SPEED_MASKS];
+  uint8_t queue[SPEED_MASKS];
+  memset(pressIndex, -1, sizeof(pressIndex));
+  int head = 0;
+  int tail = 0;
+  queue[tail++] = start;
+  depth[start] = 0;
+  pressIndex[start] = 3; // visited, not reached by a press
+
+  while (head < tail) {
+    uint8_t speeds = queue[head++];
+    if (depth[speeds] >= maxPresses) {
+      continue;
+    }
+    for (int b = 0; b < 3; b++) {
+      uint8_t next = nextFanSpeeds(controls.fanButtons[b], speeds);
+      if (next == 0 || pressIndex[next] != -1) {
+        continue;
+      }
+      pressIndex[next] = b;
+      parent[next] = speeds;
+      depth[next] = depth[speeds] + 1;
+      if (next == goal) {
+        int count = depth[next];
+        for (uint8_t at = next; at != start; at = parent[at]) {
+          dest[depth[at] - 1] = controls.fanButtons[pressIndex[at]].command;
+        }
+        return count;
+      }
+      queue[tail++] = next;
+    }
+  }
+
+  return -1;
+}
+
+uint8_t CommandPlanner::nextFanSpeeds(const FanButton& button, uint8_t speeds) {
+  uint8_t next = 0;
+  for (int speed = FAN_LOW; speed < FAN_SPEED_COUNT; speed++) {
+    if (speeds & SPEED_BIT(speed)) {
+      next |= button.next[speed];
+    }
+  }
+  return next;
+}
+
+bool CommandPlanner::addPress(struct CommandPlan* dest, enum AcCommands command, int repeats) {
+  if (dest->length >= CommandPlan::MAX_PRESSES) {
+    return false;
+  }
+  dest->presses[dest->length].command = command;
+  dest->presses[dest->length].repeats = repeats;
+  dest->length++;
+  return true;
+}
+
+}
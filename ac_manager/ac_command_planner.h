@@ -0,0 +1,101 @@
+#include "application.h"
+
+#ifndef AC_COMMAND_PLANNER_H
+#define AC_COMMAND_PLANNER_H
+
+#include "ac_display_reader.h"
+#include "ac_ir_commands.h"
+#include "ac_parser.h"
+#include "ac_hold_calibration.h"
+
+namespace AcManager {
+
+/**
+ * One remote button press, held for repeats NEC repeat codes if repeats isn't 0
+ */
+struct PlannedPress {
+  enum AcCommands command;
+  int repeats;
+};
+
+/**
+ * Presses that take the AC from its displayed state to the target, in send order
+ */
+struct CommandPlan {
+  static const int MAX_PRESSES = 40;
+
+  PlannedPress presses[MAX_PRESSES];
+  int length;
+  bool changesMode;
+  bool changesSpeed;
+  bool changesTemp;
+  int holdRepeats; // repeat codes of the held temperature press, 0 if the move is single presses
+  int tempPresses; // single temperature presses, 0 if the move is held
+  int tempDirection; // 1 for up, -1 for down
+
+  CommandPlan() : length(0), changesMode(false), changesSpeed(false), changesTemp(false), holdRepeats(0), tempPresses(0), tempDirection(0) {}
+
+  bool isEmpty() const { return length == 0; }
+};
+
+/**
+ * Works out the fewest presses to get a model from one displayed state to another.
+ *
+ * Each model's mode and fan speed buttons are described by a transition table, the fan speed a
+ * button leads to from each speed. A speed the model doesn't have (V1_4 has no FAN_MEDIUM) is never
+ * led to, so targets with it can't be planned. Some transitions aren't known exactly (leaving FAN_AUTO), those
+ * list every speed the unit could end up at. Fan presses are planned as a breadth first search
+ * over the set of speeds the unit could be at, so a plan only counts as complete when every
+ * possible outcome ends at the target. Temperature is a straight line, single presses or one held
+ * press when the HoldCalibration says it is on air for less time.
+ */
+class CommandPlanner {
+  public:
+    static const int FAN_SPEED_COUNT = FAN_AUTO + 1; // FanSpeeds a transition table covers
+    static const int MAX_FAN_PRESSES = 8;
+
+    explicit CommandPlanner(enum AcModels model);
+
+    /**
+     * Plan the presses from current to target, only the mode, fan speed and temperature are looked
+     * at. The temperature is left alone for MODE_FAN, a move is only held if its repeat codes go
+     * out within maxHoldMicros. Returns false if the model can't reach the target, dest then holds
+     * whatever part can be reached.
+     */
+    bool plan(const struct AcState& current, const struct AcState& target, const HoldCalibration& hold,
+      unsigned long maxHoldMicros, struct CommandPlan* dest) const;
+
+    /**
+     * True if the model's buttons can get it to target's mode and fan speed from any displayed
+     * state, false for a mode or speed it doesn't have
+     */
+    bool canReach(const struct AcState& target) const;
+
+    /**
+     * Fewest fan speed presses from one speed to another, written to dest. Returns the number of
+     * presses or -1 if to can't be reached within maxPresses.
+     */
+    int planFanSpeed(enum FanSpeeds from, enum FanSpeeds to, enum AcCommands dest[], int maxPresses) const;
+
+  private:
+    struct FanButton {
+      enum AcCommands command;
+      uint8_t next[FAN_SPEED_COUNT]; // bit mask of the FanSpeeds the press can lead to from each speed
+    };
+
+    struct ModelControls {
+      FanButton fanButtons[3];
+      enum AcCommands modeButtons[MODE_INVALID]; // button that selects each AcModes, AC_CMD_COUNT if none
+    };
+
+    static const ModelControls MODEL_CONTROLS[3];
+
+    const ModelControls& controls;
+
+    static uint8_t nextFanSpeeds(const FanButton& button, uint8_t speeds);
+    static bool addPress(struct CommandPlan* dest, enum AcCommands command, int repeats);
+};
+
+}
+
+#endif
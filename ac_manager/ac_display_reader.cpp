@@ -5,37 +5,28 @@
 #include "ac_parser_v18.h"
 #include "ac_display_reader.h"
 #include "ac_display_reader_p.h"
+#include "ac_state_filter.h"
+#include "ac_model_detector.h"
+#include "ac_scheduler.h"
+#include "ac_warm_state.h"
+#include "ac_capture.h"
 
-// Global config
-int clockPin;
-int inputPin;
-
-// Variables used by the ISR to track the shift register
-unsigned int cycleStart = 0;
-volatile uint8_t byteBuffer[BUFFER_LEN];
-volatile uint8_t* currentByte = byteBuffer;
-
-// Overall state tracking
-AcModels acModel = V1_4;
-long lastUpdate = Time.now(); // unix seconds of successful data parse
-long lastMessage = 0; // unix seconds of of last message sent
-int acStatesIndex = 0; // Circular buffer index into acStates array
-struct AcState currentAcState = {.timestamp = -1, .temp = -1, .timer = -1.0, .speed = FAN_INVALID, .mode = MODE_INVALID, .sleep = false};
-struct AcState acStates[AC_STATES_LEN] = {
-  {.timestamp = -1, .temp = -1, .timer = -1.0, .speed = FAN_INVALID, .mode = MODE_INVALID, .sleep = false},
-  {.timestamp = -1, .temp = -1, .timer = -1.0, .speed = FAN_INVALID, .mode = MODE_INVALID, .sleep = false},
-  {.timestamp = -1, .temp = -1, .timer = -1.0, .speed = FAN_INVALID, .mode = MODE_INVALID, .sleep = false},
-  {.timestamp = -1, .temp = -1, .timer = -1.0, .speed = FAN_INVALID, .mode = MODE_INVALID, .sleep = false}
-};
-struct AcDisplayReaderConfig config;
-char statusJson[sizeof(STATUS_TEMPLATE) * 2];
-char registerData[(BUFFER_LEN * 3) + 1];
-
-// Define versioned parsers
+// Define versioned parsers, they keep no state so every unit shares them
 AcManager::AcParserV12 acParserV12;
 AcManager::AcParserV14 acParserV14;
 AcManager::AcParserV18 acParserV18;
 
+// Readers by unit, for the clock trampolines and the cloud functions
+AcManager::DisplayReader* registeredReaders[AC_UNITS_MAX];
+
+template <int UNIT>
+void clockTrampoline() {
+  registeredReaders[UNIT]->onClock();
+}
+
+static_assert(AC_UNITS_MAX == 3, "one trampoline per unit");
+void (* const CLOCK_TRAMPOLINES[AC_UNITS_MAX])() = {clockTrampoline<0>, clockTrampoline<1>, clockTrampoline<2>};
+
 enum AcModes getModeForName(String modeName) {
   if (modeName == "MODE_OFF") {
     return MODE_OFF;
@@ -66,236 +57,653 @@ enum FanSpeeds getSpeedForName(String speedName) {
   }
 }
 
+AcManager::DisplayReader* getAcDisplayReader(int unit) {
+  if (unit < 0 || unit >= AC_UNITS_MAX) {
+    return NULL;
+  }
+  return registeredReaders[unit];
+}
+
+/**
+ * Spark Function, "<unit>:<model>" or just the model for unit 0, see DisplayReader::setAcModel
+ *
+ * http://docs.particle.io/core/firmware/#other-functions-eeprom
+ */
+int setAcModel(String command) {
+  AcManager::DisplayReader* reader = getAcDisplayReader(takeAcUnit(&command));
+  return reader != NULL ? reader->setAcModel(command) : -1;
+}
+
+/**
+ * Spark Function, "<unit>:<window>,<quorum>" or just the filter for unit 0, see
+ * DisplayReader::setStateFilter
+ */
+int setStateFilter(String command) {
+  AcManager::DisplayReader* reader = getAcDisplayReader(takeAcUnit(&command));
+  return reader != NULL ? reader->setStateFilter(command) : -1;
+}
+
+/**
+ * Spark Function, "<unit>:on" or "<unit>:off", just on or off for unit 0. Returns 1 while
+ * capturing, 0 once stopped or -1 for a bad argument, see DisplayReader::setCapture
+ */
+int setCapture(String command) {
+  AcManager::DisplayReader* reader = getAcDisplayReader(takeAcUnit(&command));
+  if (reader == NULL || (command != "on" && command != "off")) {
+    return -1;
+  }
+  reader->setCapture(command == "on");
+  return reader->isCapturing() ? 1 : 0;
+}
+
+bool waitForAcDisplayFrame(unsigned long maxMillis) {
+  unsigned long start = millis();
+  while (true) {
+    for (int unit = 0; unit < AC_UNITS_MAX; unit++) {
+      if (registeredReaders[unit] != NULL && registeredReaders[unit]->isFrameReady()) {
+        return true;
+      }
+    }
+    if (millis() - start >= maxMillis) {
+      return false;
+    }
+    delay(1);
+  }
+}
+
+namespace AcManager {
+
+DisplayReader::DisplayReader() :
+  unit(-1), cycleStart(0), shiftRegister(0), framePosition(FRAME_POSITION_UNKNOWN), byteGap(CAPTURE_GAP_UNKNOWN),
+  frameHash(FRAME_HASH_SEED), lastFrameHash(FRAME_HASH_SEED), completedFrames(0), changedFrames(0),
+  seenFrames(0), seenChanges(0), readCount(0), stats(), decodedLen(0), decodedModel(V1_2),
+  probeFreshBytes(0), acModel(V1_4), lastUpdate(Time.now()), scheduler(NULL), refreshTask(-1),
+  staleTask(-1), currentAcState(-1, -1, -10, FAN_INVALID, MODE_INVALID, false), provisional(false),
+  lastStateChange(0), stateFilter(AC_STATES_LEN, AC_STATES_QUORUM), capturing(false) {
+  memset(readBuffer, 0, BUFFER_LEN);
+  memset(readPositions, FRAME_POSITION_UNKNOWN, BUFFER_LEN);
+  statusJson[0] = '\0';
+  registerData[0] = '\0';
+}
+
+bool DisplayReader::init(int unit, struct AcDisplayReaderConfig cfg, Scheduler* sched) {
+  if (unit < 0 || unit >= AC_UNITS_MAX) {
+    return false;
+  }
+  this->unit = unit;
+  registeredReaders[unit] = this;
 
-void initAcDisplayReader(struct AcDisplayReaderConfig cfg) {
   config = cfg;
-  clockPin = config.clockPin;
-  inputPin = config.inputPin;
+  scheduler = sched;
+  // A full scheduler leaves the task id -1, the display is still read without that event
+  refreshTask = scheduler->add(publishStatusRefresh, config.refreshInterval * 1000UL, this);
+  staleTask = scheduler->add(publishStatusStale, config.staleInterval * 1000UL, this);
 
-  pinMode(clockPin, INPUT);
-  pinMode(inputPin, INPUT);
+  pinMode(config.clockPin, INPUT);
+  pinMode(config.inputPin, INPUT);
 
   // Register display status variables
   Spark.variable(config.statusVar, &statusJson, STRING);
   Spark.variable(config.dataVar, &registerData, STRING);
 
-  // Register control functions
-  Spark.function(config.setAcModelFuncName, setAcModel);
+  // Register control functions, shared by every unit
+  if (unit == 0) {
+    Spark.function(config.setAcModelFuncName, ::setAcModel);
+    Spark.function(config.setStateFilterFuncName, ::setStateFilter);
+    Spark.function(config.captureFuncName, ::setCapture);
+  }
 
   // Setup interrupt handler on rising edge of the register clock
-  attachInterrupt(clockPin, clock_Interrupt_Handler, RISING);
+  attachInterrupt(config.clockPin, CLOCK_TRAMPOLINES[unit], RISING);
 
   loadAcModel();
+  probeFreshBytes = 0;
+  restoreWarmAcState();
 
   updateVariables(&currentAcState, true);
+  return refreshTask != -1 && staleTask != -1;
 }
 
-bool isAcOn() {
-  return currentAcState.speed != FAN_OFF && currentAcState.speed != FAN_INVALID;
-}
-
-int getTemp() {
-  return currentAcState.temp;
-}
+/**
+ * Serve the state voted in before the last reset until the display confirms or replaces it. A
+ * model the EEPROM doesn't know yet is taken from the warm state too, the locked model's error
+ * rate still starts a probe if it was wrong.
+ */
+void DisplayReader::restoreWarmAcState() {
+  AcModels warmModel;
+  uint32_t warmDisplay;
+  if (!loadWarmDisplay(unit, &warmModel, &warmDisplay)) {
+    return;
+  }
 
-double getTimer() {
-  return currentAcState.timer;
-}
+  if (modelDetector.isProbing()) {
+    lockAcModel(warmModel);
+  } else if (warmModel != acModel) {
+    // Saved with a model setAcModel has replaced since
+    return;
+  }
 
-enum FanSpeeds getFanSpeed() {
-  return currentAcState.speed;
+  currentAcState.display = warmDisplay;
+  provisional = true;
 }
 
-enum AcModes getAcMode() {
-  return currentAcState.mode;
+bool DisplayReader::isAcOn() const {
+  return currentAcState.getSpeed() != FAN_OFF && currentAcState.getSpeed() != FAN_INVALID;
 }
 
 /**
  * ISR that reads the shift register data, the next bit read from the inputPin whenever the clockPin
  * goes high
  */
-void clock_Interrupt_Handler() {
+void DisplayReader::onClock() {
   // Track the start of each cycle
-  // zero out the currentByte to start accumulating data
+  // zero out the shiftRegister to start accumulating data
   int now = micros();
   if (cycleStart == 0 || (now - cycleStart) > UPDATE_TIME_MAX) {
     if (cycleStart != 0) {
-      // New cycle means go to the next byte
-      currentByte++;
-
-      // Roll over to the start of the buffer once BUFFER_LEN is reached
-      if (currentByte == (byteBuffer + BUFFER_LEN)) {
-        currentByte = byteBuffer;
-      }
+      // New cycle means the previous byte is complete, publish it to the main loop
+      pushByte(shiftRegister);
+      startByte(now - cycleStart);
     }
 
     // Record the update cycle start time for the current byte
     cycleStart = now;
 
     // Zero the current byte, some cycles don't push a full 8 bits into the register
-    *currentByte = 0;
+    shiftRegister = 0;
   }
 
   // On clock rise shift the data in the register by one
-  *currentByte <<= 1;
+  shiftRegister <<= 1;
 
   // If the input is high set the new bit to 1 otherwise leave it zero
   // faster way of reading pin D1: https://community.particle.io/t/reading-digits-from-dual-7-segment-10-pin-display/12989/6
   /*if ((GPIOB->IDR) & 0b01000000) {*/
   // Using digitalRead for core/photon cross compatibility
-  if (digitalRead(inputPin) == HIGH) {
-    *currentByte |= 1;
+  if (digitalRead(config.inputPin) == HIGH) {
+    shiftRegister |= 1;
+  }
+}
+
+void DisplayReader::replayByte(uint8_t value, uint16_t sinceLast) {
+  startByte(sinceLast);
+  pushByte(value);
+}
+
+/**
+ * A new byte started sinceLast micros after the one before it, work out its place in the display
+ * refresh. Runs in the ISR
+ */
+void DisplayReader::startByte(unsigned int sinceLast) {
+  // A long quiet period means the AC controller is starting a new display refresh, the one before
+  // it is complete
+  if (sinceLast > FRAME_GAP_MIN) {
+    if (framePosition != FRAME_POSITION_UNKNOWN) {
+      if (frameHash != lastFrameHash) {
+        changedFrames.fetch_add(1, std::memory_order_release);
+      }
+      completedFrames.fetch_add(1, std::memory_order_release);
+    }
+    lastFrameHash = frameHash;
+    frameHash = FRAME_HASH_SEED;
+    framePosition = 0;
+  } else if (framePosition != FRAME_POSITION_UNKNOWN) {
+    framePosition++;
+  }
+  byteGap = min(sinceLast, (unsigned int) CAPTURE_GAP_UNKNOWN);
+}
+
+/**
+ * The byte started by startByte is complete, publish it to processDisplayData. Runs in the ISR
+ */
+void DisplayReader::pushByte(uint8_t value) {
+  struct DisplayByte completed = {.value = value, .position = framePosition, .sinceLast = byteGap};
+  byteRing.push(completed);
+  frameHash = (frameHash ^ value) * FRAME_HASH_PRIME;
+}
+
+void DisplayReader::setCapture(bool on) {
+  if (on == capturing) {
+    return;
+  }
+  capturing = on;
+  if (!on) {
+    return;
+  }
+
+  // Serial.begin is harmless if Serial is already open, the USB port ignores the baud rate
+  Serial.begin(115200);
+  uint8_t records[CAPTURE_HEADER_LEN + CAPTURE_RECORD_MAX * 2];
+  int len = encodeCaptureHeader(records, unit);
+  len += encodeCaptureTime(&records[len], millis());
+  if (!modelDetector.isProbing()) {
+    len += encodeCaptureModel(&records[len], acModel);
   }
+  Serial.write(records, len);
 }
 
-void loadAcModel() {
-  uint8_t modelFlag = EEPROM.read(1);
+/**
+ * Stream the bytes processDisplayData just pulled from the ring, lost is set if the ring lapped
+ * the reader and older bytes never made it
+ */
+void DisplayReader::writeCapture(const struct DisplayByte bytes[], int len, bool lost) {
+  uint8_t records[BUFFER_LEN * CAPTURE_RECORD_MAX * 2]; // a time record can come before every byte
+  int recordsLen = 0;
+  for (int i = 0; i < len; i++) {
+    uint16_t sinceLast = bytes[i].sinceLast;
+    if (i == 0 && lost) {
+      // The gap to the byte before isn't known anymore, the replay has to start a new refresh
+      sinceLast = CAPTURE_GAP_UNKNOWN;
+    }
+    if (sinceLast == CAPTURE_GAP_UNKNOWN) {
+      recordsLen += encodeCaptureTime(&records[recordsLen], millis());
+    }
+    recordsLen += encodeCaptureByte(&records[recordsLen], bytes[i].value, sinceLast);
+  }
+  if (recordsLen > 0) {
+    Serial.write(records, recordsLen);
+  }
+}
+
+void DisplayReader::loadAcModel() {
+  uint8_t modelFlag = EEPROM.read(1 + unit);
   switch (modelFlag) {
-    default:
     case 12:
-      acModel = V1_2;
+      lockAcModel(V1_2);
       break;
     case 14:
-      acModel = V1_4;
+      lockAcModel(V1_4);
       break;
     case 18:
-      acModel = V1_8;
+      lockAcModel(V1_8);
+      break;
+    default:
+      // Never configured, work out the model from the display data
+      acModel = V1_2;
+      startAcModelProbe();
       break;
+  }
+}
 
+int DisplayReader::setAcModel(String acModelName) {
+  AcModels model;
+  if (acModelName == "AUTO") {
+    startAcModelProbe();
+    return 0;
+  } else if (acModelName == "V1_8") {
+    model = V1_8;
+  } else if (acModelName == "V1_4") {
+    model = V1_4;
+  } else {
+    model = V1_2;
   }
+
+  lockAcModel(model);
+  return saveAcModel(model);
 }
 
 /**
- * Spark Function letting me switch AC Models while running
- * maybe read/write this in EEPROM
- *
- * http://docs.particle.io/core/firmware/#other-functions-eeprom
+ * Switch to model and stop probing, forgets anything decoded with the previous model
  */
-int setAcModel(String acModelName) {
-  if (acModelName == "V1_8") {
-    acModel = V1_8;
-    EEPROM.write(1, 18);
-    return 18;
-  } else if (acModelName == "V1_4") {
-    acModel = V1_4;
-    EEPROM.write(1, 14);
-    return 14;
+void DisplayReader::lockAcModel(AcModels model) {
+  acModel = model;
+  modelDetector.lock();
+  stateFilter.reset();
+  decodedLen = 0;
+
+  if (capturing) {
+    uint8_t record[CAPTURE_RECORD_MAX];
+    Serial.write(record, encodeCaptureModel(record, model));
+  }
+}
+
+void DisplayReader::startAcModelProbe() {
+  modelDetector.startProbe();
+  probeFreshBytes = 0;
+  stats.modelProbes++;
+}
+
+/**
+ * Persist model to EEPROM byte 1 + unit, returns the stored flag. Only writes if it changed to
+ * spare the flash
+ */
+int DisplayReader::saveAcModel(AcModels model) {
+  uint8_t modelFlag;
+  switch (model) {
+    default:
+    case V1_2:
+      modelFlag = 12;
+      break;
+    case V1_4:
+      modelFlag = 14;
+      break;
+    case V1_8:
+      modelFlag = 18;
+      break;
+  }
+
+  if (EEPROM.read(1 + unit) != modelFlag) {
+    EEPROM.write(1 + unit, modelFlag);
+  }
+  return modelFlag;
+}
+
+bool DisplayReader::isFrameReady() const {
+  if (changedFrames.load(std::memory_order_acquire) != seenChanges) {
+    return true;
+  }
+  // While a change is still being voted on, or the model worked out, every refresh counts
+  bool settled = decodedLen > 0 && !modelDetector.isProbing();
+  return !settled && completedFrames.load(std::memory_order_acquire) != seenFrames;
+}
+
+void DisplayReader::processDisplayData() {
+  seenFrames = completedFrames.load(std::memory_order_acquire);
+  seenChanges = changedFrames.load(std::memory_order_acquire);
+
+  // Pull the bytes the ISR published since the last pass, the ring never needs interrupts off
+  struct DisplayByte newBytes[BUFFER_LEN];
+  uint32_t readBefore = readCount;
+  int newLen = byteRing.read(readCount, newBytes, BUFFER_LEN);
+  if (capturing) {
+    writeCapture(newBytes, newLen, readCount - readBefore != (uint32_t) newLen);
+  }
+
+  // Slide them onto the end of readBuffer so it always holds the newest bytes in order
+  memmove(readBuffer, readBuffer + newLen, BUFFER_LEN - newLen);
+  memmove(readPositions, readPositions + newLen, BUFFER_LEN - newLen);
+  for (int i = 0; i < newLen; i++) {
+    readBuffer[BUFFER_LEN - newLen + i] = newBytes[i].value;
+    readPositions[BUFFER_LEN - newLen + i] = newBytes[i].position;
+  }
+
+  stats.passes++;
+
+  if (modelDetector.isProbing()) {
+    probeAcModels(newLen);
   } else {
-    acModel = V1_2;
-    EEPROM.write(1, 12);
-    return 12;
+    decodeDisplayData(newLen);
   }
 }
 
 /**
- * Must be called in loop() to read the state of the AC display from the data collected by the ISR
+ * Scheduled every refreshInterval seconds nothing else was published
+ */
+void DisplayReader::publishStatusRefresh(void* reader) {
+  DisplayReader* self = (DisplayReader*) reader;
+  Spark.publish(self->config.statusRefreshEventName, self->statusJson);
+}
+
+/**
+ * Scheduled every staleInterval seconds nothing could be decoded
  */
-void processAcDisplayData() {
-  uint8_t readBuffer[BUFFER_LEN];
+void DisplayReader::publishStatusStale(void* reader) {
+  DisplayReader* self = (DisplayReader*) reader;
+  Spark.publish(self->config.statusStaleEventName, self->statusJson);
+}
+
+/**
+ * The display was just decoded, push the stale event back
+ */
+void DisplayReader::markDisplayCurrent() {
+  lastUpdate = Time.now();
+  scheduler->defer(staleTask);
+}
+
+/**
+ * Decode readBuffer with the locked model, newLen is the number of bytes that arrived this pass
+ */
+void DisplayReader::decodeDisplayData(int newLen) {
+  AcParser* acParser = getAcParser();
+  int pbLen = acParser->getDataLength();
+
+  // Fingerprint the newest complete frame, or the whole buffer if the ISR isn't finding frames
+  int latestFrame = findLatestFrame(pbLen);
+  const uint8_t* fingerprint = latestFrame >= 0 ? &readBuffer[latestFrame] : readBuffer;
+  int fingerprintLen = latestFrame >= 0 ? pbLen : BUFFER_LEN;
+
+  // Unchanged if every refresh that finished this pass is exactly what was last decoded
+  bool unchanged = decodedLen == fingerprintLen && decodedModel == acModel &&
+    memcmp(decodedBytes, fingerprint, fingerprintLen) == 0;
+  int newFrames = 0;
+  for (int rb = firstNewFrame(pbLen, newLen); unchanged && rb + pbLen <= BUFFER_LEN; rb++) {
+    if (isCompleteFrame(rb, pbLen)) {
+      unchanged = memcmp(decodedBytes, &readBuffer[rb], pbLen) == 0;
+      newFrames++;
+    }
+  }
 
-  // Copy the volatile byteBuffer to a local buffer to minimize the time that interrupts are off
-  noInterrupts();
-  memcpy(readBuffer, (const uint8_t*) byteBuffer, BUFFER_LEN);
-  // TODO use volatile uint8_t* currentByte = byteBuffer; to copy byteBuffer and fix ordering
-  interrupts();
+  if (unchanged) {
+    // Display is still showing what was last decoded, each new refresh votes for it without parsing
+    stats.decodeSkips++;
+    if (newLen > 0) {
+      markDisplayCurrent();
+      currentAcState.timestamp = lastUpdate;
+      modelDetector.addLockedResult(true);
+    }
+    struct AcState settled = currentAcState;
+    for (int i = 0; i < newFrames; i++) {
+      updateStates(&settled);
+    }
+  } else {
+    stats.decodeRuns++;
+
+    // Dump the readBuffer to a the data variable each loop to make debugging easier
+    for (int i = 0; i < BUFFER_LEN; i++) {
+      sprintf(&registerData[i * 3], "%02x ", readBuffer[i]);
+    }
+
+    // Only remember the fingerprint once the vote has settled on what it decodes to, otherwise
+    // the next pass has to decode so its new frames go into the vote
+    unsigned long attemptsBefore = stats.parseAttempts;
+    unsigned long parsedBefore = stats.parsedFrames;
+    struct AcState* lastParsed = decodeReadBuffer(acParser, pbLen, newLen);
+    if (lastParsed != NULL && !provisional && compareAcStates(lastParsed, &currentAcState)) {
+      memcpy(decodedBytes, fingerprint, fingerprintLen);
+      decodedLen = fingerprintLen;
+      decodedModel = acModel;
+    } else {
+      decodedLen = 0;
+    }
 
+    // Only passes that finished a frame count towards the error rate, part of one says nothing yet
+    if (stats.parseAttempts != attemptsBefore && modelDetector.addLockedResult(stats.parsedFrames != parsedBefore)) {
+      // Model looks wrong (hardware swap, bad EEPROM), stop decoding and work out the right one
+      probeFreshBytes = 0;
+      stats.modelProbes++;
+    }
+  }
+}
+
+/**
+ * Score every model's parser on readBuffer once BUFFER_LEN fresh bytes have arrived, locks onto and
+ * saves the winner once the detector has picked one
+ */
+void DisplayReader::probeAcModels(int newLen) {
+  probeFreshBytes += newLen;
+  if (probeFreshBytes < BUFFER_LEN) {
+    return;
+  }
+  probeFreshBytes = 0;
 
-  // Dump the readBuffer to a the data variable each loop to make debugging easier
+  // Display refreshes the ISR found frame boundaries for, every model is scored against these
+  int refreshes = 0;
   for (int i = 0; i < BUFFER_LEN; i++) {
-    sprintf(&registerData[i * 3], "%02x ", readBuffer[i]);
+    if (readPositions[i] == 0) {
+      refreshes++;
+    }
   }
 
-  // Chunk the read buffer out into parse buffers and attempt to parse each one
-  /*int pbLen = getStatusLength();*/
-  AcManager::AcParser* acParser = getAcParser();
-  int pbLen = acParser->getDataLength();
+  for (int m = 0; m < ModelDetector::MODEL_COUNT; m++) {
+    AcParser* acParser = getAcParserFor((AcModels) m);
+    int pbLen = acParser->getDataLength();
+    int frames = refreshes > 0 ? refreshes : BUFFER_LEN / pbLen;
+    int valid = 0;
 
-  uint8_t parseBuffer[pbLen];
-  for (int rb = 0; rb < BUFFER_LEN; rb++) {
-    for (int pb = 0; pb < pbLen; pb++) {
-      parseBuffer[pb] = readBuffer[(rb + pb) % BUFFER_LEN];
+    for (int rb = 0; rb + pbLen <= BUFFER_LEN; rb++) {
+      if (refreshes > 0 && !isCompleteFrame(rb, pbLen)) {
+        continue;
+      }
+
+      stats.parseAttempts++;
+      if (acParser->parseState(&probeState, &readBuffer[rb], pbLen, false)) {
+        stats.parsedFrames++;
+        valid++;
+        rb = rb + pbLen - 1;
+      }
     }
-    struct AcState *acState = &acStates[acStatesIndex];
-    bool parsed = acParser->parseState(acState, parseBuffer, pbLen);
+
+    modelDetector.addProbeResult(m, frames, valid);
+  }
+
+  int winner;
+  if (modelDetector.finishProbeSample(&winner)) {
+    lockAcModel((AcModels) winner);
+    saveAcModel((AcModels) winner);
+    Spark.publish(config.modelDetectedEventName, getAcModelVersion(acModel));
+
+    // Status carries the model version, refresh it even if the display shows the same state
+    updateVariables(&currentAcState, true);
+  }
+}
+
+/**
+ * Parse the frames in readBuffer that end in the newLen bytes that arrived this pass and feed each
+ * decoded state into the vote once, returns the most recently parsed state or NULL if nothing
+ * parsed. Older frames were voted on by the pass they arrived in
+ */
+struct AcState* DisplayReader::decodeReadBuffer(AcParser* acParser, int pbLen, int newLen) {
+  struct AcState* lastParsed = NULL;
+  int firstNew = firstNewFrame(pbLen, newLen);
+
+  // Parse each complete display refresh the ISR framed exactly once
+  bool framed = false;
+  for (int rb = 0; rb + pbLen <= BUFFER_LEN; rb++) {
+    if (!isCompleteFrame(rb, pbLen)) {
+      continue;
+    }
+    framed = true;
+    if (rb < firstNew) {
+      continue;
+    }
+
+    stats.parseAttempts++;
+    if (acParser->parseState(&parsedState, &readBuffer[rb], pbLen, true)) {
+      stats.parsedFrames++;
+      lastParsed = &parsedState;
+      rb = rb + pbLen - 1;
+      updateStates(&parsedState);
+    } else {
+      lastParsed = NULL;
+    }
+  }
+
+  if (framed) {
+    stats.framedPasses++;
+    return lastParsed;
+  }
+
+  // No frame boundaries, fall back to trying every alignment that ends in new data
+  for (int rb = firstNew; rb + pbLen <= BUFFER_LEN; rb++) {
+    stats.parseAttempts++;
+    bool parsed = acParser->parseState(&parsedState, &readBuffer[rb], pbLen, true);
     if (parsed) {
+      stats.parsedFrames++;
+      lastParsed = &parsedState;
+
       // Skip next pbLen bytes, (the end of the successfull parsed buffer)
       rb = rb + pbLen - 1;
 
       // Update the shared variables based on the state
-      updateStates();
+      updateStates(&parsedState);
     }
   }
 
-  // If no update for staleInterval publish statusStale event
-  int now = Time.now();
-  if (now - lastMessage > config.staleInterval) {
-    Spark.publish(config.statusStaleEventName, statusJson);
-    lastMessage += now + config.staleInterval;
-  }
+  return lastParsed;
 }
 
-void updateStates() {
-  // Update most recent state with the current timestamp
-  acStates[acStatesIndex].timestamp = Time.now();
+/**
+ * Start of the newest complete frame in readBuffer, -1 if there isn't one
+ */
+int DisplayReader::findLatestFrame(int frameLen) const {
+  for (int start = BUFFER_LEN - frameLen; start >= 0; start--) {
+    if (isCompleteFrame(start, frameLen)) {
+      return start;
+    }
+  }
+  return -1;
+}
 
-  // Increment states index to the next position
-  acStatesIndex = (acStatesIndex + 1) % AC_STATES_LEN;
+/**
+ * First start in readBuffer whose frameLen bytes end in one of the newLen bytes from this pass
+ */
+int DisplayReader::firstNewFrame(int frameLen, int newLen) const {
+  return max(0, BUFFER_LEN - newLen - frameLen + 1);
+}
 
-  // Track the entry with the most matches, the index it exists at and the match count for every
-  // entry
-  int maxMatches = 0;
-  int equivalentStates[AC_STATES_LEN] = { 0 };
+/**
+ * True if the frameLen bytes at start in readBuffer are exactly one display refresh
+ */
+bool DisplayReader::isCompleteFrame(int start, int frameLen) const {
+  int end = start + frameLen;
+  return readPositions[start] == 0 &&
+    readPositions[end - 1] == frameLen - 1 &&
+    (end == BUFFER_LEN || readPositions[end] == 0);
+}
 
-  // iterate through acStates comparing each entry to each other entry
-  for (int i = 0; i < AC_STATES_LEN; i++) {
-    for (int o = i + 1; o < AC_STATES_LEN; o++) {
-      if (compareAcStates(&acStates[i], &acStates[o])) {
-        maxMatches = max(maxMatches, max(++equivalentStates[i], ++equivalentStates[o]));
-      }
-    }
+void DisplayReader::updateStates(struct AcState* acState) {
+  markDisplayCurrent();
+  acState->timestamp = lastUpdate;
+
+  uint32_t winner;
+  if (stateFilter.add(acState->display, &winner)) {
+    struct AcState stableState;
+    stableState.timestamp = acState->timestamp;
+    stableState.display = winner;
+    // The first winner confirms or replaces a provisional state, a matching one changes nothing
+    provisional = false;
+    updateVariables(&stableState, false);
   }
+}
 
-  // TODO figure out better way to add this debuggging
-  /*if (maxMatches != AC_STATES_LEN - 1) {
-    char message[80];
-    sprintf(message, "mm:%d, [%d, %d, %d, %d, %d]", maxMatches, equivalentStates[0], equivalentStates[1], equivalentStates[2], equivalentStates[3], equivalentStates[4]);
-    Spark.publish("EQUIV_STATES", message);
-  }*/
-
-  if (maxMatches >= AC_STABLE_STATES) {
-    // Find the stable state with the most recent timestamp
-    int mostRecent = 0;
-    int maxIndex = -1;
-    for (int i = 0; i < AC_STATES_LEN; i++) {
-      if (equivalentStates[i] == maxMatches && acStates[i].timestamp > mostRecent) {
-        mostRecent = acStates[i].timestamp;
-        maxIndex = i;
-      }
-    }
+int DisplayReader::setStateFilter(String command) {
+  int comma = command.indexOf(",");
+  if (comma == -1) {
+    return -1;
+  }
 
-    // Protect against OOB and then update the variables
-    if (maxIndex >= 0 && maxIndex < AC_STATES_LEN) {
-      updateVariables(&acStates[maxIndex], false);
-    }
+  int window = command.substring(0, comma).toInt();
+  int quorum = command.substring(comma + 1).toInt();
+  if (!stateFilter.configure(window, quorum)) {
+    return -1;
   }
+  return window;
 }
 
-void updateVariables(struct AcState* acState, bool force) {
+void DisplayReader::updateVariables(struct AcState* acState, bool force) {
   // Record if any of the data changed, used to decide if an event should be published
   bool match = compareAcStates(&currentAcState, acState);
   if (!force && match) {
     return;
   }
 
+  if (!match) {
+    stats.stateChanges++;
+    lastStateChange = micros();
+  }
+
   // Copy the new state struct to the current state
   copyAcStates(acState, &currentAcState);
+  if (!match && !provisional) {
+    saveWarmDisplay(unit, acModel, currentAcState.display);
+  }
 
   char vSpeed[2];
   char vMode[2];
   char version[4];
 
   // TODO turn this into a function
-  switch (currentAcState.speed) {
+  switch (currentAcState.getSpeed()) {
     case FAN_OFF:
       strncpy(vSpeed, "X", 2);
       break;
@@ -317,7 +725,7 @@ void updateVariables(struct AcState* acState, bool force) {
       break;
   }
   // TODO turn this into a function
-  switch (currentAcState.mode) {
+  switch (currentAcState.getMode()) {
     case MODE_OFF:
       strncpy(vMode, "X", 2);
       break;
@@ -335,36 +743,34 @@ void updateVariables(struct AcState* acState, bool force) {
       strncpy(vMode, "?", 2);
       break;
   }
-  // TODO turn this into a function
-  switch (acModel) {
+  strncpy(version, getAcModelVersion(acModel), 4);
+
+  snprintf(statusJson, STATUS_JSON_LEN, STATUS_TEMPLATE, unit, currentAcState.getTemp(), vSpeed, vMode, version);
+  Spark.publish(force ? config.statusRefreshEventName : config.statusChangeEventName, statusJson);
+  scheduler->defer(refreshTask);
+}
+
+AcParser* DisplayReader::getAcParser() {
+  return getAcParserFor(acModel);
+}
+
+}
+
+const char* getAcModelVersion(AcModels model) {
+  switch (model) {
     case V1_2:
-      strncpy(version, "1.2", 4);
-      break;
+      return "1.2";
     case V1_4:
-      strncpy(version, "1.4", 4);
-      break;
+      return "1.4";
     case V1_8:
-      strncpy(version, "1.8", 4);
-      break;
+      return "1.8";
     default:
-      strncpy(version, "?.?", 4);
-      break;
-  }
-
-  lastUpdate = currentAcState.timestamp;
-
-  sprintf(statusJson, STATUS_TEMPLATE, currentAcState.temp, vSpeed, vMode, version);
-  if (lastUpdate - lastMessage > 300) {
-    Spark.publish(config.statusRefreshEventName, statusJson);
-    lastMessage = Time.now();
-  } else {
-    Spark.publish(config.statusChangeEventName, statusJson);
-    lastMessage = Time.now();
+      return "?.?";
   }
 }
 
-AcManager::AcParser* getAcParser() {
-  switch (acModel) {
+AcManager::AcParser* getAcParserFor(AcModels model) {
+  switch (model) {
     default:
     case V1_2:
       return &acParserV12;
@@ -376,17 +782,9 @@ AcManager::AcParser* getAcParser() {
 }
 
 bool compareAcStates(struct AcState* s1, struct AcState* s2) {
-  return s1->temp == s2->temp &&
-    s1->timer == s2->timer &&
-    s1->speed == s2->speed &&
-    s1->mode == s2->mode &&
-    s1->sleep == s2->sleep;
+  return s1->display == s2->display;
 }
 
 void copyAcStates(struct AcState* from, struct AcState* to) {
-  to->temp = from->temp;
-  to->timer = from->timer;
-  to->speed = from->speed;
-  to->mode = from->mode;
-  to->sleep = from->sleep;
+  to->display = from->display;
 }
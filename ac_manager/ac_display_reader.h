@@ -1,6 +1,8 @@
 #ifndef AC_DISPLAY_READER_H
 #define AC_DISPLAY_READER_H
 
+#include "ac_scheduler.h"
+
 /**
  * The different Frigidaire AC models supported
  */
@@ -40,12 +42,15 @@ struct AcDisplayReaderConfig {
   String statusVar;
   String dataVar;
   String setAcModelFuncName;
-  int refreshInterval;
-  int staleInterval;
+  String setStateFilterFuncName;
+  String captureFuncName;
+  int refreshInterval; // seconds without a status event before statusRefreshEventName
+  int staleInterval; // seconds without decoding the display before statusStaleEventName
   String statusChangeEventName;
   String statusRefreshEventName;
   String statusStaleEventName;
   String parseErrorEventName;
+  String modelDetectedEventName;
 };
 
 const struct AcDisplayReaderConfig AC_DISPLAY_READER_CONFIG_DEFAULTS {
@@ -54,23 +59,222 @@ const struct AcDisplayReaderConfig AC_DISPLAY_READER_CONFIG_DEFAULTS {
   .statusVar = "status",
   .dataVar = "data",
   .setAcModelFuncName = "setAcModel",
+  .setStateFilterFuncName = "setFilter",
+  .captureFuncName = "capture",
   .refreshInterval = 300,
   .staleInterval = 120,
   .statusChangeEventName = "STATUS_CHANGE",
   .statusRefreshEventName = "STATUS_REFRESH",
   .statusStaleEventName = "STATUS_STALE",
-  .parseErrorEventName = "PARSE_ERROR"
+  .parseErrorEventName = "PARSE_ERROR",
+  .modelDetectedEventName = "MODEL_DETECTED"
+};
+
+/**
+ * Counters describing how much work processAcDisplayData is doing
+ */
+struct AcDisplayReaderStats {
+  unsigned long passes; // calls to processAcDisplayData
+  unsigned long framedPasses; // passes that found frame boundaries tagged by the ISR
+  unsigned long parseAttempts; // calls to AcParser::parseState
+  unsigned long parsedFrames; // parseState calls that produced a state
+  unsigned long decodeSkips; // passes skipped because the display data was unchanged
+  unsigned long decodeRuns; // passes that had to decode the display data
+  unsigned long modelProbes; // times model detection started, at boot, from setAcModel or on errors
+  unsigned long stateChanges; // times the reported state changed
+};
+
+// The reader keeps these for every unit, the parser headers above only need the enums
+#include "ac_parser.h"
+#include "ac_state_filter.h"
+#include "ac_model_detector.h"
+#include "ac_units.h"
+#include "ac_capture.h"
+#include "isr_ring.h"
+
+// The shift register sees 5 or 6 bytes repeatedly, 30 is a reasonable common multiplier
+#define BUFFER_LEN 30
+#define RING_LEN 64 // bytes the ISR can queue up for processDisplayData, must be a power of 2
+#define STATUS_JSON_LEN 128
+
+/**
+ * A byte read from the shift register tagged with its position in the display refresh it was part
+ * of, position 0 is the first byte after a FRAME_GAP_MIN gap
+ */
+struct DisplayByte {
+  uint8_t value;
+  uint8_t position;
+  uint16_t sinceLast; // micros from the start of the byte before, CAPTURE_GAP_UNKNOWN if over 0xFFFF
+};
+
+namespace AcManager {
+
+/**
+ * Reads one unit's display off its shift register pins and votes the decoded frames into the
+ * reported state.
+ *
+ * The clock ISR only assembles bytes into the ring, everything else runs from processDisplayData
+ * in loop(). attachInterrupt handlers take no argument, so each unit's clock pin calls a trampoline
+ * that finds the reader by unit. Unit 0's config names the setAcModel, setFilter and capture cloud
+ * functions, which take an optional "<unit>:" prefix.
+ */
+class DisplayReader {
+  public:
+    DisplayReader();
+
+    /**
+     * Start reading the display as unit, the refresh and stale events are scheduled on scheduler.
+     * Returns false if unit is out of range, or if scheduler had no room for the events. The
+     * display is still read then, only the events that didn't fit never fire
+     */
+    bool init(int unit, struct AcDisplayReaderConfig config, Scheduler* scheduler);
+
+    /**
+     * Must be called in loop() to read the state of the AC display from the data collected by the
+     * ISR
+     */
+    void processDisplayData();
+
+    /**
+     * True once the display has finished a refresh processDisplayData needs to see: one that
+     * differs from the refresh before it, or any refresh while a change is still being voted on
+     */
+    bool isFrameReady() const;
+
+    struct AcDisplayReaderStats getStats() const { return stats; }
+    uint32_t getLastStateChangeMicros() const { return lastStateChange; } // micros() when the reported state last changed
+
+    bool isAcOn() const;
+    int getTemp() const { return currentAcState.getTemp(); }
+    double getTimer() const { return currentAcState.getTimer(); }
+    enum FanSpeeds getFanSpeed() const { return currentAcState.getSpeed(); }
+    enum AcModes getAcMode() const { return currentAcState.getMode(); }
+    enum AcModels getAcModel() const { return acModel; }
+    bool isDetectingAcModel() const { return modelDetector.isProbing(); }
+
+    /**
+     * True while the reported state is the one restored from before the last reset and no display
+     * frames have been voted on yet to confirm it
+     */
+    bool isAcStateProvisional() const { return provisional; }
+    int getUnit() const { return unit; }
+
+    /**
+     * Switch AC models while running, "AUTO" detects the model from the display data. The model
+     * is stored in EEPROM byte 1 + unit
+     */
+    int setAcModel(String acModelName);
+
+    /**
+     * Tune the state vote, expects "window,quorum" e.g. "5,3". A state must be decoded from quorum
+     * of the last window display refreshes before it is reported, each refresh votes once.
+     */
+    int setStateFilter(String command);
+
+    /**
+     * Start or stop streaming the raw display bytes out over Serial in the ac_capture.h format,
+     * for building a replay corpus. Only one unit should capture at a time
+     */
+    void setCapture(bool on);
+    bool isCapturing() const { return capturing; }
+
+    /**
+     * Clock ISR body, see the trampolines in ac_display_reader.cpp
+     */
+    void onClock();
+
+    /**
+     * Hand in a captured byte as if onClock had just finished clocking it, sinceLast micros after
+     * the byte before it. Lets tools/ac_replay run captures through the real framing and decoding
+     */
+    void replayByte(uint8_t value, uint16_t sinceLast);
+
+    // Steps of processDisplayData, public so the bench can drive them on their own
+    void lockAcModel(enum AcModels model);
+    void startAcModelProbe();
+    void probeAcModels(int newLen);
+    void restoreWarmAcState();
+    void updateStates(struct AcState* acState);
+    AcParser* getAcParser();
+
+  private:
+    int unit;
+    struct AcDisplayReaderConfig config;
+
+    // Used by the ISR to track the shift register
+    unsigned int cycleStart;
+    uint8_t shiftRegister; // byte currently being clocked in, only touched by the ISR
+    uint8_t framePosition; // position of shiftRegister in the display refresh
+    uint16_t byteGap; // sinceLast of shiftRegister
+    IsrRing<struct DisplayByte, RING_LEN> byteRing; // completed bytes, ISR -> processDisplayData
+    uint32_t frameHash; // hash of the bytes so far in the refresh being clocked in
+    uint32_t lastFrameHash;
+    std::atomic<uint32_t> completedFrames; // display refreshes the ISR has seen end
+    std::atomic<uint32_t> changedFrames; // completed refreshes that differed from the one before
+
+    // completedFrames and changedFrames as of the last processDisplayData pass
+    uint32_t seenFrames;
+    uint32_t seenChanges;
+
+    // Newest BUFFER_LEN bytes from the ring in arrival order, only touched by processDisplayData
+    uint8_t readBuffer[BUFFER_LEN];
+    uint8_t readPositions[BUFFER_LEN];
+    uint32_t readCount;
+    struct AcDisplayReaderStats stats;
+
+    // Fingerprint of the bytes behind currentAcState, lets unchanged display data skip decoding
+    uint8_t decodedBytes[BUFFER_LEN];
+    int decodedLen;
+    enum AcModels decodedModel;
+
+    // Model detection, probes score every parser on each BUFFER_LEN bytes of fresh data
+    ModelDetector modelDetector;
+    int probeFreshBytes;
+    struct AcState probeState;
+
+    // Overall state tracking
+    enum AcModels acModel;
+    long lastUpdate; // unix seconds of successful data parse
+    Scheduler* scheduler;
+    int refreshTask; // publishes statusRefreshEventName once nothing was published for refreshInterval
+    int staleTask; // publishes statusStaleEventName once nothing was decoded for staleInterval
+    struct AcState currentAcState;
+    bool provisional; // currentAcState came from the warm state and no frame has confirmed it yet
+    uint32_t lastStateChange; // micros() currentAcState last changed, 32 bits like batchStart it is compared to
+    struct AcState parsedState; // Destination for parseState before the state is voted on
+    StateFilter stateFilter;
+    char statusJson[STATUS_JSON_LEN];
+    char registerData[(BUFFER_LEN * 3) + 1];
+    bool capturing; // see setCapture
+
+    static void publishStatusRefresh(void* reader);
+    static void publishStatusStale(void* reader);
+    void startByte(unsigned int sinceLast);
+    void pushByte(uint8_t value);
+    void writeCapture(const struct DisplayByte bytes[], int len, bool lost);
+    void markDisplayCurrent();
+    void loadAcModel();
+    int saveAcModel(enum AcModels model);
+    void decodeDisplayData(int newLen);
+    struct AcState* decodeReadBuffer(AcParser* acParser, int pbLen, int newLen);
+    int findLatestFrame(int frameLen) const;
+    int firstNewFrame(int frameLen, int newLen) const;
+    bool isCompleteFrame(int start, int frameLen) const;
+    void updateVariables(struct AcState* acState, bool force);
 };
 
-void initAcDisplayReader(struct AcDisplayReaderConfig config);
-void processAcDisplayData();
+}
+
+/**
+ * The reader initialised as unit, NULL if there isn't one
+ */
+AcManager::DisplayReader* getAcDisplayReader(int unit);
+
+/**
+ * Sleep until any unit's isFrameReady or maxMillis pass, returns true if one is ready
+ */
+bool waitForAcDisplayFrame(unsigned long maxMillis);
 
-bool isAcOn();
-int getTemp();
-double getTimer();
-enum FanSpeeds getFanSpeed();
-enum AcModes getAcMode();
-enum AcModels getAcModel();
 enum AcModes getModeForName(String modeName);
 enum FanSpeeds getSpeedForName(String speedName);
 
@@ -1,26 +1,30 @@
 #include "application.h"
 #include "ac_parser.h"
+#include "isr_ring.h"
+#include "ac_display_reader.h"
 
 #ifndef AC_DISPLAY_READER_P_H
 #define AC_DISPLAY_READER_P_H
 
-// The shift register sees 5 or 6 bytes repeatedly, 30 is a reasonable common multiplier
-#define BUFFER_LEN 30
 #define UPDATE_TIME_MAX 500 // max time in micros the AC controller spends pushing data into the register
+#define FRAME_GAP_MIN 3000 // min time in micros between bytes that marks the start of a new display refresh
+#define FRAME_POSITION_UNKNOWN 0xFF // no frame gap seen yet or the frame is longer than any model's
+#define FRAME_HASH_SEED 2166136261u // FNV-1a, tells the ISR if a refresh differs from the last one
+#define FRAME_HASH_PRIME 16777619u
 
-#define AC_STATES_LEN 5
-#define AC_STABLE_STATES 2
+#define AC_STATES_LEN 5 // default number of decoded states the vote looks back over
+#define AC_STABLE_STATES 2 // default number of other states in the window that must agree
+#define AC_STATES_QUORUM (AC_STABLE_STATES + 1)
 
-static const char STATUS_TEMPLATE[] = "{\"temp\":%d,\"fan\":\"%s\",\"mode\":\"%s\",\"version\":\"%s\"}";
+static const char STATUS_TEMPLATE[] = "{\"unit\":%d,\"temp\":%d,\"fan\":\"%s\",\"mode\":\"%s\",\"version\":\"%s\"}";
 
-int setAcModel(String acModelName);
-void clock_Interrupt_Handler();
-void loadAcModel();
-AcManager::AcParser* getAcParser();
-void updateStates();
+int setAcModel(String command);
+int setStateFilter(String command);
+int setCapture(String command);
+const char* getAcModelVersion(AcModels model);
+AcManager::AcParser* getAcParserFor(AcModels model);
 bool compareAcStates(struct AcState* s1, struct AcState* s2);
 void copyAcStates(struct AcState* from, struct AcState* to);
-void updateVariables(struct AcState* acState, bool force);
 
 AcModes decodeAcMode(uint8_t modeFanBits);
 FanSpeeds decodeFanSpeed(uint8_t modeFanBits);
@@ -0,0 +1,68 @@
+#include "application.h"
+#include "ac_hold_calibration.h"
+#include "ac_ir_controller_p.h"
+
+// Micros a full frame and a repeat code are on air, NEC codes have as many ones as zeros since the
+// second byte of each pair is the first inverted
+#define NEC_FRAME_MICROS (NEC_HDR_MARK + NEC_HDR_SPACE + \
+  NEC_BITS / 2 * (2 * NEC_BIT_MARK + NEC_ONE_SPACE + NEC_ZERO_SPACE) + NEC_BIT_MARK)
+#define NEC_REPEAT_MICROS (NEC_HDR_MARK + NEC_RPT_SPACE + NEC_BIT_MARK)
+
+namespace AcManager {
+
+HoldCalibration::HoldCalibration() {
+  reset();
+}
+
+void HoldCalibration::reset() {
+  repeatsPerStep16 = DEFAULT_REPEATS_PER_STEP * 16;
+  misses = 0;
+  autoRepeat = true;
+}
+
+bool HoldCalibration::shouldHold(int steps, unsigned long maxMicros) const {
+  if (!autoRepeat || steps <= 1) {
+    return false;
+  }
+  // Repeat codes go out every NEC_RPT_PERIOD, a held move takes longer than pressing so it has to
+  // fit in what is left for it
+  int repeats = repeatsFor(steps);
+  if ((unsigned long) repeats * NEC_RPT_PERIOD > maxMicros) {
+    return false;
+  }
+  unsigned long held = NEC_FRAME_MICROS + (unsigned long) repeats * NEC_REPEAT_MICROS;
+  return held < (unsigned long) steps * NEC_FRAME_MICROS;
+}
+
+int HoldCalibration::repeatsFor(int steps) const {
+  if (steps <= 1) {
+    return 0;
+  }
+  return DELAY_REPEATS + ((steps - 1) * repeatsPerStep16 + 8) / 16;
+}
+
+void HoldCalibration::record(int repeats, int steps) {
+  if (steps <= 0 || repeats <= DELAY_REPEATS) {
+    // Nothing moved (unit busy, IR missed) or the hold was too short to say anything
+    return;
+  }
+
+  if (steps == 1) {
+    // Held well past the delay and still only one step, either steps are slower than thought or
+    // the unit doesn't auto repeat
+    misses++;
+    repeatsPerStep16 = min(repeatsPerStep16 * 2, MAX_REPEATS_PER_STEP * 16);
+    if (misses >= MAX_MISSES) {
+      autoRepeat = false;
+    }
+    return;
+  }
+
+  // Move a quarter of the way towards what this hold measured
+  misses = 0;
+  int measured16 = ((repeats - DELAY_REPEATS) * 16) / (steps - 1);
+  repeatsPerStep16 += (measured16 - repeatsPerStep16) / 4;
+  repeatsPerStep16 = constrain(repeatsPerStep16, 16, MAX_REPEATS_PER_STEP * 16);
+}
+
+}
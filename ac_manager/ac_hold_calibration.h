@@ -0,0 +1,56 @@
+#include "application.h"
+
+#ifndef AC_HOLD_CALIBRATION_H
+#define AC_HOLD_CALIBRATION_H
+
+namespace AcManager {
+
+/**
+ * Learns how a model's temperature/timer buttons respond to being held, so a multi step move can be
+ * sent as one press plus NEC repeat codes instead of a full frame per step.
+ *
+ * The unit is assumed to step once for the press, wait DELAY_REPEATS repeat codes and then step
+ * again every repeatsPerStep repeat codes. repeatsPerStep is learned from how far the display
+ * actually moved. A move is only held when that is on air for less time than a frame per step and
+ * the hold is over within the time it is given. Repeat codes go out every NEC_RPT_PERIOD, so a held
+ * move is slower than pressing even when it is on air for a fraction of the time. Units that don't
+ * auto repeat at all are detected and fall back to single presses.
+ */
+class HoldCalibration {
+  public:
+    static const int DELAY_REPEATS = 4; // repeat codes before auto repeat starts, about 430ms
+    static const int DEFAULT_REPEATS_PER_STEP = 2;
+    static const int MAX_REPEATS_PER_STEP = 16;
+    static const int MAX_MISSES = 2; // holds in a row that only moved one step before giving up
+
+    HoldCalibration();
+    void reset();
+
+    /**
+     * True if a move of steps is on air for less time held than as single presses and the repeat
+     * codes are all sent within maxMicros
+     */
+    bool shouldHold(int steps, unsigned long maxMicros) const;
+
+    /**
+     * Repeat codes to send after the first frame to move steps
+     */
+    int repeatsFor(int steps) const;
+
+    /**
+     * Record that holding for repeats repeat codes moved the display steps
+     */
+    void record(int repeats, int steps);
+
+    bool hasAutoRepeat() const { return autoRepeat; }
+    int getRepeatsPerStep16() const { return repeatsPerStep16; }
+
+  private:
+    int repeatsPerStep16; // fixed point, 1/16ths of a repeat code
+    int misses;
+    bool autoRepeat;
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "application.h"
+#include "ac_ir_carrier.h"
+
+namespace AcManager {
+
+PwmIrCarrier::PwmIrCarrier(unsigned int frequency, int dutyPercent) :
+  pin(-1), frequency(frequency), duty((uint8_t) ((255 * dutyPercent) / 100)) {}
+
+void PwmIrCarrier::begin(int carrierPin) {
+  pin = carrierPin;
+  pinMode(pin, OUTPUT);
+  analogWrite(pin, 0, frequency);
+}
+
+void PwmIrCarrier::on(uint32_t markStart) {
+  analogWrite(pin, duty, frequency);
+}
+
+void PwmIrCarrier::off() {
+  analogWrite(pin, 0, frequency);
+}
+
+ToggleIrCarrier::ToggleIrCarrier(unsigned int highMicros, unsigned int lowMicros) :
+  pin(-1), highMicros(highMicros), lowMicros(lowMicros), active(false), high(false), edgeAt(0) {}
+
+void ToggleIrCarrier::begin(int carrierPin) {
+  pin = carrierPin;
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+}
+
+void ToggleIrCarrier::on(uint32_t markStart) {
+  active = true;
+  high = true;
+  edgeAt = markStart + highMicros;
+  digitalWrite(pin, HIGH);
+}
+
+void ToggleIrCarrier::off() {
+  active = false;
+  high = false;
+  digitalWrite(pin, LOW);
+}
+
+bool ToggleIrCarrier::nextEdge(uint32_t* at) {
+  if (!active) {
+    return false;
+  }
+  *at = edgeAt;
+  return true;
+}
+
+void ToggleIrCarrier::toggle() {
+  high = !high;
+  edgeAt += high ? highMicros : lowMicros;
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+int pwmTimer(int pin) {
+  switch (pin) {
+    case D0:
+    case D1:
+      return 4;
+    case D2:
+    case D3:
+    case A4:
+    case A5:
+      return 3;
+    case A7:
+      return 5;
+    default:
+      return 0;
+  }
+}
+
+bool isPwmPin(int pin) {
+  return pwmTimer(pin) != 0;
+}
+
+}
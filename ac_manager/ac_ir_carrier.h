@@ -0,0 +1,84 @@
+#include "application.h"
+
+#ifndef AC_IR_CARRIER_H
+#define AC_IR_CARRIER_H
+
+namespace AcManager {
+
+/**
+ * Generates the IR carrier on the LED pin during marks. The transmitter calls on() and off() at
+ * mark boundaries from its timer ISR, a carrier that can't run on its own also asks for a timer
+ * interrupt at every carrier edge through nextEdge().
+ */
+class IrCarrier {
+  public:
+    virtual ~IrCarrier() {};
+    virtual void begin(int pin) = 0;
+
+    /**
+     * Start of a mark at markStart micros
+     */
+    virtual void on(uint32_t markStart) = 0;
+    virtual void off() = 0;
+
+    /**
+     * Software carriers return true and the micros of their next edge while on, toggle() is then
+     * called at that time. Hardware carriers always return false.
+     */
+    virtual bool nextEdge(uint32_t* at) { return false; }
+    virtual void toggle() {}
+};
+
+/**
+ * Carrier from the pin's PWM timer, the CPU is only involved at mark boundaries. Only works on pins
+ * with a PWM timer, see isPwmPin
+ */
+class PwmIrCarrier : public IrCarrier {
+  public:
+    PwmIrCarrier(unsigned int frequency, int dutyPercent);
+    void begin(int pin);
+    void on(uint32_t markStart);
+    void off();
+
+  private:
+    int pin;
+    unsigned int frequency;
+    uint8_t duty; // analogWrite value
+};
+
+/**
+ * Carrier toggled from the transmitter's timer ISR, works on any pin but takes an interrupt per
+ * carrier edge. Edge times are kept absolute from the mark start so ISR latency doesn't drift.
+ */
+class ToggleIrCarrier : public IrCarrier {
+  public:
+    ToggleIrCarrier(unsigned int highMicros, unsigned int lowMicros);
+    void begin(int pin);
+    void on(uint32_t markStart);
+    void off();
+    bool nextEdge(uint32_t* at);
+    void toggle();
+
+  private:
+    int pin;
+    unsigned int highMicros;
+    unsigned int lowMicros;
+    bool active;
+    bool high;
+    uint32_t edgeAt;
+};
+
+/**
+ * The Photon timer (3 for TIM3) that makes PWM on the pin, 0 if it has none. Every pin on a timer
+ * runs at the same frequency and an IntervalTimer on it takes it over
+ */
+int pwmTimer(int pin);
+
+/**
+ * True if the pin has a PWM timer on the Photon
+ */
+bool isPwmPin(int pin);
+
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "application.h"
+
+#ifndef AC_IR_COMMANDS_H
+#define AC_IR_COMMANDS_H
+
+/**
+ * Buttons on the Frigidaire remote, index into AC_COMMAND_CODES
+ */
+enum AcCommands {
+  AC_CMD_ON_OFF,
+  AC_CMD_TIMER,
+  AC_CMD_FAN_SPEED_U,
+  AC_CMD_FAN_SPEED_D,
+  AC_CMD_TEMP_TIMER_U,
+  AC_CMD_TEMP_TIMER_D,
+  AC_CMD_COOL,
+  AC_CMD_ENERGY_SAVER,
+  AC_CMD_AUTO_FAN,
+  AC_CMD_FAN_ONLY,
+  AC_CMD_SLEEP,
+  AC_CMD_COUNT
+};
+
+// NEC code sent for each AcCommands value
+static const unsigned int AC_COMMAND_CODES[AC_CMD_COUNT] = {
+  0x10AF8877, // AC_CMD_ON_OFF
+  0x10AF609F, // AC_CMD_TIMER
+  0x10AF807F, // AC_CMD_FAN_SPEED_U
+  0x10AF20DF, // AC_CMD_FAN_SPEED_D
+  0x10AF708F, // AC_CMD_TEMP_TIMER_U
+  0x10AFB04F, // AC_CMD_TEMP_TIMER_D
+  0x10AF906F, // AC_CMD_COOL
+  0x10AF40BF, // AC_CMD_ENERGY_SAVER
+  0x10AFF00F, // AC_CMD_AUTO_FAN
+  0x10AFE01F, // AC_CMD_FAN_ONLY
+  0x10AF00FF  // AC_CMD_SLEEP
+};
+
+#endif
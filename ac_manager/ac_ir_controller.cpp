@@ -1,24 +1,213 @@
 #include "application.h"
+#include "SparkIntervalTimer.h"
 #include "ac_ir_controller.h"
 #include "ac_ir_controller_p.h"
+#include "isr_ring.h"
+#include "ac_ir_carrier.h"
 
-unsigned long sigTime = 0; //use in mark & space functions to keep track of time
-int txPinIR;
-int lastStartMillis = 0;
+// Waveform for each remote button, compiled by IrTransmitter::init and shared by every unit
+struct IrWaveform irWaveforms[AC_CMD_COUNT];
+
+// NEC repeat code, sent while a button is held after the first full frame
+const struct IrWaveform IR_REPEAT_WAVEFORM = {.length = 3, .micros = {NEC_HDR_MARK, NEC_RPT_SPACE, NEC_BIT_MARK}};
+
+// Transmitters by unit, for the timer trampolines and the sendNEC cloud function
+AcManager::IrTransmitter* registeredTransmitters[AC_UNITS_MAX];
+
+template <int UNIT>
+void irTimerTrampoline() {
+  registeredTransmitters[UNIT]->onTimer();
+}
+
+static_assert(AC_UNITS_MAX == 3, "one trampoline per unit");
+void (* const IR_TIMER_TRAMPOLINES[AC_UNITS_MAX])() = {irTimerTrampoline<0>, irTimerTrampoline<1>, irTimerTrampoline<2>};
+
+// Each unit's hardware timer. TIM6 and TIM7 drive no pins and TIM5 only A7's PWM, so the timers of
+// the other PWM pins (TIM3 for A4/A5, TIM4 for D0/D1) are left to the carriers
+const TIMid IR_UNIT_TIMERS[AC_UNITS_MAX] = {TIMER7, TIMER6, TIMER5};
+
+namespace AcManager {
+
+IrTransmitter::IrTransmitter() :
+  unit(-1), txPin(-1), pwmCarrier(Carrier_Frequency, Duty_Cycle), toggleCarrier(HIGHTIME, LOWTIME),
+  carrier(&toggleCarrier), active(false), txSegments(0), txRepeats(0), txSegment(IR_SEGMENT_IDLE),
+  segmentEnd(0), wakeAt(0), lastFrameStart(0), sentFrame(false), frameSpacing(IR_FRAME_SPACING) {
+}
+
+bool IrTransmitter::init(int unit, String funcKey, int irLedPin) {
+  if (unit < 0 || unit >= AC_UNITS_MAX) {
+    return false;
+  }
+  this->unit = unit;
+  registeredTransmitters[unit] = this;
+
+  txPin = irLedPin;
+  carrier = hasPwmTimer(txPin) ? (IrCarrier*) &pwmCarrier : &toggleCarrier;
+  carrier->begin(txPin);
+
+  if (unit == 0) {
+    Spark.function(funcKey, sendNEC);
+  }
+
+  for (int i = 0; i < AC_CMD_COUNT; i++) {
+    compileNECWaveform(AC_COMMAND_CODES[i], &irWaveforms[i]);
+  }
+  return true;
+}
+
+int IrTransmitter::sendNECCode(unsigned int codeBin) {
+  struct IrFrame frame = {.waveform = NULL, .code = codeBin, .repeats = 0};
+  return queueFrame(frame);
+}
+
+int IrTransmitter::sendIrCommand(enum AcCommands command) {
+  const struct IrWaveform* waveform = getIrWaveform(command);
+  if (waveform == NULL) {
+    return -1;
+  }
+
+  struct IrFrame frame = {.waveform = waveform, .code = AC_COMMAND_CODES[command], .repeats = 0};
+  return queueFrame(frame);
+}
+
+int IrTransmitter::holdIrCommand(enum AcCommands command, int repeats) {
+  const struct IrWaveform* waveform = getIrWaveform(command);
+  if (waveform == NULL || repeats < 0) {
+    return -1;
+  }
+
+  struct IrFrame frame = {.waveform = waveform, .code = AC_COMMAND_CODES[command], .repeats = (uint8_t) min(repeats, 255)};
+  return queueFrame(frame);
+}
+
+bool IrTransmitter::hasPwmTimer(int pin) {
+  // The carrier can only have the pin's timer if no transmitter's IntervalTimer runs on it
+  for (int u = 0; u < AC_UNITS_MAX; u++) {
+    if (pwmTimer(pin) == 3 + IR_UNIT_TIMERS[u] - TIMER3) {
+      return false;
+    }
+  }
+  return isPwmPin(pin);
+}
+
+unsigned long IrTransmitter::setFrameSpacing(unsigned long micros) {
+  frameSpacing = constrain(micros, (unsigned long) IR_FRAME_SPACING_MIN, (unsigned long) IR_FRAME_SPACING_MAX);
+  return frameSpacing;
+}
+
+/**
+ * Queue frame to be sent, returns right away. The frame goes out from onTimer at least
+ * frameSpacing after the start of the previous one.
+ */
+int IrTransmitter::queueFrame(const struct IrFrame& frame) {
+  if (!queue.push(frame)) {
+    return IR_QUEUE_FULL;
+  }
+
+  // The ISR only stops after finding the queue empty, so if it is still active it will get this code
+  if (!active) {
+    uint32_t now = micros();
+    uint32_t sinceLast = now - lastFrameStart;
+    wakeAt = (sentFrame && sinceLast < frameSpacing) ? lastFrameStart + frameSpacing : now;
+    txSegment = IR_SEGMENT_IDLE;
+    txRepeats = 0;
+    active = true;
+    timer.begin(IR_TIMER_TRAMPOLINES[unit], IR_TIMER_MIN_PERIOD, uSec, IR_UNIT_TIMERS[unit]);
+    scheduleTimer(now);
+  }
+
+  return 1;
+}
+
+/**
+ * Timer ISR that plays the queued NEC frames. Every mark and space edge is its own timer interrupt,
+ * plus every carrier edge when the carrier is toggled in software. Edge times are tracked
+ * absolutely so ISR latency never accumulates over the frame. Interrupts stay on so the display
+ * readers keep running.
+ */
+void IrTransmitter::onTimer() {
+  uint32_t now = micros();
+  if ((int32_t) (wakeAt - now) > 0) {
+    // Long wait that didn't fit in one timer period
+    scheduleTimer(now);
+    return;
+  }
+
+  if (txSegment == IR_SEGMENT_IDLE) {
+    if (txRepeats > 0) {
+      // Button still held
+      txRepeats--;
+      txFrame.waveform = &IR_REPEAT_WAVEFORM;
+    } else if (queue.pop(txFrame)) {
+      txRepeats = txFrame.repeats;
+    } else {
+      active = false;
+      timer.end();
+      return;
+    }
+
+    txSegment = 0;
+    txSegments = frameSegments(txFrame);
+    lastFrameStart = now;
+    sentFrame = true;
+    segmentEnd = now + frameSegmentMicros(txFrame, 0);
+    carrier->on(now);
+  } else if ((int32_t) (segmentEnd - now) <= 0) {
+    txSegment++;
+    if (txSegment == txSegments) {
+      // Frame done, repeat codes follow on the NEC repeat period, anything else waits out the spacing
+      carrier->off();
+      txSegment = IR_SEGMENT_IDLE;
+      wakeAt = lastFrameStart + (txRepeats > 0 ? NEC_RPT_PERIOD : frameSpacing);
+      scheduleTimer(now);
+      return;
+    }
+
+    uint32_t segmentStart = segmentEnd;
+    segmentEnd = segmentStart + frameSegmentMicros(txFrame, txSegment);
+    if ((txSegment & 1) == 0) {
+      carrier->on(segmentStart);
+    } else {
+      carrier->off();
+    }
+  } else {
+    // Software carrier edge inside a mark
+    carrier->toggle();
+  }
+
+  // Wake at the end of the segment, or the next carrier edge if the carrier needs the ISR
+  uint32_t edgeAt;
+  wakeAt = (carrier->nextEdge(&edgeAt) && (int32_t) (edgeAt - segmentEnd) < 0) ? edgeAt : segmentEnd;
+  scheduleTimer(now);
+}
+
+/**
+ * Point timer at wakeAt, or as far towards it as one timer period goes
+ */
+void IrTransmitter::scheduleTimer(uint32_t now) {
+  int32_t delta = (int32_t) (wakeAt - now);
+  intPeriod period = (intPeriod) constrain(delta, IR_TIMER_MIN_PERIOD, IR_TIMER_MAX_PERIOD);
+  timer.resetPeriod_SIT(period, uSec);
+}
 
-void initIrController(String funcKey, int irLedPin) {
-  txPinIR = irLedPin;
-  pinMode(txPinIR, OUTPUT);
-  Spark.function(funcKey, sendNEC);
 }
 
 int sendNEC(String command) {
-  if (command.length() != 8) {
+  int unit = takeAcUnit(&command);
+  AcManager::IrTransmitter* transmitter = getIrTransmitter(unit);
+  if (transmitter == NULL || command.length() != 8) {
     return -1;
   }
 
   unsigned int codeBin = decodeNECHex(command);
-  return sendNECCode(codeBin);
+  return transmitter->sendNECCode(codeBin);
+}
+
+AcManager::IrTransmitter* getIrTransmitter(int unit) {
+  if (unit < 0 || unit >= AC_UNITS_MAX) {
+    return NULL;
+  }
+  return registeredTransmitters[unit];
 }
 
 unsigned int decodeNECHex(String codeHex) {
@@ -29,53 +218,43 @@ unsigned int decodeNECHex(String codeHex) {
   return h;
 }
 
-int sendNECCode(unsigned int codeBin) {
-  // Don't send IR codes more than once every 110ms
-  int sleepTime = min(110, max(0, 110 - (millis() - lastStartMillis)));
-  if (sleepTime > 0) {
-    delay(sleepTime);
+const struct IrWaveform* getIrWaveform(enum AcCommands command) {
+  if (command < 0 || command >= AC_CMD_COUNT) {
+    return NULL;
   }
+  return &irWaveforms[command];
+}
 
-  // Disable interrupts while sending IR code to not break the timing
-  noInterrupts();
-
-  sigTime = micros(); //keeps rolling track of signal time to avoid impact of loop & code execution delays
-  mark(NEC_HDR_MARK);
-  space(NEC_HDR_SPACE);
-  for (int i = NEC_BITS - 1; i >= 0; i--) {
-    mark(NEC_BIT_MARK);
-    if (codeBin & (1<<i)) {
-      space(NEC_ONE_SPACE);
-    } else {
-      space(NEC_ZERO_SPACE);
-    }
+/**
+ * Lay out the marks and spaces of the NEC frame for codeBin
+ */
+void compileNECWaveform(unsigned int codeBin, struct IrWaveform* dest) {
+  dest->length = NEC_SEGMENTS;
+  for (int i = 0; i < NEC_SEGMENTS; i++) {
+    dest->micros[i] = necSegmentMicros(codeBin, i);
   }
-  mark(NEC_BIT_MARK);
-
-  interrupts();
-
-  return 1;
 }
 
-void mark(unsigned int mLen) { //uses sigTime as end parameter
-  sigTime+= mLen; //mark ends at new sigTime
-  unsigned long now = micros();
-  if (now >= sigTime) return;
-
-  unsigned long dur = sigTime - now; //allows for rolling time adjustment due to code execution delays
-  while ((micros() - now) < dur) { //just wait here until time is up
-    digitalWrite(txPinIR, HIGH);
-    delayMicroseconds(HIGHTIME - 3);
-    digitalWrite(txPinIR, LOW);
-    delayMicroseconds(LOWTIME - 4);
+/**
+ * Length of one mark or space of the NEC frame for codeBin, MSB first
+ */
+unsigned int necSegmentMicros(unsigned int codeBin, int segment) {
+  if (segment == 0) {
+    return NEC_HDR_MARK;
+  } else if (segment == 1) {
+    return NEC_HDR_SPACE;
+  } else if ((segment & 1) == 0) {
+    return NEC_BIT_MARK;
   }
+
+  int bit = NEC_BITS - 1 - ((segment - 3) / 2);
+  return (codeBin & (1u << bit)) ? NEC_ONE_SPACE : NEC_ZERO_SPACE;
 }
 
-void space(unsigned int sLen) { //uses sigTime as end parameter
-  sigTime+= sLen; //space ends at new sigTime
-  unsigned long now = micros();
-  if (now >= sigTime) return;
+unsigned int frameSegmentMicros(const struct IrFrame& frame, int segment) {
+  return frame.waveform != NULL ? frame.waveform->micros[segment] : necSegmentMicros(frame.code, segment);
+}
 
-  unsigned long dur = sigTime - now; //allows for rolling time adjustment due to code execution delays
-  while ((micros() - now) < dur) ; //just wait here until time is up
+int frameSegments(const struct IrFrame& frame) {
+  return frame.waveform != NULL ? frame.waveform->length : NEC_SEGMENTS;
 }
@@ -3,7 +3,116 @@
 #ifndef AC_IR_CONTROLLER_H
 #define AC_IR_CONTROLLER_H
 
-void initIrController(String funcKey, int irLedPin);
+#include "SparkIntervalTimer.h"
+#include "ac_ir_commands.h"
+#include "ac_ir_controller_p.h"
+#include "ac_ir_carrier.h"
+#include "ac_units.h"
+#include "isr_ring.h"
+
+#define IR_QUEUE_FULL -2 // sendNEC result when the transmit queue has no room
+
+namespace AcManager {
+
+/**
+ * One unit's IR LED. Frames are queued and played in the background by the transmitter's own
+ * hardware timer, every mark and space edge is a timer interrupt. IntervalTimer callbacks take no
+ * argument so each unit's timer calls a trampoline that finds the transmitter by unit.
+ */
+class IrTransmitter {
+  public:
+    IrTransmitter();
+
+    /**
+     * Send from irLedPin as unit. Unit 0 also registers funcKey, the sendNEC cloud function every
+     * unit shares. Returns false if unit is out of range
+     */
+    bool init(int unit, String funcKey, int irLedPin);
+
+    /**
+     * Queue a 32 bit NEC code, returns 1 once queued or IR_QUEUE_FULL
+     */
+    int sendNECCode(unsigned int codeBin);
+
+    /**
+     * Queue one of the remote's buttons, same results as sendNECCode or -1 for a bad command. Uses
+     * the waveform compiled at init so nothing is parsed or computed per call
+     */
+    int sendIrCommand(enum AcCommands command);
+
+    /**
+     * Queue a button press held for repeats NEC repeat codes, one every 108ms after the first frame.
+     * Takes one queue slot no matter how long the hold
+     */
+    int holdIrCommand(enum AcCommands command, int repeats);
+
+    /**
+     * Change the micros from the start of one frame to the start of the next, clamped to what a NEC
+     * receiver can take. Returns the spacing that will be used
+     */
+    unsigned long setFrameSpacing(unsigned long micros);
+    unsigned long getFrameSpacing() const { return frameSpacing; }
+
+    /**
+     * True once everything queued has been sent
+     */
+    bool isIdle() const { return !active; }
+    int getUnit() const { return unit; }
+    bool hasPwmCarrier() const { return carrier == &pwmCarrier; }
+
+    /**
+     * True if a carrier on pin can come from its PWM timer, it has one and no unit's transmitter
+     * uses that timer for its IntervalTimer (see IR_UNIT_TIMERS)
+     */
+    static bool hasPwmTimer(int pin);
+
+    /**
+     * Timer ISR body, see the trampolines in ac_ir_controller.cpp
+     */
+    void onTimer();
+
+  private:
+    int unit;
+    int txPin;
+
+    // The LED carrier, from the PWM timer when the pin has one to itself otherwise toggled by onTimer
+    PwmIrCarrier pwmCarrier;
+    ToggleIrCarrier toggleCarrier;
+    IrCarrier* carrier;
+
+    // Frames waiting to be sent, queueFrame -> onTimer
+    IsrQueue<struct IrFrame, IR_QUEUE_LEN> queue;
+    IntervalTimer timer;
+    volatile bool active; // timer is running, cleared by the ISR once the queue is empty
+
+    // Transmit state, only touched by the ISR while active
+    struct IrFrame txFrame;
+    int txSegments; // segments in txFrame
+    int txRepeats; // repeat codes still to send after txFrame
+    int txSegment; // segment of txFrame being sent
+    // Times are 32 bit micros like micros() on the Photon, differences are taken as int32_t so they
+    // keep working across micros() wrapping every 71 minutes wherever unsigned long is wider
+    uint32_t segmentEnd; // micros the current mark or space ends
+    uint32_t wakeAt; // micros of the next edge, the timer may take a few periods to get there
+    uint32_t lastFrameStart;
+    bool sentFrame;
+    volatile unsigned long frameSpacing; // see setFrameSpacing
+
+    int queueFrame(const struct IrFrame& frame);
+    void scheduleTimer(uint32_t now);
+};
+
+}
+
+/**
+ * Cloud function, queues an 8 hex digit NEC code on a unit: "10AF708F" for unit 0 or "1:10AF708F".
+ * Returns 1 once queued, -1 for a bad code or unit or IR_QUEUE_FULL
+ */
 int sendNEC(String command);
 
+/**
+ * The transmitter initialised as unit, NULL if there isn't one
+ */
+AcManager::IrTransmitter* getIrTransmitter(int unit);
+
 #endif
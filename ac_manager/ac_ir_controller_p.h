@@ -3,6 +3,8 @@
 #ifndef AC_IR_CONTROLLER_P_H
 #define AC_IR_CONTROLLER_P_H
 
+#include "ac_ir_commands.h"
+
 // From https://github.com/shirriff/Arduino-IRremote/blob/master/IRremoteInt.h
 #define NEC_BITS        32
 #define NEC_HDR_MARK	  9000
@@ -11,9 +13,39 @@
 #define NEC_ONE_SPACE	  1690
 #define NEC_ZERO_SPACE  560
 #define NEC_RPT_SPACE   2250
+#define NEC_RPT_PERIOD  108000 // start of one frame to the start of the following repeat code
 
 #define MARK_EXCESS 100
 
+// A NEC frame is the header mark and space, a mark and space per bit and a trailing mark.
+// Even segments are marks (carrier on), odd segments are spaces
+#define NEC_SEGMENTS (2 + (NEC_BITS * 2) + 1)
+
+#define IR_QUEUE_LEN 32 // NEC codes sendNECCode can queue up, must be a power of 2
+#define IR_FRAME_SPACING 110000 // default micros from the start of one NEC frame to the next
+#define IR_FRAME_SPACING_MIN 80000 // a frame takes up to 68ms, leave the receiver a gap after it
+#define IR_FRAME_SPACING_MAX 250000
+#define IR_TIMER_MIN_PERIOD 5 // shortest timer period, edges that are already due fire after this
+#define IR_TIMER_MAX_PERIOD 50000 // longest timer period, longer waits are done in steps
+#define IR_SEGMENT_IDLE -1 // txSegment between frames
+
+/**
+ * Mark and space lengths of one frame in send order, starting with a mark
+ */
+struct IrWaveform {
+  uint8_t length;
+  uint16_t micros[NEC_SEGMENTS];
+};
+
+/**
+ * A queued frame, either a precompiled waveform or an ad-hoc NEC code that is timed as it is sent
+ */
+struct IrFrame {
+  const struct IrWaveform* waveform;
+  unsigned int code; // used when waveform is NULL
+  uint8_t repeats; // NEC repeat codes sent after the frame, as if the button was held
+};
+
 #define Duty_Cycle 50  //in percent (10->50), usually 33 or 50
 //actual duty cycle will be relative close to set value, depending on carrier freq
 
@@ -24,8 +56,11 @@
 #define LOWTIME   PERIOD - HIGHTIME
 
 unsigned int decodeNECHex(String codeHex);
-int sendNECCode(unsigned int codeBin);
-void mark(unsigned int mLen);
-void space(unsigned int sLen);
+extern const struct IrWaveform IR_REPEAT_WAVEFORM;
+void compileNECWaveform(unsigned int codeBin, struct IrWaveform* dest);
+const struct IrWaveform* getIrWaveform(enum AcCommands command);
+unsigned int necSegmentMicros(unsigned int codeBin, int segment);
+unsigned int frameSegmentMicros(const struct IrFrame& frame, int segment);
+int frameSegments(const struct IrFrame& frame);
 
 #endif
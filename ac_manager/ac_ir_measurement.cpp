@@ -0,0 +1,87 @@
+#include "application.h"
+#include "ac_ir_measurement.h"
+
+namespace AcManager {
+
+IrMeasurement::IrMeasurement(unsigned int carrierFrequency) :
+  gapMicros((3 * 1000000) / carrierFrequency) {
+  reset();
+}
+
+void IrMeasurement::reset() {
+  marks = 0;
+  high = false;
+  lastRise = 0;
+  periodSum = 0;
+  highSum = 0;
+  periods = 0;
+  highs = 0;
+}
+
+void IrMeasurement::addEdge(unsigned long micros, bool rising) {
+  if (rising == high) {
+    return;
+  }
+  high = rising;
+
+  if (rising) {
+    bool newBurst = marks == 0 || (micros - markEnd[marks - 1]) > gapMicros;
+    if (newBurst) {
+      if (marks == MAX_MARKS) {
+        return;
+      }
+      markStart[marks] = micros;
+      markEnd[marks] = micros;
+      marks++;
+    } else {
+      periodSum += micros - lastRise;
+      periods++;
+    }
+    lastRise = micros;
+  } else if (marks > 0) {
+    highSum += micros - lastRise;
+    highs++;
+    markEnd[marks - 1] = micros;
+  }
+}
+
+bool IrMeasurement::compare(const uint16_t* segmentMicros, int segments, struct IrMeasurementReport* report) {
+  report->marks = marks;
+  report->expectedMarks = (segments + 1) / 2;
+  report->carrierHz = periods > 0 ? 1000000.0 * periods / periodSum : 0;
+  report->dutyPercent = (periods > 0 && highs > 0) ? 100.0 * ((double) highSum / highs) / ((double) periodSum / periods) : 0;
+  report->maxStartError = 0;
+  report->maxEndError = 0;
+  report->worstMark = -1;
+
+  if (marks != report->expectedMarks) {
+    return false;
+  }
+
+  long expected = 0;
+  int worst = -1;
+  for (int seg = 0; seg < segments; seg += 2) {
+    int mark = seg / 2;
+    long startError = (long) (markStart[mark] - markStart[0]) - expected;
+    expected += segmentMicros[seg];
+    long endError = (long) (markEnd[mark] - markStart[0]) - expected;
+    if (seg + 1 < segments) {
+      expected += segmentMicros[seg + 1];
+    }
+
+    if (abs(startError) > abs(report->maxStartError)) {
+      report->maxStartError = startError;
+    }
+    if (abs(endError) > abs(report->maxEndError)) {
+      report->maxEndError = endError;
+    }
+    int error = max(abs(startError), abs(endError));
+    if (error > worst) {
+      worst = error;
+      report->worstMark = mark;
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,65 @@
+#include "application.h"
+
+#ifndef AC_IR_MEASUREMENT_H
+#define AC_IR_MEASUREMENT_H
+
+namespace AcManager {
+
+/**
+ * What the IR LED actually did while sending one frame, compared against the frame's marks and
+ * spaces
+ */
+struct IrMeasurementReport {
+  int marks; // carrier bursts found
+  int expectedMarks;
+  double carrierHz; // mean carrier frequency inside marks
+  double dutyPercent; // mean carrier duty cycle inside marks
+  int maxStartError; // worst mark start error in micros, signed
+  int maxEndError; // worst mark end error in micros, signed
+  int worstMark; // index of the mark with the largest error
+};
+
+/**
+ * Measurement mode for the IR output. Fed the LED pin edges of one frame, it splits them into
+ * carrier bursts and checks the burst timing against the expected mark/space lengths.
+ *
+ * Mark starts are timed from the first carrier rise, mark ends from the last carrier fall. The
+ * first mark start is taken as the frame start so errors are relative to it.
+ */
+class IrMeasurement {
+  public:
+    static const int MAX_MARKS = 40;
+
+    IrMeasurement(unsigned int carrierFrequency);
+
+    void reset();
+
+    /**
+     * Add the next edge, micros must not go backwards
+     */
+    void addEdge(unsigned long micros, bool rising);
+
+    /**
+     * Compare against segments mark/space lengths in send order, starting with a mark. Returns
+     * false if the bursts don't line up with the marks at all
+     */
+    bool compare(const uint16_t* segmentMicros, int segments, struct IrMeasurementReport* report);
+
+  private:
+    unsigned long gapMicros; // low time that ends a burst, a few carrier periods
+
+    int marks;
+    unsigned long markStart[MAX_MARKS];
+    unsigned long markEnd[MAX_MARKS];
+
+    bool high;
+    unsigned long lastRise;
+    unsigned long periodSum; // rise to rise inside bursts
+    unsigned long highSum; // rise to fall inside bursts
+    int periods;
+    int highs;
+};
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include "application.h"
+#include "ac_link_monitor.h"
+
+namespace AcManager {
+
+LinkMonitor::LinkMonitor(const struct LinkMonitorConfig& config) : config(config) {
+  this->config.window = constrain(config.window, 1, 32);
+  reset(0);
+}
+
+void LinkMonitor::reset(unsigned long now) {
+  results = 0;
+  failuresInARow = 0;
+  lastSuccess = now;
+  interval = config.minInterval;
+  up = true;
+}
+
+int LinkMonitor::getWindowFailures() const {
+  uint32_t mask = config.window == 32 ? 0xFFFFFFFF : (1UL << config.window) - 1;
+  uint32_t failures = results & mask;
+  int count = 0;
+  while (failures) {
+    failures &= failures - 1;
+    count++;
+  }
+  return count;
+}
+
+LinkMonitor::Action LinkMonitor::record(bool success, unsigned long now) {
+  results = (results << 1) | (success ? 0 : 1);
+
+  if (success) {
+    failuresInARow = 0;
+    lastSuccess = now;
+    interval = min(interval * 2, config.maxInterval);
+    up = true;
+    return ACTION_NONE;
+  }
+
+  failuresInARow++;
+  interval = config.minInterval;
+  if (getWindowFailures() >= config.downFailures) {
+    up = false;
+  }
+
+  if (failuresInARow >= config.resetFailures && now - lastSuccess >= config.resetMillis) {
+    return ACTION_RESET;
+  }
+  if (failuresInARow == config.reconnectFailures) {
+    return ACTION_RECONNECT;
+  }
+  return ACTION_NONE;
+}
+
+}
@@ -0,0 +1,74 @@
+#include "application.h"
+
+#ifndef AC_LINK_MONITOR_H
+#define AC_LINK_MONITOR_H
+
+namespace AcManager {
+
+struct LinkMonitorConfig {
+  unsigned long minInterval; // millis between probes while failing
+  unsigned long maxInterval; // millis between probes once the link has been healthy for a while
+  int window; // probes the success rate is measured over, at most 32
+  int downFailures; // failures in the window that mark the link down
+  int reconnectFailures; // failures in a row before WiFi is restarted
+  int resetFailures; // failures in a row before the device is reset...
+  unsigned long resetMillis; // ...as long as nothing has answered for this long
+};
+
+const struct LinkMonitorConfig LINK_MONITOR_CONFIG_DEFAULTS {
+  .minInterval = 5000,
+  .maxInterval = 80000,
+  .window = 8,
+  .downFailures = 3,
+  .reconnectFailures = 3,
+  .resetFailures = 6,
+  .resetMillis = 60000
+};
+
+/**
+ * Decides what to do after each single ping probe. Keeps a window of recent results, doubles the
+ * probe interval while the link answers and drops straight to minInterval on a failure.
+ *
+ * A run of failures first asks for a WiFi reconnect and only asks for a reset once more failures
+ * followed and nothing answered for resetMillis. The monitor never touches the network itself.
+ */
+class LinkMonitor {
+  public:
+    enum Action {
+      ACTION_NONE,
+      ACTION_RECONNECT,
+      ACTION_RESET
+    };
+
+    explicit LinkMonitor(const struct LinkMonitorConfig& config);
+    void reset(unsigned long now);
+
+    /**
+     * Record the result of one probe sent at now, returns what the caller should do about it
+     */
+    Action record(bool success, unsigned long now);
+
+    /**
+     * Millis until the next probe
+     */
+    unsigned long getInterval() const { return interval; }
+
+    /**
+     * False once downFailures of the window failed, record() flips it back on the next success
+     */
+    bool isUp() const { return up; }
+    int getWindowFailures() const;
+    int getFailuresInARow() const { return failuresInARow; }
+
+  private:
+    struct LinkMonitorConfig config;
+    uint32_t results; // one bit per probe in the window, 1 for a failure, newest in bit 0
+    int failuresInARow;
+    unsigned long lastSuccess; // millis
+    unsigned long interval;
+    bool up;
+};
+
+}
+
+#endif
@@ -2,54 +2,100 @@
 #include "ac_display_reader.h"
 #include "ac_ir_controller.h"
 #include "ac_manager.h"
+#include "ac_state_controller.h"
+#include "ac_scheduler.h"
+#include "ac_units.h"
 #include "wifi_keepalive.h"
 
-#define IR_LED   D6   //IR carrier output pin
-
-#define CLOCK_PIN D2
-#define INPUT_PIN D1
+#ifndef AC_UNITS
+#define AC_UNITS 1 // window units wired to this device, at most AC_UNITS_MAX
+#endif
 
 #define MIN_TEMP  60
 #define MAX_TEMP  90
 
-#define AC_CMD__ON_OFF        "10AF8877"
-#define AC_CMD__TIMER         "10AF609F"
-#define AC_CMD__FAN_SPEED_U   "10AF807F"
-#define AC_CMD__FAN_SPEED_D   "10AF20DF"
-#define AC_CMD__TEMP_TIMER_U  "10AF708F"
-#define AC_CMD__TEMP_TIMER_D  "10AFB04F"
-#define AC_CMD__COOL          "10AF906F"
-#define AC_CMD__ENERGY_SAVER  "10AF40BF"
-#define AC_CMD__AUTO_FAN      "10AFF00F"
-#define AC_CMD__FAN_ONLY      "10AFE01F"
-#define AC_CMD__SLEEP         "10AF00FF"
+#define LOOP_BUSY_MAX 50 // longest sleep while a state controller is driving its AC
+
+struct AcUnitPins {
+  int clockPin;
+  int inputPin;
+  int irLedPin; // IR carrier output pin, PWM pins save the ISR toggling the carrier
+};
+
+// Clock pins each need their own EXTI line, see attachInterrupt in the Photon docs. Units 1 and 2
+// get their IR carrier from TIM3's PWM on A4/A5, the transmitters' IntervalTimers are pinned to
+// TIM5-7 so they never take it (see IR_UNIT_TIMERS). Unit 0 keeps D6, which has no PWM, so its
+// carrier is toggled from the timer ISR, about 2180 interrupts a frame against 69 with PWM. D0
+// (TIM4) would give it PWM if that matters more than the existing wiring
+const struct AcUnitPins AC_UNIT_PINS[AC_UNITS_MAX] = {
+  {.clockPin = D2, .inputPin = D1, .irLedPin = D6},
+  {.clockPin = D4, .inputPin = D3, .irLedPin = A4},
+  {.clockPin = D5, .inputPin = A2, .irLedPin = A5}
+};
+
+// Periodic work, the link probe and every display reader's refresh and stale events
+AcManager::Scheduler scheduler;
+static_assert(AC_UNITS * 2 + 1 <= AcManager::Scheduler::MAX_TASKS, "scheduler has no room for every unit's tasks");
+
+// One of each per unit, the state controller drives its AC towards what setState last asked for
+AcManager::DisplayReader displayReaders[AC_UNITS];
+AcManager::IrTransmitter irTransmitters[AC_UNITS];
+AcManager::StateController stateControllers[AC_UNITS];
+
+// Keep backup SRAM powered so the warm state survives resets, see ac_warm_state.h
+STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));
 
 void setup() {
-  initIrController("sendNEC", IR_LED);
+  for (int unit = 0; unit < AC_UNITS; unit++) {
+    // Unit 0 keeps the original names, the others get their number on the end
+    String suffix = unit == 0 ? String() : String(unit);
+
+    irTransmitters[unit].init(unit, "sendNEC", AC_UNIT_PINS[unit].irLedPin);
+
+    struct AcDisplayReaderConfig acConfig = AC_DISPLAY_READER_CONFIG_DEFAULTS;
+    acConfig.clockPin = AC_UNIT_PINS[unit].clockPin;
+    acConfig.inputPin = AC_UNIT_PINS[unit].inputPin;
+    acConfig.statusVar = acConfig.statusVar + suffix;
+    acConfig.dataVar = acConfig.dataVar + suffix;
+    if (!displayReaders[unit].init(unit, acConfig, &scheduler)) {
+      Spark.publish("SETUP_FAILED", String("display") + suffix);
+    }
 
-  struct AcDisplayReaderConfig acConfig = AC_DISPLAY_READER_CONFIG_DEFAULTS;
-  initAcDisplayReader(acConfig);
+    stateControllers[unit].init(&displayReaders[unit], &irTransmitters[unit], String("pacing") + suffix);
+  }
 
   Spark.function("setState", setState);
 
-  setupConnectionCheck();
+  if (!setupConnectionCheck(&scheduler, AcManager::LINK_MONITOR_CONFIG_DEFAULTS)) {
+    Spark.publish("SETUP_FAILED", "link");
+  }
 }
 
 /**
- * Expects one of:
+ * Expects one of, with an optional "<unit>:" prefix for units other than 0:
  *  70,MODE_ECO,FAN_AUTO (temp,acMode,fanSpeed)
+ *  ON
  *  OFF
  *
+ * Returns right away with a request id (100 and up) once the command is valid, the AC is driven
+ * there from loop(). SET_STATE_DONE or SET_STATE_TIMEOUT is published with the id when it ends.
+ * 7 means the prefix names a unit that isn't wired up, 8 that the unit's model can't show that
+ * mode and fan speed (V1_4 has no FAN_MEDIUM).
  */
 int setState(String command) {
   Spark.publish("SET_STATE", command);
 
-  int start = Time.now();
+  int unit = takeAcUnit(&command);
+  if (unit < 0 || unit >= AC_UNITS) {
+    return 7;
+  }
 
   bool toggleOn = false;
   int temp;
   enum AcModes mode;
   enum FanSpeeds speed;
+  String modeName;
+  String speedName;
 
   if (command == "OFF") {
     temp = 0;
@@ -78,128 +124,51 @@ int setState(String command) {
       return 4;
     }
 
-    mode = getModeForName(command.substring(firstComma + 1, secondComma));
+    modeName = command.substring(firstComma + 1, secondComma);
+    mode = getModeForName(modeName);
     if (mode == MODE_INVALID) {
-      Spark.publish("MODE_INVALID", command.substring(firstComma + 1, secondComma));
+      Spark.publish("MODE_INVALID", modeName);
       return 5;
     }
 
-    speed = getSpeedForName(command.substring(secondComma + 1));
+    speedName = command.substring(secondComma + 1);
+    speed = getSpeedForName(speedName);
     if (speed == FAN_INVALID) {
-      Spark.publish("FAN_INVALID", command.substring(secondComma + 1));
+      Spark.publish("FAN_INVALID", speedName);
       return 6;
     }
   }
 
-  // Try to get AC to the correct state for up to 10 seconds
-  while (Time.now() - start < 10) {
-    // Special handling for OFF
-    if (toggleOn) {
-      if (!isAcOn()) {
-        Spark.publish("ON", "");
-        sendNEC(AC_CMD__ON_OFF);
-      } else {
-        break;
-      }
-    }
-    else if (mode == MODE_OFF) {
-      if (isAcOn()) {
-        Spark.publish("OFF", "");
-        sendNEC(AC_CMD__ON_OFF);
-      } else {
-        break;
-      }
-    } else if (!isAcOn()) {
-      // First turn it on if it is off
-      Spark.publish("ON", "");
-      sendNEC(AC_CMD__ON_OFF);
-    } else {
-      bool stable = true;
-      if (mode != getAcMode()) {
-        stable = false;
-        switch (mode) {
-          case MODE_FAN:
-            Spark.publish("MODE", "MODE_FAN");
-            sendNEC(AC_CMD__FAN_ONLY);
-            break;
-          case MODE_ECO:
-            Spark.publish("MODE", "MODE_ECO");
-            sendNEC(AC_CMD__ENERGY_SAVER);
-            break;
-          case MODE_COOL:
-            Spark.publish("MODE", "MODE_COOL");
-            sendNEC(AC_CMD__COOL);
-            break;
-        }
-      }
-
-      if (speed != getFanSpeed()) {
-        stable = false;
-        switch (speed) {
-          case FAN_AUTO:
-            Spark.publish("SPEED", "FAN_AUTO");
-            sendNEC(AC_CMD__AUTO_FAN);
-            break;
-          case FAN_LOW:
-            Spark.publish("SPEED", "FAN_LOW");
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            break;
-          case FAN_MEDIUM:
-            Spark.publish("SPEED", "FAN_MEDIUM");
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            sendNEC(AC_CMD__FAN_SPEED_D);
-            sendNEC(AC_CMD__FAN_SPEED_U);
-            break;
-          case FAN_HIGH:
-            Spark.publish("SPEED", "FAN_HIGH");
-            sendNEC(AC_CMD__FAN_SPEED_U);
-            sendNEC(AC_CMD__FAN_SPEED_U);
-            break;
-        }
-      }
-
-      if (mode != MODE_FAN && temp != getTemp()) {
-        stable = false;
-        int tempDiff = temp - getTemp();
-        if (tempDiff < 0) {
-          for (int i = 0; i < abs(tempDiff); i++) {
-            sendNEC(AC_CMD__TEMP_TIMER_D);
-          }
-        } else {
-          for (int i = 0; i < abs(tempDiff); i++) {
-            sendNEC(AC_CMD__TEMP_TIMER_U);
-          }
-        }
-      }
-
-      // Yay at a stable state!
-      if (stable) {
-        return 0;
-      }
-    }
-
-    // Wait for the AC to handle IR codes and the display to update
-    delay(2000);
-    processAcDisplayData();
+  enum AcManager::StateController::Power power = toggleOn ? AcManager::StateController::POWER_ON :
+    mode == MODE_OFF ? AcManager::StateController::POWER_OFF : AcManager::StateController::POWER_SET;
+  struct AcState target(0, temp, 0, speed, mode, false);
+  if (power == AcManager::StateController::POWER_SET && !stateControllers[unit].canReach(target)) {
+    Spark.publish("STATE_UNREACHABLE", command);
+    return 8;
   }
+  int requestId = stateControllers[unit].request(power, target, modeName, speedName);
 
-  if (Time.now() - start >= 30) {
-    // Return 1000 for timeout
-    return 1000;
-  } else {
-    // Return 0 for success
-    return 0;
-  }
+  // Get the first presses out now rather than after loop() wakes
+  stateControllers[unit].step();
+  return requestId;
 }
 
 void loop() {
-  checkConnection();
-
-  processAcDisplayData();
+  // Sleep until a display shows something new or a task is due, a panel press shows up as soon
+  // as its refresh ends
+  unsigned long sleep = scheduler.untilNext();
+  for (int unit = 0; unit < AC_UNITS; unit++) {
+    if (stateControllers[unit].isBusy()) {
+      sleep = min(sleep, (unsigned long) LOOP_BUSY_MAX);
+    }
+  }
+  waitForAcDisplayFrame(sleep);
 
-  // process display data here
-  delay(5000); // Sleep 1 second
+  for (int unit = 0; unit < AC_UNITS; unit++) {
+    displayReaders[unit].processDisplayData();
+  }
+  scheduler.run();
+  for (int unit = 0; unit < AC_UNITS; unit++) {
+    stateControllers[unit].step();
+  }
 }
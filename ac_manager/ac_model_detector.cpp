@@ -0,0 +1,77 @@
+#include "application.h"
+#include "ac_model_detector.h"
+
+namespace AcManager {
+
+ModelDetector::ModelDetector() : lockedHistory(0) {
+  startProbe();
+}
+
+void ModelDetector::startProbe() {
+  probing = true;
+  probeSamples = 0;
+  for (int i = 0; i < MODEL_COUNT; i++) {
+    probeFrames[i] = 0;
+    probeValid[i] = 0;
+  }
+}
+
+void ModelDetector::lock() {
+  probing = false;
+  lockedHistory = 0;
+}
+
+void ModelDetector::addProbeResult(int model, int frames, int valid) {
+  if (model < 0 || model >= MODEL_COUNT) {
+    return;
+  }
+  probeFrames[model] += frames;
+  probeValid[model] += valid;
+}
+
+bool ModelDetector::finishProbeSample(int* winner) {
+  probeSamples++;
+  if (probeSamples < PROBE_SAMPLES) {
+    return false;
+  }
+
+  // Rank on valid frame rate, frames are counted per model since the models have different lengths
+  int best = -1;
+  int bestRate = -1;
+  int secondRate = -1;
+  for (int i = 0; i < MODEL_COUNT; i++) {
+    int rate = probeFrames[i] == 0 ? 0 : (probeValid[i] * 100) / probeFrames[i];
+    if (rate > bestRate) {
+      secondRate = bestRate;
+      bestRate = rate;
+      best = i;
+    } else if (rate > secondRate) {
+      secondRate = rate;
+    }
+  }
+
+  if (bestRate >= PROBE_MIN_RATE && bestRate > secondRate) {
+    *winner = best;
+    lock();
+    return true;
+  }
+
+  // Nothing parses well enough yet (AC not sending, noisy wiring), score the next samples fresh
+  startProbe();
+  return false;
+}
+
+bool ModelDetector::addLockedResult(bool decoded) {
+  if (probing) {
+    return false;
+  }
+
+  lockedHistory = ((lockedHistory << 1) | (decoded ? 0 : 1)) & ((1u << LOCKED_WINDOW) - 1);
+  if (__builtin_popcount(lockedHistory) >= LOCKED_MAX_FAILURES) {
+    startProbe();
+    return true;
+  }
+  return false;
+}
+
+}
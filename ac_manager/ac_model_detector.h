@@ -0,0 +1,67 @@
+#include "application.h"
+
+#ifndef AC_MODEL_DETECTOR_H
+#define AC_MODEL_DETECTOR_H
+
+namespace AcManager {
+
+/**
+ * Works out which AC model is on the other end of the shift register. While probing every model's
+ * parser is scored on its valid frame rate over the same display data until one clearly wins.
+ * Once locked only the locked model's decode results are tracked, a burst of failed decodes starts
+ * a new probe.
+ *
+ * Models are identified by their AcModels value, the detector doesn't do any parsing itself.
+ */
+class ModelDetector {
+  public:
+    static const int MODEL_COUNT = 3;
+    static const int PROBE_SAMPLES = 3; // samples of fresh display data scored before picking a winner
+    static const int PROBE_MIN_RATE = 60; // percent of frames a winner must have parsed
+    static const int LOCKED_WINDOW = 16; // locked samples the error rate is measured over
+    static const int LOCKED_MAX_FAILURES = 10; // failed samples in the window that trigger a probe
+
+    ModelDetector();
+
+    /**
+     * Drop the locked model and start scoring every model again
+     */
+    void startProbe();
+
+    /**
+     * Stop probing, the caller has picked the model
+     */
+    void lock();
+
+    bool isProbing() const { return probing; }
+
+    /**
+     * Record that model parsed valid out of frames display refreshes in one sample of fresh data
+     */
+    void addProbeResult(int model, int frames, int valid);
+
+    /**
+     * Call once every model has been scored for a sample. Returns true and sets winner once a
+     * model clearly wins, after PROBE_SAMPLES without a winner the scores start over.
+     */
+    bool finishProbeSample(int* winner);
+
+    /**
+     * Record whether a sample of fresh data decoded with the locked model. Returns true if the
+     * failure rate spiked, the detector is then probing again.
+     */
+    bool addLockedResult(bool decoded);
+
+    int getProbeSamples() const { return probeSamples; }
+
+  private:
+    bool probing;
+    int probeSamples;
+    int probeFrames[MODEL_COUNT];
+    int probeValid[MODEL_COUNT];
+    uint32_t lockedHistory; // bit per locked sample, 1 = failed, newest in bit 0
+};
+
+}
+
+#endif
@@ -1,20 +1,26 @@
 #include "application.h"
 #include "ac_parser.h"
+#include "ac_parser_v12.h"
+#include "ac_parser_v14.h"
+#include "ac_parser_v18.h"
 
 namespace AcManager {
 
   // "PARSE_ERROR" -> config.parseErrorEventName
 
-bool AcParser::parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen) {
-  if (pbLen != getDataLength()) {
-    Spark.publish("PARSE_ERROR", "BAD LENGTH");
+template <typename Traits>
+bool AcParserT<Traits>::parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen, bool publishErrors) {
+  if (pbLen != Traits::DATA_LENGTH) {
+    if (publishErrors) {
+      Spark.publish("PARSE_ERROR", "BAD LENGTH");
+    }
     // Something is wrong, skip parsing
     return false;
   }
 
   // Verify the header bytes in the parser buffer match the header array
-  for (int i = 0; i < headerLength; i++) {
-    if (parseBuffer[i] != headerAndMask[i]) {
+  for (int i = 0; i < Traits::HEADER_LENGTH; i++) {
+    if (parseBuffer[i] != Traits::HEADER_AND_MASK[i]) {
       return false;
     }
   }
@@ -24,9 +30,9 @@ bool AcParser::parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen
   // having to add that logic into the various parsing bits
   bool isOff = true;
   bool maskMatches = true;
-  for (int i = headerLength; i < pbLen; i++) {
+  for (int i = Traits::HEADER_LENGTH; i < Traits::DATA_LENGTH; i++) {
     isOff = isOff && parseBuffer[i] == 0xFF;
-    maskMatches = maskMatches && ((parseBuffer[i] & headerAndMask[i]) == headerAndMask[i]);
+    maskMatches = maskMatches && ((parseBuffer[i] & Traits::HEADER_AND_MASK[i]) == Traits::HEADER_AND_MASK[i]);
   }
   if (isOff) {
     updateStates(dest, 0, 0, FAN_OFF, MODE_OFF, false);
@@ -35,63 +41,69 @@ bool AcParser::parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen
   if (!maskMatches) {
     char msg[20];
     sprintf(msg, "INVALID MASKED BITS"); // TODO print parseBuffer
-    Spark.publish("PARSE_ERROR", msg);
+    if (publishErrors) {
+      Spark.publish("PARSE_ERROR", msg);
+    }
     return false;
   }
 
-  bool timer = isTimer(parseBuffer, pbLen);
+  bool timer = Traits::isTimer(parseBuffer);
 
-  uint8_t tensBits = parseBuffer[headerLength];
-  uint8_t onesBits = parseBuffer[headerLength + 1];
-  double display = decodeDisplayNumber(tensBits, onesBits, timer);
+  uint8_t tensBits = parseBuffer[Traits::HEADER_LENGTH];
+  uint8_t onesBits = parseBuffer[Traits::HEADER_LENGTH + 1];
+  int display = decodeDisplayNumber(tensBits, onesBits, timer);
   if (display == -1) {
     // Display digits were invalid, ignore buffer
-    char msg[20];
-    sprintf(msg, "INVALID DISPLAY: hl:%d %02x %02x", headerLength, tensBits, onesBits);
-    Spark.publish("PARSE_ERROR", msg);
+    char msg[40];
+    sprintf(msg, "INVALID DISPLAY: hl:%d %02x %02x", Traits::HEADER_LENGTH, tensBits, onesBits);
+    if (publishErrors) {
+      Spark.publish("PARSE_ERROR", msg);
+    }
     return false;
   }
 
-  uint8_t acModeBits = parseBuffer[acModeByteIndex];
+  uint8_t acModeBits = parseBuffer[Traits::AC_MODE_BYTE_INDEX];
   enum AcModes acMode = decodeAcMode(acModeBits);
   if (acMode == MODE_INVALID) {
     // AC Mode was invalid, ignore buffer
     char msg[20];
     sprintf(msg, "INVALID MODE: %02x", acModeBits);
-    Spark.publish("PARSE_ERROR", msg);
+    if (publishErrors) {
+      Spark.publish("PARSE_ERROR", msg);
+    }
     return false;
   }
 
-  uint8_t fanSpeedBits = parseBuffer[fanSpeedByteIndex];
+  uint8_t fanSpeedBits = parseBuffer[Traits::FAN_SPEED_BYTE_INDEX];
   enum FanSpeeds fanSpeed = decodeFanSpeed(fanSpeedBits);
   if (fanSpeed == FAN_INVALID) {
     // Fan Speed was invalid, ignore buffer
     char msg[20];
     sprintf(msg, "INVALID FAN: %02x", fanSpeedBits);
-    Spark.publish("PARSE_ERROR", msg);
+    if (publishErrors) {
+      Spark.publish("PARSE_ERROR", msg);
+    }
     return false;
   }
 
   if (timer) {
     updateStates(dest, 0, display, fanSpeed, acMode, false);
   } else {
-    updateStates(dest, (int) display, 0, fanSpeed, acMode, false);
+    updateStates(dest, display, 0, fanSpeed, acMode, false);
   }
 
   return true;
 }
 
-void AcParser::updateStates(struct AcState* dest, int temp, double timer, enum FanSpeeds speed, enum AcModes mode, bool isSleep) {
+template <typename Traits>
+void AcParserT<Traits>::updateStates(struct AcState* dest, int temp, int timerTenths, enum FanSpeeds speed, enum AcModes mode, bool isSleep) {
   // Update the next index in the states array with the pushed data
   dest->timestamp = Time.now();
-  dest->temp = temp;
-  dest->timer = timer;
-  dest->speed = speed;
-  dest->mode = mode;
-  dest->sleep = isSleep;
+  dest->set(temp, timerTenths, speed, mode, isSleep);
 }
 
-double AcParser::decodeDisplayNumber(uint8_t tensBits, uint8_t onesBits, bool isTimer) {
+template <typename Traits>
+int AcParserT<Traits>::decodeDisplayNumber(uint8_t tensBits, uint8_t onesBits, bool isTimer) {
   int tens = decodeDigit(tensBits, isTimer);
   int ones = decodeDigit(onesBits, false);
 
@@ -100,74 +112,38 @@ double AcParser::decodeDisplayNumber(uint8_t tensBits, uint8_t onesBits, bool is
     return -1;
   }
 
-  if (isTimer) {
-    // For the timer the number is a double between 0.0 and 9.9
-    return tens + (ones / 10.0);
-  } else {
-    // Non timer the number is an int between 00 and 99
-    return (tens * 10) + ones;
-  }
+  // Non timer the number is an int between 00 and 99, for the timer it is 0.0 to 9.9 hours which
+  // is kept in tenths
+  return (tens * 10) + ones;
 }
 
 /**
  * Decode the number bits that control the 8 segment display
  */
-int AcParser::decodeDigit(uint8_t digitBits, bool shouldHaveDecimal) {
-  bool hasDecimal = (digitBits & decimalBitMask) != decimalBitMask;
-  if (shouldHaveDecimal != hasDecimal) {
-    // decimal in the wrong state
+template <typename Traits>
+int AcParserT<Traits>::decodeDigit(uint8_t digitBits, bool shouldHaveDecimal) {
+  uint8_t digit = Traits::DIGIT_TABLE[digitBits];
+  if (digit == DIGIT_INVALID || shouldHaveDecimal != ((digit & DIGIT_DECIMAL) != 0)) {
+    // not a digit or decimal in the wrong state
     return -1;
   }
 
-  // Ensure the decimal bit is true to make the switch work no matter the state of the decimal place
-  uint8_t decimalMasked = digitBits | decimalBitMask;
-  for (int i = 0; i < 10; i++) {
-    if (numberBytes[i] == decimalMasked) {
-      return i;
-    }
-  }
-
-  return -1;
+  return digit & DIGIT_VALUE_MASK;
 }
 
-AcModes AcParser::decodeAcMode(uint8_t acModeBits) {
-  uint8_t acModeBitsMasked = acModeBits | acModeBitMask;
-
-  for (int i = 0; i < 3; i++) {
-    if (acModeBytes[i] == acModeBitsMasked) {
-      switch (i) {
-        case 0:
-          return MODE_COOL;
-        case 1:
-          return MODE_ECO;
-        case 2:
-          return MODE_FAN;
-      }
-    }
-  }
-
-  return MODE_INVALID;
+template <typename Traits>
+AcModes AcParserT<Traits>::decodeAcMode(uint8_t acModeBits) {
+  return (AcModes) Traits::AC_MODE_TABLE[acModeBits];
 }
 
-FanSpeeds AcParser::decodeFanSpeed(uint8_t fanSpeedBits) {
-  uint8_t fanSpeedBitsMasked = fanSpeedBits | fanSpeedBitMask;
-
-  for (int i = 0; i < 4; i++) {
-    if (fanSpeedBytes[i] == fanSpeedBitsMasked) {
-      switch (i) {
-        case 0:
-          return FAN_LOW;
-        case 1:
-          return FAN_MEDIUM;
-        case 2:
-          return FAN_HIGH;
-        case 3:
-          return FAN_AUTO;
-      }
-    }
-  }
-
-  return FAN_INVALID;
+template <typename Traits>
+FanSpeeds AcParserT<Traits>::decodeFanSpeed(uint8_t fanSpeedBits) {
+  return (FanSpeeds) Traits::FAN_SPEED_TABLE[fanSpeedBits];
 }
 
+// Instantiate the supported models here so the parsing code stays out of the headers
+template class AcParserT<V12Traits>;
+template class AcParserT<V14Traits>;
+template class AcParserT<V18Traits>;
+
 }
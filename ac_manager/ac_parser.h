@@ -1,60 +1,108 @@
 #include "ac_display_reader.h"
+#include "ac_parser_tables.h"
 
 #ifndef AC_PARSER_H
 #define AC_PARSER_H
 
+// Bit layout of AcState::display
+#define AC_STATE_TEMP_SHIFT 0 // 8 bits, signed
+#define AC_STATE_TIMER_SHIFT 8 // 8 bits, signed, tenths of an hour
+#define AC_STATE_SPEED_SHIFT 16 // 4 bits, FanSpeeds
+#define AC_STATE_MODE_SHIFT 20 // 4 bits, AcModes
+#define AC_STATE_SLEEP_SHIFT 24 // 1 bit
+
 /**
  * Structure that contains all of the displayed state of the AC unit
+ *
+ * The displayed fields are packed into the single display word so states can be copied, compared
+ * and hashed as one integer, use the accessors to read and write them.
  * TODO namespace
  */
 struct AcState {
   int timestamp;
-  int temp;
-  double timer;
-  enum FanSpeeds speed;
-  enum AcModes mode;
-  bool sleep;
+  uint32_t display;
+
+  AcState() : timestamp(0), display(0) {}
+  AcState(int ts, int temp, int timerTenths, enum FanSpeeds speed, enum AcModes mode, bool sleep) :
+    timestamp(ts), display(pack(temp, timerTenths, speed, mode, sleep)) {}
+
+  int getTemp() const {
+    return (int8_t) ((display >> AC_STATE_TEMP_SHIFT) & 0xFF);
+  }
+  int getTimerTenths() const {
+    return (int8_t) ((display >> AC_STATE_TIMER_SHIFT) & 0xFF);
+  }
+  double getTimer() const {
+    return getTimerTenths() / 10.0;
+  }
+  enum FanSpeeds getSpeed() const {
+    return (FanSpeeds) ((display >> AC_STATE_SPEED_SHIFT) & 0x0F);
+  }
+  enum AcModes getMode() const {
+    return (AcModes) ((display >> AC_STATE_MODE_SHIFT) & 0x0F);
+  }
+  bool isSleep() const {
+    return (display >> AC_STATE_SLEEP_SHIFT) & 0x01;
+  }
+
+  void set(int temp, int timerTenths, enum FanSpeeds speed, enum AcModes mode, bool sleep) {
+    display = pack(temp, timerTenths, speed, mode, sleep);
+  }
+
+  static uint32_t pack(int temp, int timerTenths, enum FanSpeeds speed, enum AcModes mode, bool sleep) {
+    return ((uint32_t) (temp & 0xFF) << AC_STATE_TEMP_SHIFT) |
+      ((uint32_t) (timerTenths & 0xFF) << AC_STATE_TIMER_SHIFT) |
+      ((uint32_t) (speed & 0x0F) << AC_STATE_SPEED_SHIFT) |
+      ((uint32_t) (mode & 0x0F) << AC_STATE_MODE_SHIFT) |
+      ((uint32_t) (sleep ? 1 : 0) << AC_STATE_SLEEP_SHIFT);
+  }
 };
 
 namespace AcManager {
 
+/**
+ * Runtime interface used to pick a parser for the configured model, the parsing itself is done by
+ * AcParserT so the model constants are known at compile time
+ */
 class AcParser {
   public:
-    AcParser(uint8_t hl, const uint8_t *ham, uint8_t dbm, const uint8_t *nb, uint8_t ambi, uint8_t ambm, const uint8_t *amb, uint8_t fsbi, uint8_t fsbm, const uint8_t *fsb) :
-      headerLength(hl),
-      headerAndMask(ham),
-      decimalBitMask(dbm),
-      numberBytes(nb),
-      acModeByteIndex(ambi),
-      acModeBitMask(ambm),
-      acModeBytes(amb),
-      fanSpeedByteIndex(fsbi),
-      fanSpeedBitMask(fsbm),
-      fanSpeedBytes(fsb) {}
-
     virtual ~AcParser() {};
     virtual int getDataLength() = 0;
-    bool parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen);
-  protected:
-    const uint8_t headerLength; // Number of bytes in the header
-    const uint8_t *headerAndMask; // Contains the header bytes and then "bits that must by 1" and-mask Size must be equal to getDataLength()
-    const uint8_t decimalBitMask; // and-mask that denotes the decimal bit
-    const uint8_t *numberBytes; // The ten number bytes to compare against, decimal bit must be 1
-    const uint8_t acModeByteIndex; // The index of the byte that contains the ac mode data
-    const uint8_t acModeBitMask; // The or-mask for the mode byte
-    const uint8_t *acModeBytes; // 3 byte array in {MODE_COOL, MODE_ECO, MODE_FAN} order
-    const uint8_t fanSpeedByteIndex; // The index of the byte that contains the fan speed data
-    const uint8_t fanSpeedBitMask; // The or-mask for the mode byte
-    const uint8_t *fanSpeedBytes; // 4 byte array in {FAN_LOW, FAN_MEDIUM, FAN_HIGH, FAN_AUTO} order
-
-    virtual bool isTimer(uint8_t parseBuffer[], int pbLen) = 0;
+
+    /**
+     * Decode one display frame into dest, returns false if the frame isn't valid for this model.
+     * publishErrors is false while probing for the model so wrong guesses don't publish PARSE_ERROR
+     */
+    virtual bool parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen, bool publishErrors) = 0;
+};
+
+/**
+ * Display parser specialized for one AC model. Traits must provide:
+ *
+ *  HEADER_LENGTH - Number of bytes in the header
+ *  DATA_LENGTH - Number of bytes in a full display frame
+ *  HEADER_AND_MASK - The header bytes and then "bits that must by 1" and-mask, DATA_LENGTH long
+ *  DIGIT_TABLE - Raw digit byte -> digit value, see makeDigitTable
+ *  AC_MODE_BYTE_INDEX - The index of the byte that contains the ac mode data
+ *  AC_MODE_TABLE - Raw mode byte -> AcModes, see makeAcModeTable
+ *  FAN_SPEED_BYTE_INDEX - The index of the byte that contains the fan speed data
+ *  FAN_SPEED_TABLE - Raw fan byte -> FanSpeeds, see makeFanSpeedTable
+ *  isTimer(parseBuffer) - true if the display is showing the timer instead of the temperature
+ */
+template <typename Traits>
+class AcParserT : public AcParser {
+  public:
+    int getDataLength() {
+      return Traits::DATA_LENGTH;
+    };
+    bool parseState(struct AcState* dest, uint8_t parseBuffer[], int pbLen, bool publishErrors);
 
   private:
-    int decodeDigit(uint8_t digitBits, bool hasDecimal);
-    double decodeDisplayNumber(uint8_t tensBits, uint8_t onesBits, bool isTimer);
-    FanSpeeds decodeFanSpeed(uint8_t modeFanBits);
-    AcModes decodeAcMode(uint8_t modeFanBits);
-    void updateStates(struct AcState* dest, int temp, double timer, enum FanSpeeds speed, enum AcModes mode, bool isSleep);
+    static int decodeDigit(uint8_t digitBits, bool hasDecimal);
+    static int decodeDisplayNumber(uint8_t tensBits, uint8_t onesBits, bool isTimer);
+    static FanSpeeds decodeFanSpeed(uint8_t modeFanBits);
+    static AcModes decodeAcMode(uint8_t modeFanBits);
+    static void updateStates(struct AcState* dest, int temp, int timerTenths, enum FanSpeeds speed, enum AcModes mode, bool isSleep);
 };
 
 }
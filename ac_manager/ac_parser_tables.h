@@ -0,0 +1,102 @@
+#include "application.h"
+#include "ac_display_reader.h"
+
+#ifndef AC_PARSER_TABLES_H
+#define AC_PARSER_TABLES_H
+
+namespace AcManager {
+
+/**
+ * 256 entry byte -> value lookup table, indexed directly by the raw display byte
+ */
+struct DecodeTable {
+  uint8_t values[256];
+
+  constexpr uint8_t operator[](uint8_t bits) const {
+    return values[bits];
+  }
+};
+
+// Digit table entries are the digit value with DIGIT_DECIMAL set if the decimal segment is lit
+static const uint8_t DIGIT_INVALID = 0xFF;
+static const uint8_t DIGIT_DECIMAL = 0x10;
+static const uint8_t DIGIT_VALUE_MASK = 0x0F;
+
+namespace Tables {
+
+// Compile time 0..N-1 index list, used to expand a table initializer one entry per byte value
+template <int... I> struct Indexes {};
+template <int N, int... I> struct MakeIndexes : MakeIndexes<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndexes<0, I...> {
+  typedef Indexes<I...> type;
+};
+
+constexpr int findByte(const uint8_t* bytes, int count, uint8_t value, int i) {
+  return i >= count ? -1 : (bytes[i] == value ? i : findByte(bytes, count, value, i + 1));
+}
+
+constexpr uint8_t digitEntry(int index, uint8_t hasDecimal) {
+  return index == -1 ? DIGIT_INVALID : (uint8_t) (index | (hasDecimal ? DIGIT_DECIMAL : 0));
+}
+
+// The decimal bit is active low, force it high before looking up the digit segments
+constexpr uint8_t digitValue(const uint8_t (&numberBytes)[10], uint8_t decimalBitMask, int bits) {
+  return digitEntry(
+    findByte(numberBytes, 10, (uint8_t) (bits | decimalBitMask), 0),
+    (bits & decimalBitMask) != decimalBitMask);
+}
+
+// acModeBytes is in {MODE_COOL, MODE_ECO, MODE_FAN} order
+constexpr uint8_t acModeForIndex(int index) {
+  return index == 0 ? MODE_COOL : index == 1 ? MODE_ECO : index == 2 ? MODE_FAN : MODE_INVALID;
+}
+
+constexpr uint8_t acModeValue(const uint8_t (&acModeBytes)[3], uint8_t acModeBitMask, int bits) {
+  return acModeForIndex(findByte(acModeBytes, 3, (uint8_t) (bits | acModeBitMask), 0));
+}
+
+// fanSpeedBytes is in {FAN_LOW, FAN_MEDIUM, FAN_HIGH, FAN_AUTO} order
+constexpr uint8_t fanSpeedForIndex(int index) {
+  return index == 0 ? FAN_LOW : index == 1 ? FAN_MEDIUM : index == 2 ? FAN_HIGH : index == 3 ? FAN_AUTO : FAN_INVALID;
+}
+
+constexpr uint8_t fanSpeedValue(const uint8_t (&fanSpeedBytes)[4], uint8_t fanSpeedBitMask, int bits) {
+  return fanSpeedForIndex(findByte(fanSpeedBytes, 4, (uint8_t) (bits | fanSpeedBitMask), 0));
+}
+
+template <int... I>
+constexpr DecodeTable digitTable(const uint8_t (&numberBytes)[10], uint8_t decimalBitMask, Indexes<I...>) {
+  return DecodeTable{{ digitValue(numberBytes, decimalBitMask, I)... }};
+}
+
+template <int... I>
+constexpr DecodeTable acModeTable(const uint8_t (&acModeBytes)[3], uint8_t acModeBitMask, Indexes<I...>) {
+  return DecodeTable{{ acModeValue(acModeBytes, acModeBitMask, I)... }};
+}
+
+template <int... I>
+constexpr DecodeTable fanSpeedTable(const uint8_t (&fanSpeedBytes)[4], uint8_t fanSpeedBitMask, Indexes<I...>) {
+  return DecodeTable{{ fanSpeedValue(fanSpeedBytes, fanSpeedBitMask, I)... }};
+}
+
+}
+
+/**
+ * Build the decode tables from a model's display byte arrays and masks, meant to be evaluated at
+ * compile time so the tables live in flash
+ */
+constexpr DecodeTable makeDigitTable(const uint8_t (&numberBytes)[10], uint8_t decimalBitMask) {
+  return Tables::digitTable(numberBytes, decimalBitMask, Tables::MakeIndexes<256>::type());
+}
+
+constexpr DecodeTable makeAcModeTable(const uint8_t (&acModeBytes)[3], uint8_t acModeBitMask) {
+  return Tables::acModeTable(acModeBytes, acModeBitMask, Tables::MakeIndexes<256>::type());
+}
+
+constexpr DecodeTable makeFanSpeedTable(const uint8_t (&fanSpeedBytes)[4], uint8_t fanSpeedBitMask) {
+  return Tables::fanSpeedTable(fanSpeedBytes, fanSpeedBitMask, Tables::MakeIndexes<256>::type());
+}
+
+}
+
+#endif
@@ -3,42 +3,34 @@
 
 #include "application.h"
 #include "ac_parser.h"
+#include "ac_parser_tables.h"
 
 namespace AcManager {
 
-class AcParserV14 : public AcParser {
-  static const uint8_t HEADER_LENGTH = 2;
-  static const uint8_t DATA_LENGTH = 6;
-  static const uint8_t HEADER_AND_MASK[DATA_LENGTH];
-  static const uint8_t DECIMAL_BIT_MASK = 0b10000000;
-  static const uint8_t NUMBER_BYTES[10];
-  static const uint8_t AC_MODE_BYTE_INDEX = 4;
-  static const uint8_t AC_MODE_BIT_MASK = 0b10001111;
-  static const uint8_t AC_MODE_BYTES[3];
-  static const uint8_t FAN_SPEED_BYTE_INDEX = 4;
-  static const uint8_t FAN_SPEED_BIT_MASK = 0b11110001;
-  static const uint8_t FAN_SPEED_BYTES[4];
+struct V14Traits {
+  static constexpr uint8_t HEADER_LENGTH = 2;
+  static constexpr uint8_t DATA_LENGTH = 6;
+  static constexpr uint8_t HEADER_AND_MASK[DATA_LENGTH] = {0x7F, 0x7F, 0x00, 0x80, 0x01, 0xFD};
+  static constexpr uint8_t DECIMAL_BIT_MASK = 0b10000000;
+  static constexpr uint8_t NUMBER_BYTES[10] = {0xC0, 0xF9, 0xA4, 0xB0, 0x99, 0x92, 0x82, 0xF8, 0x80, 0x90};
+  static constexpr uint8_t AC_MODE_BYTE_INDEX = 4;
+  static constexpr uint8_t AC_MODE_BIT_MASK = 0b10001111;
+  static constexpr uint8_t AC_MODE_BYTES[3] = {0xEF, 0xDF, 0xBF};
+  static constexpr uint8_t FAN_SPEED_BYTE_INDEX = 4;
+  static constexpr uint8_t FAN_SPEED_BIT_MASK = 0b11110001;
+  static constexpr uint8_t FAN_SPEED_BYTES[4] = {0xF7, 0x00, 0xFB, 0xFD};
+  static constexpr DecodeTable DIGIT_TABLE = makeDigitTable(NUMBER_BYTES, DECIMAL_BIT_MASK);
+  static constexpr DecodeTable AC_MODE_TABLE = makeAcModeTable(AC_MODE_BYTES, AC_MODE_BIT_MASK);
+  static constexpr DecodeTable FAN_SPEED_TABLE = makeFanSpeedTable(FAN_SPEED_BYTES, FAN_SPEED_BIT_MASK);
 
-  public:
-    AcParserV14() : AcParser(
-      HEADER_LENGTH,
-      HEADER_AND_MASK,
-      DECIMAL_BIT_MASK,
-      NUMBER_BYTES,
-      AC_MODE_BYTE_INDEX,
-      AC_MODE_BIT_MASK,
-      AC_MODE_BYTES,
-      FAN_SPEED_BYTE_INDEX,
-      FAN_SPEED_BIT_MASK,
-      FAN_SPEED_BYTES
-    ) {};
-    int getDataLength() {
-      return DATA_LENGTH;
-    };
-  protected:
-    bool isTimer(uint8_t parseBuffer[], int pbLen);
+  static bool isTimer(const uint8_t parseBuffer[]) {
+    return !(parseBuffer[2] & 0b10000000) && //bit 7 on byte 2 == 0
+      !(parseBuffer[4] & 0b10000000); //bits 7 on byte 4 == 0
+  }
 };
 
+typedef AcParserT<V14Traits> AcParserV14;
+
 }
 
 #endif
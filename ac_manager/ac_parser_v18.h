@@ -3,42 +3,35 @@
 
 #include "application.h"
 #include "ac_parser.h"
+#include "ac_parser_tables.h"
 
 namespace AcManager {
 
-class AcParserV18 : public AcParser {
-  static const uint8_t HEADER_LENGTH = 2;
-  static const uint8_t DATA_LENGTH = 6;
-  static const uint8_t HEADER_AND_MASK[DATA_LENGTH];
-  static const uint8_t DECIMAL_BIT_MASK = 0b00100000;
-  static const uint8_t NUMBER_BYTES[10];
-  static const uint8_t AC_MODE_BYTE_INDEX = 4;
-  static const uint8_t AC_MODE_BIT_MASK = 0b11111000;
-  static const uint8_t AC_MODE_BYTES[3];
-  static const uint8_t FAN_SPEED_BYTE_INDEX = 5;
-  static const uint8_t FAN_SPEED_BIT_MASK = 0b10110001;
-  static const uint8_t FAN_SPEED_BYTES[4];
+struct V18Traits {
+  static constexpr uint8_t HEADER_LENGTH = 2;
+  static constexpr uint8_t DATA_LENGTH = 6;
+  static constexpr uint8_t HEADER_AND_MASK[DATA_LENGTH] = {0xFF, 0xFF, 0x00, 0x20, 0x98, 0xA0};
+  static constexpr uint8_t DECIMAL_BIT_MASK = 0b00100000;
+  static constexpr uint8_t NUMBER_BYTES[10] = {0x30, 0xFC, 0xA2, 0xA4, 0x6C, 0x25, 0x21, 0xBC, 0x20, 0x24};
+  static constexpr uint8_t AC_MODE_BYTE_INDEX = 4;
+  static constexpr uint8_t AC_MODE_BIT_MASK = 0b11111000;
+  static constexpr uint8_t AC_MODE_BYTES[3] = {0xFB, 0xFD, 0xFE};
+  static constexpr uint8_t FAN_SPEED_BYTE_INDEX = 5;
+  static constexpr uint8_t FAN_SPEED_BIT_MASK = 0b10110001;
+  static constexpr uint8_t FAN_SPEED_BYTES[4] = {0xBF, 0xFD, 0xFB, 0xF7};
+  static constexpr DecodeTable DIGIT_TABLE = makeDigitTable(NUMBER_BYTES, DECIMAL_BIT_MASK);
+  static constexpr DecodeTable AC_MODE_TABLE = makeAcModeTable(AC_MODE_BYTES, AC_MODE_BIT_MASK);
+  static constexpr DecodeTable FAN_SPEED_TABLE = makeFanSpeedTable(FAN_SPEED_BYTES, FAN_SPEED_BIT_MASK);
 
-  public:
-    AcParserV18() : AcParser(
-      HEADER_LENGTH,
-      HEADER_AND_MASK,
-      DECIMAL_BIT_MASK,
-      NUMBER_BYTES,
-      AC_MODE_BYTE_INDEX,
-      AC_MODE_BIT_MASK,
-      AC_MODE_BYTES,
-      FAN_SPEED_BYTE_INDEX,
-      FAN_SPEED_BIT_MASK,
-      FAN_SPEED_BYTES
-    ) {};
-    int getDataLength() {
-      return DATA_LENGTH;
-    };
-  protected:
-    bool isTimer(uint8_t parseBuffer[], int pbLen);
+  static bool isTimer(const uint8_t parseBuffer[]) {
+    return !(parseBuffer[2] & 0b00100000) && //bit 5 on byte 2 == 0
+      !(parseBuffer[4] & 0b01100000) && //bits 5 & 6 on byte 4 == 0
+      (parseBuffer[5] & 0b00000001); //bit 0 on byte 5 == 1
+  }
 };
 
+typedef AcParserT<V18Traits> AcParserV18;
+
 }
 
 #endif
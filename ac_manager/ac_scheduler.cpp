@@ -0,0 +1,65 @@
+#include "application.h"
+#include "ac_scheduler.h"
+
+namespace AcManager {
+
+Scheduler::Scheduler() : taskCount(0) {
+}
+
+int Scheduler::add(Task task, unsigned long periodMillis, void* context) {
+  if (taskCount == MAX_TASKS) {
+    return -1;
+  }
+  tasks[taskCount].task = task;
+  tasks[taskCount].context = context;
+  tasks[taskCount].period = periodMillis;
+  tasks[taskCount].deadline = millis() + periodMillis;
+  return taskCount++;
+}
+
+void Scheduler::setPeriod(int id, unsigned long periodMillis) {
+  if (!isTask(id)) {
+    return;
+  }
+  tasks[id].period = periodMillis;
+  defer(id);
+}
+
+void Scheduler::defer(int id) {
+  if (!isTask(id)) {
+    return;
+  }
+  tasks[id].deadline = millis() + tasks[id].period;
+}
+
+unsigned long Scheduler::untilNext() const {
+  uint32_t now = millis();
+  unsigned long next = 0xFFFFFFFF;
+  for (int i = 0; i < taskCount; i++) {
+    // Deadlines are compared as signed differences so they keep working across millis() wrapping
+    int32_t remaining = (int32_t) (tasks[i].deadline - now);
+    if (remaining <= 0) {
+      return 0;
+    }
+    next = min(next, (unsigned long) remaining);
+  }
+  return next;
+}
+
+int Scheduler::run() {
+  int ran = 0;
+  for (int i = 0; i < taskCount; i++) {
+    uint32_t now = millis();
+    int32_t late = (int32_t) (now - tasks[i].deadline);
+    if (late < 0) {
+      continue;
+    }
+
+    tasks[i].deadline = (uint32_t) late < tasks[i].period ? tasks[i].deadline + tasks[i].period : now + tasks[i].period;
+    tasks[i].task(tasks[i].context);
+    ran++;
+  }
+  return ran;
+}
+
+}
@@ -0,0 +1,70 @@
+#include "application.h"
+
+#ifndef AC_SCHEDULER_H
+#define AC_SCHEDULER_H
+
+namespace AcManager {
+
+/**
+ * Runs periodic tasks off millis() deadlines and tells loop() how long it can sleep before the
+ * next one is due.
+ *
+ * There are only a handful of tasks so they live in a small fixed table and the next deadline is
+ * a scan of it. A task runs at most once per run() call, a task that fell more than a period
+ * behind is rescheduled a period from now rather than run repeatedly to catch up.
+ */
+class Scheduler {
+  public:
+    static const int MAX_TASKS = 8;
+
+    typedef void (*Task)(void* context);
+
+    Scheduler();
+
+    /**
+     * Run task with context every periodMillis, first a period from now. Returns the task id or -1
+     * if the table is full
+     */
+    int add(Task task, unsigned long periodMillis, void* context = NULL);
+
+    /**
+     * Change a task's period, its next run is a new period from now. Ids add didn't return, -1
+     * included, are ignored
+     */
+    void setPeriod(int id, unsigned long periodMillis);
+
+    /**
+     * Push a task's next run back to a full period from now, for tasks that only need to run when
+     * something hasn't happened in a while. Ids add didn't return are ignored
+     */
+    void defer(int id);
+
+    /**
+     * Millis until the next task is due, 0 if one already is
+     */
+    unsigned long untilNext() const;
+
+    /**
+     * Run every task that is due, returns the number run
+     */
+    int run();
+
+    unsigned long getPeriod(int id) const { return isTask(id) ? tasks[id].period : 0; }
+
+  private:
+    struct Entry {
+      Task task;
+      void* context;
+      unsigned long period;
+      uint32_t deadline; // millis, 32 bits like millis() so differences wrap with it on any host
+    };
+
+    Entry tasks[MAX_TASKS];
+    int taskCount;
+
+    bool isTask(int id) const { return id >= 0 && id < taskCount; }
+};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "application.h"
+#include "ac_display_reader.h"
+#include "ac_ir_controller.h"
+#include "ac_state_controller.h"
+#include "ac_warm_state.h"
+
+static const char PACING_TEMPLATE[] = "{\"ackMs\":%lu,\"devMs\":%lu,\"waitMs\":%lu,\"spacingUs\":%lu,\"samples\":%d}";
+
+namespace AcManager {
+
+int StateController::nextRequestId = FIRST_REQUEST_ID;
+
+StateController::StateController() :
+  reader(NULL), transmitter(NULL), phase(PHASE_IDLE), requestId(0), requestTime(0), power(POWER_SET),
+  nextPress(0), settleStart(0), batchStart(0), batchChanges(0), acked(false), startTemp(0) {
+  pacingJson[0] = '\0';
+}
+
+void StateController::init(DisplayReader* reader, IrTransmitter* transmitter, String pacingVar) {
+  this->reader = reader;
+  this->transmitter = transmitter;
+  loadWarmPacing(reader->getUnit(), pacing, holdCalibrations);
+  updatePacingJson();
+  Spark.variable(pacingVar, &pacingJson, STRING);
+}
+
+int StateController::request(enum Power power, const struct AcState& target, String modeName, String speedName) {
+  if (phase != PHASE_IDLE) {
+    Spark.publish("SET_STATE_REPLACED", String(requestId));
+  }
+
+  requestId = nextRequestId++;
+  if (nextRequestId < FIRST_REQUEST_ID) {
+    nextRequestId = FIRST_REQUEST_ID;
+  }
+  requestTime = Time.now();
+  this->power = power;
+  this->target = target;
+  this->modeName = modeName;
+  this->speedName = speedName;
+
+  if (phase == PHASE_SENDING) {
+    // Drop the rest of the old plan, what is already queued goes out and settles before the
+    // display is checked against the new target
+    nextPress = plan.length;
+  } else if (phase == PHASE_IDLE) {
+    phase = PHASE_CHECK;
+  }
+  return requestId;
+}
+
+bool StateController::canReach(const struct AcState& target) const {
+  return CommandPlanner(reader->getAcModel()).canReach(target);
+}
+
+void StateController::step() {
+  switch (phase) {
+    case PHASE_IDLE:
+      return;
+    case PHASE_SENDING:
+      sendPlan();
+      if (nextPress < plan.length || !transmitter->isIdle()) {
+        return;
+      }
+      phase = PHASE_SETTLING;
+      settleStart = millis();
+      // The display may already show the presses
+      // fall through
+    case PHASE_SETTLING:
+      settle();
+      return;
+    case PHASE_CHECK:
+      check();
+      return;
+  }
+}
+
+bool StateController::isAtTarget() {
+  if (power != POWER_SET) {
+    return reader->isAcOn() == (power == POWER_ON);
+  }
+  if (!reader->isAcOn()) {
+    return false;
+  }
+  struct AcState current(0, reader->getTemp(), 0, reader->getFanSpeed(), reader->getAcMode(), false);
+  struct CommandPlan remaining;
+  enum AcModels model = reader->getAcModel();
+  CommandPlanner planner(model);
+  return planner.plan(current, target, holdCalibrations[model], MAX_HOLD_MICROS, &remaining) &&
+    remaining.isEmpty();
+}
+
+void StateController::check() {
+  if (Time.now() - requestTime >= TIMEOUT_SECONDS) {
+    finish("SET_STATE_TIMEOUT");
+    return;
+  }
+
+  // A state restored after a reset may be stale, a power press decided on it could turn the AC
+  // the wrong way so wait for the display to confirm it
+  if (reader->isAcStateProvisional() && (power != POWER_SET || !reader->isAcOn())) {
+    return;
+  }
+
+  plan = CommandPlan();
+  nextPress = 0;
+  if (power == POWER_ON || power == POWER_OFF) {
+    if (reader->isAcOn() == (power == POWER_ON)) {
+      finish("SET_STATE_DONE");
+      return;
+    }
+    Spark.publish(power == POWER_ON ? "ON" : "OFF", "");
+    plan.presses[plan.length++] = {AC_CMD_ON_OFF, 0};
+  } else if (!reader->isAcOn()) {
+    // First turn it on if it is off
+    Spark.publish("ON", "");
+    plan.presses[plan.length++] = {AC_CMD_ON_OFF, 0};
+  } else {
+    // Everything that differs is sent as one batch, then checked once the display catches up
+    struct AcState current(0, reader->getTemp(), 0, reader->getFanSpeed(), reader->getAcMode(), false);
+    enum AcModels model = reader->getAcModel();
+    CommandPlanner planner(model);
+    if (!planner.plan(current, target, holdCalibrations[model], MAX_HOLD_MICROS, &plan)) {
+      // setState checked the target, the model must have been changed or detected since
+      finish("SET_STATE_UNREACHABLE");
+      return;
+    }
+
+    if (plan.isEmpty()) {
+      finish("SET_STATE_DONE");
+      return;
+    }
+
+    if (plan.changesMode) {
+      Spark.publish("MODE", modeName);
+    }
+    if (plan.changesSpeed) {
+      Spark.publish("SPEED", speedName);
+    }
+  }
+
+  startTemp = reader->getTemp();
+  batchStart = micros();
+  batchChanges = reader->getStats().stateChanges;
+  acked = false;
+  transmitter->setFrameSpacing(pacing[reader->getAcModel()].getFrameSpacing());
+
+  phase = PHASE_SENDING;
+  sendPlan();
+}
+
+/**
+ * Queue as much of the plan as the transmitter has room for
+ */
+void StateController::sendPlan() {
+  while (nextPress < plan.length) {
+    const PlannedPress& press = plan.presses[nextPress];
+    if (transmitter->holdIrCommand(press.command, press.repeats) == IR_QUEUE_FULL) {
+      return;
+    }
+    nextPress++;
+  }
+}
+
+/**
+ * Wait for the display to show the target or for the learned settle time, whichever comes first
+ */
+void StateController::settle() {
+  CommandPacing& modelPacing = pacing[reader->getAcModel()];
+  if (!acked && reader->getStats().stateChanges != batchChanges) {
+    acked = true;
+    modelPacing.recordAck((uint32_t) (reader->getLastStateChangeMicros() - batchStart) / 1000);
+  }
+
+  bool waited = (uint32_t) (millis() - settleStart) >= modelPacing.getSettleMillis() || Time.now() - requestTime >= TIMEOUT_SECONDS;
+  if (!waited && !(acked && isAtTarget())) {
+    return;
+  }
+
+  if (!acked) {
+    modelPacing.recordMiss();
+  }
+  learn();
+  saveWarmPacing(reader->getUnit(), pacing, holdCalibrations);
+  updatePacingJson();
+  check();
+}
+
+/**
+ * Compare the temperature move against the display
+ */
+void StateController::learn() {
+  int landed = (reader->getTemp() - startTemp) * plan.tempDirection;
+  if (plan.holdRepeats > 0) {
+    holdCalibrations[reader->getAcModel()].record(plan.holdRepeats, landed);
+  } else if (plan.tempPresses > 0) {
+    pacing[reader->getAcModel()].recordPresses(plan.tempPresses, landed);
+  }
+}
+
+void StateController::finish(const char* eventName) {
+  Spark.publish(eventName, String(requestId));
+  phase = PHASE_IDLE;
+}
+
+void StateController::updatePacingJson() {
+  const CommandPacing& modelPacing = pacing[reader->getAcModel()];
+  sprintf(pacingJson, PACING_TEMPLATE, modelPacing.getAckMillis(), modelPacing.getAckDeviationMillis(),
+    modelPacing.getSettleMillis(), modelPacing.getFrameSpacing(), modelPacing.getSamples());
+}
+
+}
@@ -0,0 +1,122 @@
+#include "application.h"
+
+#ifndef AC_STATE_CONTROLLER_H
+#define AC_STATE_CONTROLLER_H
+
+#include "ac_parser.h"
+#include "ac_display_reader.h"
+#include "ac_ir_controller.h"
+#include "ac_hold_calibration.h"
+#include "ac_command_planner.h"
+#include "ac_command_pacing.h"
+
+namespace AcManager {
+
+/**
+ * Drives the AC towards the last requested state without blocking. request() only records the
+ * target, step() is called from loop() and does one small piece of work each time: queue planned
+ * presses, wait for the transmitter to drain, wait for the display to settle, then compare the
+ * display to the target and plan again.
+ *
+ * How long to wait for the display and how far apart to send presses is learned per model by
+ * CommandPacing, from when the display first changed after each batch and how many presses
+ * landed. The display is checked early once it shows the target. What has been learned is kept
+ * in the warm state so it survives a reset, power presses wait until a state restored from it has
+ * been confirmed by the display.
+ *
+ * Each unit has its own controller, bound to the unit's display reader and IR transmitter. There is
+ * only ever one target per unit, a new request replaces the one in progress. Results are published
+ * as events with the request id as data: SET_STATE_DONE, SET_STATE_TIMEOUT, SET_STATE_REPLACED
+ * for a request that was overtaken before it finished or SET_STATE_UNREACHABLE if the model changed
+ * since the request to one that can't show the target. Request ids are unique across units.
+ */
+class StateController {
+  public:
+    static const int FIRST_REQUEST_ID = 100; // request ids never collide with setState error codes
+    static const int TIMEOUT_SECONDS = 10; // from the latest request to giving up
+    // Longest held temperature move, the rest of the timeout is left to settle and correct it
+    static const unsigned long MAX_HOLD_MICROS = TIMEOUT_SECONDS * 1000000UL / 4;
+
+    enum Power {
+      POWER_SET, // turn on if needed and get to the target mode, fan speed and temperature
+      POWER_ON, // only turn on, target is ignored
+      POWER_OFF
+    };
+
+    StateController();
+
+    /**
+     * Drive the unit reader displays and transmitter sends to. Restores pacing learned before the
+     * last reset and registers the cloud variable showing the current model's learned pacing
+     */
+    void init(DisplayReader* reader, IrTransmitter* transmitter, String pacingVar);
+
+    /**
+     * Make target the state to drive towards, returns the id the result events will carry.
+     * modeName and speedName are only used as event data.
+     */
+    int request(enum Power power, const struct AcState& target, String modeName, String speedName);
+
+    /**
+     * True if the unit's model can be driven to target, see CommandPlanner::canReach
+     */
+    bool canReach(const struct AcState& target) const;
+
+    /**
+     * Do whatever the current phase needs, never waits
+     */
+    void step();
+
+    bool isBusy() const { return phase != PHASE_IDLE; }
+    int getRequestId() const { return requestId; }
+    const CommandPacing& getPacing(enum AcModels model) const { return pacing[model]; }
+    const HoldCalibration& getHoldCalibration(enum AcModels model) const { return holdCalibrations[model]; }
+
+  private:
+    enum Phase {
+      PHASE_IDLE,
+      PHASE_CHECK, // compare the display to the target
+      PHASE_SENDING, // queueing plan presses and waiting for them to go out
+      PHASE_SETTLING // waiting for the display to catch up
+    };
+
+    static int nextRequestId;
+
+    DisplayReader* reader;
+    IrTransmitter* transmitter;
+    Phase phase;
+    int requestId;
+    int requestTime; // Time.now() of the latest request
+    enum Power power;
+    struct AcState target;
+    String modeName;
+    String speedName;
+
+    struct CommandPlan plan;
+    int nextPress; // plan presses before this are queued
+    uint32_t settleStart; // millis the last frame of the batch went out
+
+    // What the batch is measured against once the display settles. Times are 32 bit like micros()
+    // and millis() on the Photon so the differences survive them wrapping wherever unsigned long is
+    // wider
+    uint32_t batchStart; // micros the first frame was queued
+    unsigned long batchChanges; // display state changes before the batch
+    bool acked; // the display changed since batchStart
+    int startTemp;
+
+    HoldCalibration holdCalibrations[3]; // indexed by AcModels
+    CommandPacing pacing[3];
+    char pacingJson[96];
+
+    bool isAtTarget();
+    void check();
+    void sendPlan();
+    void settle();
+    void learn();
+    void finish(const char* eventName);
+    void updatePacingJson();
+};
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "application.h"
+#include "ac_state_filter.h"
+
+namespace AcManager {
+
+StateFilter::StateFilter(int window, int quorum) : window(1), quorum(1) {
+  if (!configure(window, quorum)) {
+    reset();
+  }
+}
+
+bool StateFilter::configure(int newWindow, int newQuorum) {
+  if (newWindow < 1 || newWindow > MAX_WINDOW || newQuorum < 1 || newQuorum > newWindow) {
+    return false;
+  }
+
+  window = newWindow;
+  quorum = newQuorum;
+  reset();
+  return true;
+}
+
+void StateFilter::reset() {
+  historyStart = 0;
+  historyLen = 0;
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    counts[i].count = EMPTY;
+  }
+  hasWinner = false;
+  currentWinner = 0;
+}
+
+bool StateFilter::add(uint32_t packed, uint32_t* winner) {
+  // Evict the oldest state once the window is full
+  if (historyLen == window) {
+    decrement(history[historyStart]);
+    historyStart = (historyStart + 1) % window;
+    historyLen--;
+  }
+
+  history[(historyStart + historyLen) % window] = packed;
+  historyLen++;
+  int count = increment(packed);
+
+  if (count >= quorum) {
+    hasWinner = true;
+    currentWinner = packed;
+  } else if (hasWinner && countOf(currentWinner) < quorum) {
+    hasWinner = false;
+  }
+
+  if (hasWinner) {
+    *winner = currentWinner;
+  }
+  return hasWinner;
+}
+
+int StateFilter::countOf(uint32_t packed) const {
+  int slot = find(packed);
+  return slot == -1 ? 0 : counts[slot].count;
+}
+
+/**
+ * Bits in an index of a table of size slots, size is a power of 2
+ */
+static constexpr int indexBits(int size) {
+  return size <= 1 ? 0 : 1 + indexBits(size / 2);
+}
+
+int StateFilter::home(uint32_t packed) {
+  // Fibonacci hashing, keep the top bits as the index
+  static_assert((TABLE_SIZE & (TABLE_SIZE - 1)) == 0, "TABLE_SIZE must be a power of 2");
+  return (packed * 2654435761u) >> (32 - indexBits(TABLE_SIZE));
+}
+
+int StateFilter::find(uint32_t packed) const {
+  for (int slot = home(packed); counts[slot].count != EMPTY; slot = (slot + 1) % TABLE_SIZE) {
+    if (counts[slot].packed == packed) {
+      return slot;
+    }
+  }
+  return -1;
+}
+
+int StateFilter::increment(uint32_t packed) {
+  int slot = home(packed);
+  while (counts[slot].count != EMPTY && counts[slot].packed != packed) {
+    slot = (slot + 1) % TABLE_SIZE;
+  }
+  counts[slot].packed = packed;
+  return ++counts[slot].count;
+}
+
+void StateFilter::decrement(uint32_t packed) {
+  int slot = find(packed);
+  if (slot == -1 || --counts[slot].count != EMPTY) {
+    return;
+  }
+
+  // Slot is now free, shift later entries of the probe run back so lookups still find them
+  int next = slot;
+  while (true) {
+    next = (next + 1) % TABLE_SIZE;
+    if (counts[next].count == EMPTY) {
+      break;
+    }
+    int nextHome = home(counts[next].packed);
+    bool movable = (slot <= next) ? (nextHome <= slot || nextHome > next) : (nextHome <= slot && nextHome > next);
+    if (movable) {
+      counts[slot] = counts[next];
+      counts[next].count = EMPTY;
+      slot = next;
+    }
+  }
+}
+
+}
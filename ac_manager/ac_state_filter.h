@@ -0,0 +1,67 @@
+#include "application.h"
+
+#ifndef AC_STATE_FILTER_H
+#define AC_STATE_FILTER_H
+
+namespace AcManager {
+
+/**
+ * Streaming consensus over the states decoded from the last window display refreshes, keyed by
+ * AcState::display. Keeps a count per distinct packed state so adding a state and evicting the
+ * oldest are both O(1), no matter the window size.
+ *
+ * A state wins once it has been seen quorum times in the window. If the newest state has quorum
+ * it wins, otherwise the previous winner is kept for as long as it still has quorum.
+ */
+class StateFilter {
+  public:
+    static const int MAX_WINDOW = 32;
+
+    StateFilter(int window, int quorum);
+
+    /**
+     * Change the window and quorum, clears the history. Returns false and leaves the filter alone
+     * if they are out of range.
+     */
+    bool configure(int window, int quorum);
+    void reset();
+
+    /**
+     * Add the newest state, evicting the oldest once the window is full. Returns true and sets
+     * winner if some state has quorum.
+     */
+    bool add(uint32_t packed, uint32_t* winner);
+
+    int countOf(uint32_t packed) const;
+    int getWindow() const { return window; }
+    int getQuorum() const { return quorum; }
+
+    // Count table layout, public so the tests can pick states that collide
+    static const int TABLE_SIZE = MAX_WINDOW * 2; // Keeps the count table at most half full, a power of 2
+    static int home(uint32_t packed);
+
+  private:
+    static const uint8_t EMPTY = 0;
+
+    struct Slot {
+      uint32_t packed;
+      uint8_t count; // EMPTY marks an unused slot
+    };
+
+    int window;
+    int quorum;
+    uint32_t history[MAX_WINDOW]; // Circular buffer of the packed states in the window
+    int historyStart;
+    int historyLen;
+    Slot counts[TABLE_SIZE]; // Open addressed packed state -> count
+    bool hasWinner;
+    uint32_t currentWinner;
+
+    int find(uint32_t packed) const;
+    int increment(uint32_t packed);
+    void decrement(uint32_t packed);
+};
+
+}
+
+#endif
@@ -0,0 +1,28 @@
+#include "application.h"
+
+#ifndef AC_UNITS_H
+#define AC_UNITS_H
+
+// Window units one device can run. Each takes a display clock interrupt, an IR timer and an ISR
+// trampoline slot, the Photon has three spare hardware timers
+#define AC_UNITS_MAX 3
+
+/**
+ * Split the optional "<unit>:" prefix off a cloud function argument, e.g. "1:72,MODE_COOL,FAN_AUTO".
+ * Returns the unit, 0 when there is no prefix, or -1 if the prefix isn't a unit number
+ */
+inline int takeAcUnit(String* command) {
+  int colon = command->indexOf(':');
+  if (colon == -1) {
+    return 0;
+  }
+
+  char digit = command->charAt(0);
+  if (colon != 1 || digit < '0' || digit >= '0' + AC_UNITS_MAX) {
+    return -1;
+  }
+  *command = command->substring(colon + 1);
+  return digit - '0';
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "application.h"
+#include "ac_warm_state.h"
+
+static_assert(std::is_trivially_copyable<AcManager::CommandPacing>::value, "CommandPacing is copied as bytes");
+static_assert(std::is_trivially_copyable<AcManager::HoldCalibration>::value, "HoldCalibration is copied as bytes");
+
+retained struct WarmState warmState;
+
+static uint32_t warmStateChecksum() {
+  const uint8_t* bytes = (const uint8_t*) &warmState;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(struct WarmState, checksum); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+bool isWarmStateValid() {
+  return warmState.magic == WARM_STATE_MAGIC && warmState.version == WARM_STATE_VERSION &&
+    warmState.checksum == warmStateChecksum();
+}
+
+/**
+ * Start a fresh record if the retained one can't be trusted, anything it held is garbage
+ */
+static void prepareWarmState() {
+  if (!isWarmStateValid()) {
+    memset(&warmState, 0, sizeof(warmState));
+    warmState.magic = WARM_STATE_MAGIC;
+    warmState.version = WARM_STATE_VERSION;
+  }
+}
+
+void saveWarmDisplay(int unit, enum AcModels model, uint32_t display) {
+  prepareWarmState();
+  struct WarmUnit& warm = warmState.units[unit];
+  warm.hasDisplay = 1;
+  warm.model = model;
+  warm.display = display;
+  warmState.checksum = warmStateChecksum();
+}
+
+bool loadWarmDisplay(int unit, enum AcModels* model, uint32_t* display) {
+  const struct WarmUnit& warm = warmState.units[unit];
+  if (!isWarmStateValid() || !warm.hasDisplay || warm.model >= WARM_STATE_MODELS) {
+    return false;
+  }
+  *model = (AcModels) warm.model;
+  *display = warm.display;
+  return true;
+}
+
+void saveWarmPacing(int unit, const AcManager::CommandPacing pacing[], const AcManager::HoldCalibration holdCalibrations[]) {
+  prepareWarmState();
+  struct WarmUnit& warm = warmState.units[unit];
+  warm.hasPacing = 1;
+  for (int m = 0; m < WARM_STATE_MODELS; m++) {
+    memcpy(warm.pacing[m], &pacing[m], sizeof(AcManager::CommandPacing));
+    memcpy(warm.holdCalibrations[m], &holdCalibrations[m], sizeof(AcManager::HoldCalibration));
+  }
+  warmState.checksum = warmStateChecksum();
+}
+
+bool loadWarmPacing(int unit, AcManager::CommandPacing pacing[], AcManager::HoldCalibration holdCalibrations[]) {
+  const struct WarmUnit& warm = warmState.units[unit];
+  if (!isWarmStateValid() || !warm.hasPacing) {
+    return false;
+  }
+  for (int m = 0; m < WARM_STATE_MODELS; m++) {
+    memcpy(&pacing[m], warm.pacing[m], sizeof(AcManager::CommandPacing));
+    memcpy(&holdCalibrations[m], warm.holdCalibrations[m], sizeof(AcManager::HoldCalibration));
+  }
+  return true;
+}
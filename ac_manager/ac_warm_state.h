@@ -0,0 +1,59 @@
+#ifndef AC_WARM_STATE_H
+#define AC_WARM_STATE_H
+
+#include "ac_display_reader.h"
+#include "ac_command_pacing.h"
+#include "ac_hold_calibration.h"
+
+#define WARM_STATE_MAGIC 0x41435753 // "ACWS"
+#define WARM_STATE_VERSION 2 // bump whenever the layout of WarmState or what it copies changes
+#define WARM_STATE_MODELS 3 // indexed by AcModels
+
+/**
+ * One unit's part of WarmState
+ */
+struct WarmUnit {
+  uint8_t hasDisplay;
+  uint8_t hasPacing;
+  uint8_t model; // AcModels display was decoded with
+  uint32_t display; // AcState::display of the last voted state
+  uint8_t pacing[WARM_STATE_MODELS][sizeof(AcManager::CommandPacing)];
+  uint8_t holdCalibrations[WARM_STATE_MODELS][sizeof(AcManager::HoldCalibration)];
+};
+
+/**
+ * What the firmware knew about each unit before the last System.reset(), kept in retained backup
+ * SRAM so a warm boot doesn't start from an unknown display and default pacing.
+ *
+ * Retained memory holds whatever was there at power on, so the record is only trusted when the
+ * magic, version and checksum all match. The learned pacing is copied in as raw bytes, a retained
+ * object with a constructor would be reset on every boot.
+ */
+struct WarmState {
+  uint32_t magic;
+  uint16_t version;
+  struct WarmUnit units[AC_UNITS_MAX];
+  uint32_t checksum; // FNV-1a over everything before it
+};
+
+bool isWarmStateValid();
+
+/**
+ * Remember unit's voted display state, called on every state change
+ */
+void saveWarmDisplay(int unit, enum AcModels model, uint32_t display);
+
+/**
+ * Sets model and display from unit's record, false if there isn't a valid one
+ */
+bool loadWarmDisplay(int unit, enum AcModels* model, uint32_t* display);
+
+void saveWarmPacing(int unit, const AcManager::CommandPacing pacing[], const AcManager::HoldCalibration holdCalibrations[]);
+
+/**
+ * Overwrites pacing and holdCalibrations with unit's record, false and untouched if there isn't a
+ * valid one
+ */
+bool loadWarmPacing(int unit, AcManager::CommandPacing pacing[], AcManager::HoldCalibration holdCalibrations[]);
+
+#endif
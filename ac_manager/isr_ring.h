@@ -0,0 +1,134 @@
+#include "application.h"
+
+#ifndef ISR_RING_H
+#define ISR_RING_H
+
+#include <atomic>
+
+namespace AcManager {
+
+/**
+ * Lock-free single producer, single consumer ring. The producer (an ISR) fills a slot and then
+ * publishes it by bumping writeCount, the consumer never has to turn interrupts off.
+ *
+ * writeCount is a free running count of every entry ever pushed. The low bits index the ring and
+ * the rest is the generation, which lets the reader spot slots the producer lapped while it was
+ * copying them.
+ */
+template <typename T, uint32_t N>
+class IsrRing {
+  static_assert((N & (N - 1)) == 0, "IsrRing size must be a power of 2");
+
+  public:
+    IsrRing() : writeCount(0) {}
+
+    /**
+     * Producer side, must only be called from the ISR
+     */
+    void push(const T& value) {
+      uint32_t count = writeCount.load(std::memory_order_relaxed);
+      slots[count & (N - 1)] = value;
+      writeCount.store(count + 1, std::memory_order_release);
+    }
+
+    /**
+     * Number of entries pushed so far, wraps at 2^32
+     */
+    uint32_t written() const {
+      return writeCount.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Copy the entries pushed since readCount into dest in arrival order, keeping only the newest
+     * maxLen of them. readCount is advanced past everything available, returns the number of
+     * entries copied.
+     */
+    int read(uint32_t& readCount, T dest[], int maxLen) {
+      uint32_t end = written();
+      uint32_t start = readCount;
+      uint32_t limit = min((uint32_t) maxLen, N);
+      if (end - start > limit) {
+        start = end - limit;
+      }
+
+      int len = 0;
+      for (uint32_t seq = start; seq != end; seq++) {
+        dest[len++] = slots[seq & (N - 1)];
+      }
+
+      // Drop anything at the front the producer may have overwritten while it was being copied
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint32_t after = writeCount.load(std::memory_order_relaxed);
+      int stale = 0;
+      while (stale < len && (after - (start + stale)) >= N) {
+        stale++;
+      }
+      if (stale > 0) {
+        for (int i = stale; i < len; i++) {
+          dest[i - stale] = dest[i];
+        }
+        len -= stale;
+      }
+
+      readCount = end;
+      return len;
+    }
+
+  private:
+    T slots[N];
+    std::atomic<uint32_t> writeCount;
+};
+
+/**
+ * Lock-free bounded single producer, single consumer queue for handing work to an ISR. Unlike
+ * IsrRing nothing is ever overwritten, push fails once the consumer is N entries behind.
+ *
+ * head and tail are free running counts of entries popped and pushed, each is only written by one
+ * side.
+ */
+template <typename T, uint32_t N>
+class IsrQueue {
+  static_assert((N & (N - 1)) == 0, "IsrQueue size must be a power of 2");
+
+  public:
+    IsrQueue() : head(0), tail(0) {}
+
+    /**
+     * Producer side, returns false if the queue is full
+     */
+    bool push(const T& value) {
+      uint32_t t = tail.load(std::memory_order_relaxed);
+      if (t - head.load(std::memory_order_acquire) >= N) {
+        return false;
+      }
+      slots[t & (N - 1)] = value;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Consumer side, returns false if the queue is empty
+     */
+    bool pop(T& dest) {
+      uint32_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) {
+        return false;
+      }
+      dest = slots[h & (N - 1)];
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    int size() const {
+      return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+  private:
+    T slots[N];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+}
+
+#endif
@@ -1,41 +1,65 @@
 #include "application.h"
 #include "wifi_keepalive.h"
 
-int checkInterval;
-int resetInterval;
+#define PING_TRIES 1 // one probe per tick keeps the time checkConnection blocks to a single ping
+
 IPAddress pingDest;
 
 int lastCheck;
 int lastResponse;
 
-void setupConnectionCheck() {
-  checkInterval = 10;
-  resetInterval = 40;
+AcManager::Scheduler* keepaliveScheduler;
+int checkTask;
+AcManager::LinkMonitor linkMonitor(AcManager::LINK_MONITOR_CONFIG_DEFAULTS);
+
+bool setupConnectionCheck(AcManager::Scheduler* scheduler, const struct AcManager::LinkMonitorConfig& config) {
   IPAddress pd(192, 168, 0, 1);
   pingDest = pd;
 
   lastCheck = Time.now();
   lastResponse = lastCheck;
 
+  linkMonitor = AcManager::LinkMonitor(config);
+  linkMonitor.reset(millis());
+  keepaliveScheduler = scheduler;
+  checkTask = scheduler->add(checkConnection, linkMonitor.getInterval());
+
   Spark.variable("lastCheck", &lastCheck, INT);
   Spark.variable("lastResponse", &lastResponse, INT);
+  return checkTask != -1;
 }
 
-void checkConnection() {
+/**
+ * Scheduled every LinkMonitor interval, sends one probe and acts on the result
+ */
+void checkConnection(void* context) {
   int now = Time.now();
-  if ((now - lastCheck) >= checkInterval) {
-    lastCheck = now;
-    Serial.println(pingDest);
-    int successes = WiFi.ping(pingDest, 8);
-
-    if (successes > 0) {
-      Spark.publish("PING", "SUCCESS");
-      lastResponse = now;
-    } else {
-      Spark.publish("PING", "FAIL");
-    }
+  lastCheck = now;
+  bool wasUp = linkMonitor.isUp();
+  bool success = WiFi.ping(pingDest, PING_TRIES) > 0;
+  if (success) {
+    lastResponse = now;
+  }
+
+  switch (linkMonitor.record(success, millis())) {
+    case AcManager::LinkMonitor::ACTION_RECONNECT:
+      Spark.publish("LINK_RECONNECT", String(linkMonitor.getWindowFailures()));
+      WiFi.disconnect();
+      WiFi.connect();
+      break;
+    case AcManager::LinkMonitor::ACTION_RESET:
+      System.reset();
+      break;
+    case AcManager::LinkMonitor::ACTION_NONE:
+      break;
   }
-  if ((now - lastResponse) > resetInterval) {
-    System.reset();
+
+  if (linkMonitor.isUp() != wasUp) {
+    Spark.publish(linkMonitor.isUp() ? "LINK_UP" : "LINK_DOWN", String(linkMonitor.getWindowFailures()));
   }
+  keepaliveScheduler->setPeriod(checkTask, linkMonitor.getInterval());
+}
+
+const AcManager::LinkMonitor& getLinkMonitor() {
+  return linkMonitor;
 }
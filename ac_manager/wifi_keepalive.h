@@ -1,7 +1,16 @@
 #ifndef WIFI_KEEPALIVE_H
 #define WIFI_KEEPALIVE_H
 
-void setupConnectionCheck();
-void checkConnection();
+#include "ac_scheduler.h"
+#include "ac_link_monitor.h"
+
+/**
+ * Probe the router with one ping per scheduler tick, LinkMonitor decides how often and when to
+ * reconnect or reset. LINK_DOWN/LINK_UP changes and LINK_RECONNECT are published with the failed
+ * probes in the window. setupConnectionCheck returns false and probes nothing if scheduler is full
+ */
+bool setupConnectionCheck(AcManager::Scheduler* scheduler, const struct AcManager::LinkMonitorConfig& config);
+void checkConnection(void* context);
+const AcManager::LinkMonitor& getLinkMonitor();
 
 #endif
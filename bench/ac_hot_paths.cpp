@@ -0,0 +1,242 @@
+/**
+ * Microbenchmarks of every path that runs continuously on the device, checked against stored
+ * results (see baseline.h)
+ *
+ *   ac_hot_paths [-b baseline] [-o results] [-t percent] [-r repeats]
+ *
+ *  -b  compare against this results file, exit 1 if any path got slower than the threshold
+ *  -o  write this run's results, run with -o bench/baselines.tsv to take a new baseline
+ *  -t  slowdown over the baseline that counts as a regression, default 50%
+ *  -r  measurements per path, the median is kept, default 5
+ *
+ * Baselines are only comparable on the machine and build type they were taken with.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "application.h"
+#include "host_hal.h"
+#include "ac_parser.h"
+#include "ac_display_reader.h"
+#include "ac_display_reader_p.h"
+#include "ac_ir_controller.h"
+#include "ac_ir_controller_p.h"
+#include "ac_manager.h"
+
+extern AcManager::DisplayReader displayReaders[];
+extern AcManager::IrTransmitter irTransmitters[];
+#include "bench.h"
+#include "baseline.h"
+
+static AcManager::DisplayReader& reader = displayReaders[0];
+static AcManager::IrTransmitter& transmitter = irTransmitters[0];
+
+#define BIT_MICROS 4 // time the AC controller takes to clock one bit into the register
+#define BYTE_MICROS 1000 // time between the start of each byte, must be over UPDATE_TIME_MAX
+#define FRAME_GAP_MICROS 5000 // extra quiet time between display refreshes, must be over FRAME_GAP_MIN
+
+// A valid 72 degree, cool, auto fan display frame for each model, and 73 degrees on V1_4
+static const uint8_t FRAME_V12[] = {0xFF, 0xF8, 0xA4, 0xDE, 0xEE};
+static const uint8_t FRAME_V14[] = {0x7F, 0x7F, 0xF8, 0xA4, 0xED, 0xFF};
+static const uint8_t FRAME_V18[] = {0xFF, 0xFF, 0xBC, 0xA2, 0xFB, 0xF7};
+static const uint8_t FRAME_V14_73[] = {0x7F, 0x7F, 0xF8, 0xB0, 0xED, 0xFF};
+
+struct ModelFrame {
+  const char* modelName;
+  const uint8_t* frame;
+  int frameLen;
+};
+
+static const ModelFrame MODEL_FRAMES[] = {
+  {"V1_2", FRAME_V12, sizeof(FRAME_V12)},
+  {"V1_4", FRAME_V14, sizeof(FRAME_V14)},
+  {"V1_8", FRAME_V18, sizeof(FRAME_V18)}
+};
+
+static int repeats = 5;
+static Bench::ResultLog results;
+
+template <typename F>
+static void record(const char* name, uint64_t iterations, F fn) {
+  results.add(Bench::runMedian(name, repeats, iterations, fn));
+}
+
+static void feedFrame(const ModelFrame& mf) {
+  HostHal::advanceMicros(FRAME_GAP_MICROS);
+  for (int i = 0; i < mf.frameLen; i++) {
+    uint64_t start = HostHal::nowMicros();
+    HostHal::clockInByte(AC_DISPLAY_READER_CONFIG_DEFAULTS.clockPin, AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin,
+      mf.frame[i], BIT_MICROS);
+    HostHal::setMicros(start + BYTE_MICROS);
+  }
+}
+
+static void hotClockInterrupt() {
+  // Every edge of a byte so the new byte and frame gap paths are in the average
+  setAcModel("V1_4");
+  int bit = 7;
+  int index = 0;
+  uint64_t byteStart = HostHal::nowMicros();
+  record("onClock per edge", 4000000, [&]() {
+    HostHal::setMicros(byteStart + (7 - bit) * BIT_MICROS);
+    HostHal::setPin(AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin, (FRAME_V14[index] >> bit) & 1);
+    reader.onClock();
+    if (--bit < 0) {
+      bit = 7;
+      index = (index + 1) % sizeof(FRAME_V14);
+      byteStart += index == 0 ? BYTE_MICROS + FRAME_GAP_MICROS : BYTE_MICROS;
+    }
+  });
+  reader.processDisplayData();
+  HostHal::clearPublished();
+}
+
+static void hotParseState() {
+  for (const ModelFrame& mf : MODEL_FRAMES) {
+    AcManager::AcParser* parser = getAcParserFor((AcModels) (&mf - MODEL_FRAMES));
+    uint8_t parseBuffer[8];
+    memcpy(parseBuffer, mf.frame, mf.frameLen);
+    struct AcState state;
+
+    char name[64];
+    sprintf(name, "parseState %s per frame", mf.modelName);
+    record(name, 2000000, [&]() {
+      Bench::doNotOptimize(parser->parseState(&state, parseBuffer, mf.frameLen, true));
+    });
+  }
+}
+
+static void hotProcessDisplayData() {
+  // A steady display, what every pass costs while nothing changes
+  for (const ModelFrame& mf : MODEL_FRAMES) {
+    setAcModel(mf.modelName);
+    for (int i = 0; i < BUFFER_LEN / mf.frameLen + 1; i++) {
+      feedFrame(mf);
+    }
+    reader.processDisplayData();
+
+    char name[64];
+    sprintf(name, "processDisplayData %s per pass", mf.modelName);
+    record(name, 200000, [&]() {
+      reader.processDisplayData();
+    });
+    HostHal::clearPublished();
+  }
+
+  // A refresh that differs from the last one has to be decoded and voted on
+  setAcModel("V1_4");
+  const ModelFrame frames[] = {
+    {"V1_4", FRAME_V14, sizeof(FRAME_V14)},
+    {"V1_4", FRAME_V14_73, sizeof(FRAME_V14_73)}
+  };
+  int next = 0;
+  record("feed + processDisplayData new frame", 20000, [&]() {
+    feedFrame(frames[next]);
+    next = 1 - next;
+    reader.processDisplayData();
+    HostHal::clearPublished();
+  });
+}
+
+static void hotUpdateStates() {
+  setAcModel("V1_4");
+  uint8_t parseBuffers[2][8];
+  memcpy(parseBuffers[0], FRAME_V14, sizeof(FRAME_V14));
+  memcpy(parseBuffers[1], FRAME_V14_73, sizeof(FRAME_V14_73));
+  struct AcState state;
+  getAcParserFor(V1_4)->parseState(&state, parseBuffers[0], sizeof(FRAME_V14), true);
+  record("updateStates per vote", 2000000, [&]() {
+    reader.updateStates(&state);
+  });
+  HostHal::clearPublished();
+
+  // With a window of one every other vote changes the state, formatting and publishing the status
+  struct AcState states[2];
+  getAcParserFor(V1_4)->parseState(&states[0], parseBuffers[0], sizeof(FRAME_V14), true);
+  getAcParserFor(V1_4)->parseState(&states[1], parseBuffers[1], sizeof(FRAME_V14_73), true);
+  reader.setStateFilter("1,1");
+  int next = 0;
+  record("updateStates + status JSON per change", 200000, [&]() {
+    reader.updateStates(&states[next]);
+    next = 1 - next;
+    HostHal::clearPublished();
+  });
+  reader.setStateFilter(String(AC_STATES_LEN) + "," + String(AC_STATES_QUORUM));
+}
+
+static void hotIr() {
+  String command = "10AF708F";
+  record("decodeNECHex", 2000000, [&]() {
+    Bench::doNotOptimize(decodeNECHex(command));
+  });
+
+  struct IrWaveform waveform;
+  unsigned int code = 0x10AF708F;
+  record("compileNECWaveform", 2000000, [&]() {
+    compileNECWaveform(code, &waveform);
+    Bench::doNotOptimize(waveform);
+  });
+
+  // Every timer interrupt of a frame going out, the fake clock jumps straight to each one
+  record("sendIrCommand + transmit frame", 1000, []() {
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+    while (!transmitter.isIdle()) {
+      HostHal::advanceMicros(1000);
+    }
+  });
+}
+
+int main(int argc, char** argv) {
+  const char* baselinePath = NULL;
+  const char* outPath = NULL;
+  double threshold = 0.5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:o:t:r:")) != -1) {
+    switch (opt) {
+      case 'b': baselinePath = optarg; break;
+      case 'o': outPath = optarg; break;
+      case 't': threshold = atof(optarg) / 100; break;
+      case 'r': repeats = max(1, atoi(optarg)); break;
+      default:
+        fprintf(stderr, "usage: %s [-b baseline] [-o results] [-t percent] [-r repeats]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  // Read the baseline first, -o may be about to replace it
+  std::map<std::string, double> baseline;
+  if (baselinePath != NULL && !Bench::readBaseline(baselinePath, &baseline)) {
+    fprintf(stderr, "%s: %s\n", baselinePath, strerror(errno));
+    return 2;
+  }
+
+  HostHal::reset();
+  HostHal::setMicros(1000000);
+  setup();
+
+  hotClockInterrupt();
+  hotParseState();
+  hotProcessDisplayData();
+  hotUpdateStates();
+  hotIr();
+
+  if (outPath != NULL && !results.write(outPath)) {
+    fprintf(stderr, "%s: %s\n", outPath, strerror(errno));
+    return 2;
+  }
+  if (baselinePath == NULL) {
+    return 0;
+  }
+
+  printf("\n");
+  int regressions = Bench::compare(results, baseline, threshold);
+  if (regressions > 0) {
+    printf("%d of %zu paths more than %.0f%% slower than %s\n", regressions, results.getEntries().size(),
+      threshold * 100, baselinePath);
+    return 1;
+  }
+  return 0;
+}
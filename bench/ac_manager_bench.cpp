@@ -0,0 +1,822 @@
+/**
+ * Host benchmarks for the code that runs continuously on the device
+ *
+ * Everything is driven through the fake HAL so results only measure the ac_manager code itself.
+ */
+
+#include "application.h"
+#include "host_hal.h"
+#include "ac_parser.h"
+#include "ac_parser_v12.h"
+#include "ac_parser_v14.h"
+#include "ac_parser_v18.h"
+#include "ac_display_reader.h"
+#include "ac_display_reader_p.h"
+#include "ac_state_filter.h"
+#include "ac_ir_controller.h"
+#include "ac_ir_controller_p.h"
+#include "ac_ir_carrier.h"
+#include "ac_ir_measurement.h"
+#include "ac_hold_calibration.h"
+#include "ac_command_planner.h"
+#include "ac_manager.h"
+#include "wifi_keepalive.h"
+#include "ac_state_controller.h"
+#include "ac_warm_state.h"
+
+extern AcManager::DisplayReader displayReaders[];
+extern AcManager::IrTransmitter irTransmitters[];
+extern AcManager::StateController stateControllers[];
+extern AcManager::Scheduler scheduler;
+extern struct WarmState warmState;
+#include "bench.h"
+#include "capture_replay.h"
+#include "edge_trace.h"
+#include "convergence.h"
+
+// Unit 0, set up by setup() like on the device
+static AcManager::DisplayReader& reader = displayReaders[0];
+static AcManager::IrTransmitter& transmitter = irTransmitters[0];
+static AcManager::StateController& stateController = stateControllers[0];
+
+#define BIT_MICROS 4 // time the AC controller takes to clock one bit into the register
+#define BYTE_MICROS 1000 // time between the start of each byte, must be over UPDATE_TIME_MAX
+#define FRAME_GAP_MICROS 5000 // extra quiet time between display refreshes, must be over FRAME_GAP_MIN
+
+// A valid 72 degree, cool, auto fan display frame for each model
+static const uint8_t FRAME_V12[] = {0xFF, 0xF8, 0xA4, 0xDE, 0xEE};
+static const uint8_t FRAME_V14[] = {0x7F, 0x7F, 0xF8, 0xA4, 0xED, 0xFF};
+static const uint8_t FRAME_V18[] = {0xFF, 0xFF, 0xBC, 0xA2, 0xFB, 0xF7};
+static const uint8_t FRAME_V14_73[] = {0x7F, 0x7F, 0xF8, 0xB0, 0xED, 0xFF};
+
+struct ModelFrame {
+  const char* modelName;
+  const uint8_t* frame;
+  int frameLen;
+};
+
+static const ModelFrame MODEL_FRAMES[] = {
+  {"V1_2", FRAME_V12, sizeof(FRAME_V12)},
+  {"V1_4", FRAME_V14, sizeof(FRAME_V14)},
+  {"V1_8", FRAME_V18, sizeof(FRAME_V18)}
+};
+
+static void feedByte(uint8_t value) {
+  uint64_t start = HostHal::nowMicros();
+  HostHal::clockInByte(AC_DISPLAY_READER_CONFIG_DEFAULTS.clockPin, AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin, value, BIT_MICROS);
+  HostHal::setMicros(start + BYTE_MICROS);
+}
+
+static void feedFrames(const ModelFrame& mf, int byteCount, bool frameGaps) {
+  for (int i = 0; i < byteCount; i++) {
+    if (frameGaps && i % mf.frameLen == 0) {
+      HostHal::advanceMicros(FRAME_GAP_MICROS);
+    }
+    feedByte(mf.frame[i % mf.frameLen]);
+  }
+}
+
+static void benchParseState() {
+  for (const ModelFrame& mf : MODEL_FRAMES) {
+    setAcModel(mf.modelName);
+    AcManager::AcParser* parser = reader.getAcParser();
+    uint8_t parseBuffer[8];
+    memcpy(parseBuffer, mf.frame, mf.frameLen);
+    struct AcState state;
+
+    char name[64];
+    sprintf(name, "parseState %s", mf.modelName);
+    Bench::run(name, 2000000, [&]() {
+      Bench::doNotOptimize(parser->parseState(&state, parseBuffer, mf.frameLen, true));
+    });
+  }
+}
+
+static void benchClockInterrupt() {
+  // Walk through the edges of a full byte so the cycle rollover path is included
+  uint8_t value = FRAME_V14[2];
+  int bit = 7;
+  uint64_t byteStart = HostHal::nowMicros();
+  Bench::run("DisplayReader::onClock per edge", 8000000, [&]() {
+    HostHal::setMicros(byteStart + (7 - bit) * BIT_MICROS);
+    HostHal::setPin(AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin, (value >> bit) & 1);
+    reader.onClock();
+    if (--bit < 0) {
+      bit = 7;
+      byteStart += BYTE_MICROS;
+    }
+  });
+}
+
+static void benchProcessAcDisplayData(bool frameGaps) {
+  for (const ModelFrame& mf : MODEL_FRAMES) {
+    setAcModel(mf.modelName);
+    feedFrames(mf, BUFFER_LEN * 2, frameGaps);
+
+    char name[64];
+    sprintf(name, "processDisplayData %s %s", mf.modelName, frameGaps ? "framed" : "unframed");
+    struct AcDisplayReaderStats before = reader.getStats();
+    Bench::Result result = Bench::run(name, 200000, [&]() {
+      reader.processDisplayData();
+      HostHal::clearPublished();
+    });
+    struct AcDisplayReaderStats after = reader.getStats();
+    unsigned long passes = after.passes - before.passes;
+    printf("%-40s %12.1f parse attempts/pass %5.1f%% decode skips\n", name,
+      (double) (after.parseAttempts - before.parseAttempts) / passes,
+      100.0 * (after.decodeSkips - before.decodeSkips) / passes);
+    Bench::doNotOptimize(result);
+  }
+}
+
+/**
+ * How much decoding the passes between two stats snapshots did
+ */
+static void printDecodeWork(const char* name, const AcDisplayReaderStats& before, const AcDisplayReaderStats& after) {
+  unsigned long passes = after.passes - before.passes;
+  printf("%-40s %12.2f parse attempts/pass %8.2f votes/pass %5.1f%% decode skips\n", name,
+    (double) (after.parseAttempts - before.parseAttempts) / passes,
+    (double) (after.parsedFrames - before.parsedFrames) / passes,
+    100.0 * (after.decodeSkips - before.decodeSkips) / passes);
+}
+
+static void benchChangingDisplay() {
+  // Alternate the temperature every frame so every pass has to decode, includes the feed cost
+  setAcModel("V1_4");
+  const ModelFrame frames[] = {
+    {"V1_4", FRAME_V14, sizeof(FRAME_V14)},
+    {"V1_4", FRAME_V14_73, sizeof(FRAME_V14_73)}
+  };
+  int next = 0;
+
+  struct AcDisplayReaderStats before = reader.getStats();
+  Bench::run("feed frame + processDisplayData V1_4", 20000, [&]() {
+    feedFrames(frames[next], sizeof(FRAME_V14), true);
+    next = 1 - next;
+    reader.processDisplayData();
+    HostHal::clearPublished();
+  });
+  printDecodeWork("feed frame + processDisplayData V1_4", before, reader.getStats());
+
+  // The display changing while loop() only gets round every other refresh
+  before = reader.getStats();
+  Bench::run("feed 2 frames + processDisplayData V1_4", 20000, [&]() {
+    feedFrames(frames[next], sizeof(FRAME_V14), true);
+    feedFrames(frames[1 - next], sizeof(FRAME_V14), true);
+    next = 1 - next;
+    reader.processDisplayData();
+    HostHal::clearPublished();
+  });
+  printDecodeWork("feed 2 frames + processDisplayData V1_4", before, reader.getStats());
+}
+
+static void benchUpdateStates() {
+  setAcModel("V1_4");
+  AcManager::AcParser* parser = reader.getAcParser();
+  uint8_t parseBuffer[8];
+  memcpy(parseBuffer, FRAME_V14, sizeof(FRAME_V14));
+  struct AcState state;
+
+  Bench::run("parseState + updateStates V1_4", 2000000, [&]() {
+    parser->parseState(&state, parseBuffer, sizeof(FRAME_V14), true);
+    reader.updateStates(&state);
+  });
+  HostHal::clearPublished();
+}
+
+/**
+ * The all pairs vote updateStates used before StateFilter, kept here to compare against
+ */
+static bool quadraticVote(const uint32_t* window, int windowLen, int quorum, uint32_t* winner) {
+  int maxMatches = 0;
+  int equivalentStates[AcManager::StateFilter::MAX_WINDOW] = { 0 };
+  for (int i = 0; i < windowLen; i++) {
+    for (int o = i + 1; o < windowLen; o++) {
+      if (window[i] == window[o]) {
+        maxMatches = max(maxMatches, max(++equivalentStates[i], ++equivalentStates[o]));
+      }
+    }
+  }
+  for (int i = windowLen - 1; i >= 0; i--) {
+    if (maxMatches + 1 >= quorum && equivalentStates[i] == maxMatches) {
+      *winner = window[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+static void benchStateFilterSweep() {
+  // Mostly one state with every 7th decode glitching to another, like a noisy unit
+  struct AcState stable(0, 72, 0, FAN_AUTO, MODE_COOL, false);
+  struct AcState glitch(0, 78, 0, FAN_AUTO, MODE_COOL, false);
+  uint32_t stream[7];
+  for (int i = 0; i < 7; i++) {
+    stream[i] = (i == 6 ? glitch : stable).display;
+  }
+
+  const int windows[] = {5, 9, 17, 32};
+  for (int window : windows) {
+    int quorum = window / 2 + 1;
+    AcManager::StateFilter filter(window, quorum);
+    uint32_t winner;
+    int next = 0;
+
+    char name[64];
+    sprintf(name, "StateFilter::add window %d", window);
+    Bench::run(name, 2000000, [&]() {
+      Bench::doNotOptimize(filter.add(stream[next], &winner));
+      next = (next + 1) % 7;
+    });
+
+    uint32_t history[AcManager::StateFilter::MAX_WINDOW];
+    int head = 0;
+    for (int i = 0; i < window; i++) {
+      history[i] = stream[i % 7];
+    }
+    sprintf(name, "quadratic vote window %d", window);
+    Bench::run(name, 2000000 / window, [&]() {
+      history[head] = stream[next];
+      head = (head + 1) % window;
+      next = (next + 1) % 7;
+      Bench::doNotOptimize(quadraticVote(history, window, quorum, &winner));
+    });
+  }
+}
+
+static void benchModelDetection() {
+  // Bytes of display data each model needs before detection locks onto it
+  for (const ModelFrame& mf : MODEL_FRAMES) {
+    setAcModel("AUTO");
+    int bytes = 0;
+    while (reader.isDetectingAcModel() && bytes < BUFFER_LEN * 20) {
+      feedFrames(mf, mf.frameLen, true);
+      reader.processDisplayData();
+      bytes += mf.frameLen;
+    }
+    printf("%-40s %12d bytes to lock, detected %s\n", "model detection", bytes, getAcModelVersion(reader.getAcModel()));
+  }
+  HostHal::clearPublished();
+
+  // Cost of scoring all three parsers on one buffer of fresh data
+  feedFrames(MODEL_FRAMES[1], BUFFER_LEN, true);
+  reader.processDisplayData();
+  Bench::run("probeAcModels sample", 200000, []() {
+    if (!reader.isDetectingAcModel()) {
+      reader.startAcModelProbe();
+    }
+    reader.probeAcModels(BUFFER_LEN);
+  });
+  HostHal::clearPublished();
+  setAcModel("V1_4");
+}
+
+static void drainIrQueue() {
+  while (!transmitter.isIdle()) {
+    HostHal::advanceMicros(1000);
+  }
+}
+
+static void benchSendNECCode() {
+  // What it costs to turn a command into something the transmitter can queue
+  String command = "10AF708F";
+  Bench::run("decodeNECHex", 2000000, [&]() {
+    Bench::doNotOptimize(decodeNECHex(command));
+  });
+  Bench::run("getIrWaveform", 2000000, []() {
+    Bench::doNotOptimize(getIrWaveform(AC_CMD_TEMP_TIMER_U));
+  });
+
+  // Frames go out from the timer ISR as the fake clock moves, so these time every edge of a frame
+  Bench::run("sendNEC(String) + transmit frame", 2000, [&]() {
+    sendNEC(command);
+    drainIrQueue();
+  });
+
+  uint64_t start = HostHal::nowMicros();
+  unsigned long callsBefore = HostHal::timerCalls();
+  Bench::Result result = Bench::run("sendIrCommand + transmit frame", 2000, []() {
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+    drainIrQueue();
+  });
+  uint64_t frames = result.iterations + result.iterations / 10 + 1;
+  printf("%-40s %12llu us simulated per frame %8.1f timer interrupts/frame\n", "sendIrCommand",
+    (unsigned long long) ((HostHal::nowMicros() - start) / frames), (double) (HostHal::timerCalls() - callsBefore) / frames);
+
+  // Keep the display clocking in while frames are sent, none of its edges should be lost
+  setAcModel("V1_4");
+  unsigned long missedBefore = HostHal::missedInterrupts();
+  struct AcDisplayReaderStats before = reader.getStats();
+  for (int i = 0; i < 4; i++) {
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  }
+  while (!transmitter.isIdle()) {
+    feedFrames(MODEL_FRAMES[1], sizeof(FRAME_V14), true);
+    reader.processDisplayData();
+  }
+  struct AcDisplayReaderStats after = reader.getStats();
+  printf("%-40s %12lu missed display edges %8lu reader passes %5.1f%% decode skips\n", "display while sending",
+    HostHal::missedInterrupts() - missedBefore, after.passes - before.passes,
+    100.0 * (after.decodeSkips - before.decodeSkips) / (after.passes - before.passes));
+  HostHal::clearPublished();
+}
+
+static void benchIrCarrier() {
+  // Send one frame with each carrier and measure what came out of the LED pin
+  const int pins[] = {D6, D3};
+  for (int pin : pins) {
+    transmitter.init(0, "sendNEC", pin);
+    const char* name = AcManager::isPwmPin(pin) ? "PWM carrier" : "toggled carrier";
+
+    HostHal::recordPinWrites(true);
+    HostHal::clearPinWrites();
+    unsigned long callsBefore = HostHal::timerCalls();
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+    drainIrQueue();
+    unsigned long calls = HostHal::timerCalls() - callsBefore;
+
+    AcManager::IrMeasurement measurement(Carrier_Frequency);
+    for (const HostHal::PinWrite& write : HostHal::pinWrites()) {
+      if (write.pin == pin) {
+        measurement.addEdge(write.micros, write.level == HIGH);
+      }
+    }
+    HostHal::recordPinWrites(false);
+    HostHal::clearPinWrites();
+
+    const struct IrWaveform* waveform = getIrWaveform(AC_CMD_TEMP_TIMER_U);
+    struct AcManager::IrMeasurementReport report;
+    measurement.compare(waveform->micros, waveform->length, &report);
+    printf("%-40s %12.0f Hz %5.1f%% duty %3d/%d marks %4d us start %4d us end error (mark %d)\n", name,
+      report.carrierHz, report.dutyPercent, report.marks, report.expectedMarks, report.maxStartError,
+      report.maxEndError, report.worstMark);
+    printf("%-40s %12lu timer interrupts/frame\n", name, calls);
+
+    char benchName[64];
+    sprintf(benchName, "transmit frame, %s", name);
+    Bench::run(benchName, 2000, []() {
+      transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+      drainIrQueue();
+    });
+  }
+
+  transmitter.init(0, "sendNEC", D6);
+}
+
+static void benchTempHold() {
+  // Airtime of a 10 degree move sent as single presses and as one held press
+  const int steps = 10;
+  uint64_t start = HostHal::nowMicros();
+  for (int i = 0; i < steps; i++) {
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  }
+  drainIrQueue();
+  uint64_t pressMicros = HostHal::nowMicros() - start;
+
+  AcManager::HoldCalibration hold;
+  int repeats = hold.repeatsFor(steps);
+  start = HostHal::nowMicros();
+  transmitter.holdIrCommand(AC_CMD_TEMP_TIMER_U, repeats);
+  drainIrQueue();
+  uint64_t holdMicros = HostHal::nowMicros() - start;
+  // Carrier on time, the marks of each code, and time on air, the codes without the gaps between
+  const struct IrWaveform* waveform = getIrWaveform(AC_CMD_TEMP_TIMER_U);
+  unsigned long frameMarks = 0;
+  unsigned long frameAir = 0;
+  for (int i = 0; i < waveform->length; i++) {
+    frameMarks += i % 2 == 0 ? waveform->micros[i] : 0;
+    frameAir += waveform->micros[i];
+  }
+  unsigned long repeatMarks = IR_REPEAT_WAVEFORM.micros[0] + IR_REPEAT_WAVEFORM.micros[2];
+  unsigned long repeatAir = repeatMarks + IR_REPEAT_WAVEFORM.micros[1];
+  printf("%-40s %12lu us carrier %d presses %8lu us carrier held (%d repeats)\n", "10 degree move",
+    frameMarks * steps, steps, frameMarks + repeatMarks * repeats, repeats);
+  printf("%-40s %12lu us on air %d presses %8lu us on air held (%s)\n", "10 degree move",
+    frameAir * steps, steps, frameAir + repeatAir * repeats,
+    hold.shouldHold(steps, AcManager::StateController::MAX_HOLD_MICROS) ? "held" : "pressed");
+  printf("%-40s %12llu us to send %d presses %8llu us to send held\n", "10 degree move",
+    (unsigned long long) pressMicros, steps, (unsigned long long) holdMicros);
+
+  // Holds it takes to learn a unit that steps every 3 repeat codes instead of the default 2
+  int holds = 0;
+  while (hold.repeatsFor(steps) != AcManager::HoldCalibration::DELAY_REPEATS + (steps - 1) * 3 && holds < 50) {
+    int sent = hold.repeatsFor(steps);
+    hold.record(sent, 1 + (sent - AcManager::HoldCalibration::DELAY_REPEATS) / 3);
+    holds++;
+  }
+  printf("%-40s %12d holds to calibrate 3 repeats/step\n", "HoldCalibration", holds);
+}
+
+static void benchCommandPlanner() {
+  // Fan presses over every from/to pair, planned vs the fixed sequence setState used to send
+  // for each target (auto 1, low 3, medium 4, high 2) no matter the current speed
+  const int fixedPresses[] = {0, 3, 4, 2, 1};
+  AcManager::CommandPlanner planner(V1_4);
+  int planned = 0;
+  int fixed = 0;
+  for (int from = FAN_LOW; from <= FAN_AUTO; from++) {
+    for (int to = FAN_LOW; to <= FAN_AUTO; to++) {
+      if (from == to) {
+        continue;
+      }
+      enum AcCommands presses[AcManager::CommandPlanner::MAX_FAN_PRESSES];
+      planned += planner.planFanSpeed((FanSpeeds) from, (FanSpeeds) to, presses, AcManager::CommandPlanner::MAX_FAN_PRESSES);
+      fixed += fixedPresses[to];
+    }
+  }
+  printf("%-40s %12d presses planned %8d presses fixed (12 speed changes)\n", "fan speed", planned, fixed);
+
+  struct AcState current(0, 72, 0, FAN_AUTO, MODE_ECO, false);
+  struct AcState target(0, 68, 0, FAN_MEDIUM, MODE_COOL, false);
+  AcManager::HoldCalibration hold;
+  struct AcManager::CommandPlan plan;
+  Bench::run("CommandPlanner::plan", 1000000, [&]() {
+    Bench::doNotOptimize(planner.plan(current, target, hold, AcManager::StateController::MAX_HOLD_MICROS, &plan));
+  });
+}
+
+// Display that keeps refreshing while loop() sleeps, 72, cool, auto fan unless a bench changes it
+static ModelFrame loopDisplay = MODEL_FRAMES[1];
+
+// Fake unit, once IR starts going out the display switches to ackDisplay ackMicros later
+static const ModelFrame* ackDisplay = NULL;
+static uint64_t ackMicros = 0;
+static uint64_t irSeen = 0;
+
+static void feedDisplayUntil(uint64_t untilMicros) {
+  while (HostHal::nowMicros() < untilMicros) {
+    if (ackDisplay != NULL) {
+      if (irSeen == 0 && !transmitter.isIdle()) {
+        irSeen = HostHal::nowMicros();
+      }
+      if (irSeen != 0 && HostHal::nowMicros() - irSeen >= ackMicros) {
+        loopDisplay = *ackDisplay;
+        ackDisplay = NULL;
+      }
+    }
+    feedFrames(loopDisplay, loopDisplay.frameLen, true);
+  }
+}
+
+static void benchStatusLatency() {
+  setAcModel("V1_4");
+  HostHal::setPingSuccesses(8);
+  HostHal::setDelayCallback(feedDisplayUntil);
+  for (int i = 0; i < 20; i++) {
+    loop();
+  }
+
+  // Nothing changing, loop() should only wake for the idle bound
+  uint64_t start = HostHal::nowMicros();
+  struct AcDisplayReaderStats before = reader.getStats();
+  while (HostHal::nowMicros() - start < 10000000) {
+    loop();
+  }
+  struct AcDisplayReaderStats after = reader.getStats();
+  printf("%-40s %12.1f passes/s %8.1f decodes/s\n", "idle display",
+    (after.passes - before.passes) / 10.0, (after.decodeRuns - before.decodeRuns) / 10.0);
+
+  // Someone presses the panel, time from the first changed refresh to STATUS_CHANGE
+  const ModelFrame displays[] = {{"V1_4", FRAME_V14_73, sizeof(FRAME_V14_73)}, MODEL_FRAMES[1]};
+  for (const ModelFrame& display : displays) {
+    size_t changesBefore = HostHal::publishCount("STATUS_CHANGE");
+    loopDisplay = display;
+    start = HostHal::nowMicros();
+    while (HostHal::publishCount("STATUS_CHANGE") == changesBefore) {
+      loop();
+    }
+    printf("%-40s %12llu ms to STATUS_CHANGE\n", "panel change",
+      (unsigned long long) ((HostHal::published().back().micros - start) / 1000));
+  }
+  HostHal::clearPublished();
+}
+
+static void benchSetState() {
+  // setState validates the command and queues the first presses, loop() does the rest
+  Bench::run("setState", 200000, []() {
+    Bench::doNotOptimize(setState("72,MODE_COOL,FAN_AUTO"));
+  });
+  HostHal::clearPublished();
+  setState("72,MODE_COOL,FAN_AUTO");
+  printf("%-40s %12zu SET_STATE_DONE from setState itself\n", "already there", HostHal::publishCount("SET_STATE_DONE"));
+
+  // The display never moves, so these have to time out. The first is replaced before loop() runs
+  uint64_t start = HostHal::nowMicros();
+  uint64_t longestStep = 0;
+  setState("75,MODE_COOL,FAN_AUTO");
+  setState("76,MODE_COOL,FAN_AUTO");
+  printf("%-40s %12zu SET_STATE_REPLACED\n", "coalesced", HostHal::publishCount("SET_STATE_REPLACED"));
+  size_t timeoutsBefore = HostHal::publishCount("SET_STATE_TIMEOUT");
+  while (HostHal::publishCount("SET_STATE_TIMEOUT") == timeoutsBefore) {
+    uint64_t stepStart = HostHal::nowMicros();
+    loop();
+    longestStep = max(longestStep, HostHal::nowMicros() - stepStart);
+  }
+  printf("%-40s %12llu ms to SET_STATE_TIMEOUT %8llu ms longest loop()\n", "unreachable target",
+    (unsigned long long) ((HostHal::nowMicros() - start) / 1000), (unsigned long long) (longestStep / 1000));
+  HostHal::clearPublished();
+}
+
+static void benchAckPacing() {
+  // A fake unit that shows each temperature press 400ms after the IR starts, setState moves it
+  // between 72 and 73 and the pacing is learned as it goes
+  const ModelFrame displays[] = {MODEL_FRAMES[1], {"V1_4", FRAME_V14_73, sizeof(FRAME_V14_73)}};
+  ackMicros = 400000;
+  for (int round = 0; round < 8; round++) {
+    int to = (round + 1) % 2;
+    uint64_t start = HostHal::nowMicros();
+    size_t doneBefore = HostHal::publishCount("SET_STATE_DONE");
+    ackDisplay = &displays[to];
+    irSeen = 0;
+    setState(to == 1 ? "73,MODE_COOL,FAN_AUTO" : "72,MODE_COOL,FAN_AUTO");
+    while (HostHal::publishCount("SET_STATE_DONE") == doneBefore && HostHal::nowMicros() - start < 20000000) {
+      loop();
+    }
+    const AcManager::CommandPacing& pacing = stateController.getPacing(V1_4);
+    printf("%-40s %12llu ms to SET_STATE_DONE %5lu ms ack %5lu ms wait\n", round == 0 ? "converge, first request" : "converge, learned",
+      (unsigned long long) ((HostHal::nowMicros() - start) / 1000), pacing.getAckMillis(), pacing.getSettleMillis());
+  }
+  ackDisplay = NULL;
+  loopDisplay = MODEL_FRAMES[1];
+  HostHal::setDelayCallback(NULL);
+  HostHal::clearPublished();
+}
+
+static void benchWarmRestart() {
+  HostHal::setDelayCallback(feedDisplayUntil);
+  HostHal::clearPublished();
+
+  // Boot with the display still showing the saved state, it is served before any frame is voted on
+  reader.lockAcModel(V1_4);
+  reader.restoreWarmAcState();
+  uint64_t start = HostHal::nowMicros();
+  while (reader.isAcStateProvisional()) {
+    loop();
+  }
+  printf("%-40s %12d F at boot %8llu ms to confirm (cold boot has no state until then)\n", "warm boot",
+    reader.getTemp(), (unsigned long long) ((HostHal::nowMicros() - start) / 1000));
+
+  // The AC was off at the reset but someone turned it on since, OFF waits for the display first
+  saveWarmDisplay(0, V1_4, AcState(0, 72, 0, FAN_OFF, MODE_OFF, false).display);
+  reader.lockAcModel(V1_4);
+  reader.restoreWarmAcState();
+  start = HostHal::nowMicros();
+  setState("OFF");
+  while (transmitter.isIdle() && stateController.isBusy()) {
+    loop();
+  }
+  printf("%-40s %12llu ms to first press\n", "stale warm state, OFF", (unsigned long long) ((HostHal::nowMicros() - start) / 1000));
+  while (stateController.isBusy()) {
+    loop();
+  }
+  HostHal::setDelayCallback(NULL);
+  HostHal::clearPublished();
+}
+
+static void benchVirtualAc() {
+  // setState against each model from whatever it shows, pacing and hold timing learned as it goes
+  for (int m = 0; m < 3; m++) {
+    struct VirtualAcConfig config = VIRTUAL_AC_DEFAULTS;
+    config.model = (AcModels) m;
+    VirtualAc ac(config);
+    Convergence::warmUp(&ac, MODEL_FRAMES[m].modelName);
+    Convergence::Result result;
+    Convergence::run(&ac, 100, m + 1, &result);
+
+    char name[64];
+    sprintf(name, "converge %s", MODEL_FRAMES[m].modelName);
+    printf("%-40s %8.2f s p50 %8.2f s p95 %8.2f frames/req %6.2f repeats/req %4d timeouts %4d rejected\n", name,
+      result.percentile(0.5), result.percentile(0.95), (double) result.frames / result.accepted(),
+      (double) result.repeats / result.accepted(), result.timeouts, result.rejected);
+  }
+  setAcModel("V1_4");
+}
+
+// Extra units for benchMultiUnit, unit 0 is the one setup() wires to the default pins
+static AcManager::DisplayReader extraReaders[AC_UNITS_MAX - 1];
+static const int EXTRA_CLOCK_PINS[AC_UNITS_MAX - 1] = {D4, D5};
+static const int EXTRA_INPUT_PINS[AC_UNITS_MAX - 1] = {D3, A2};
+
+static void benchMultiUnit() {
+  for (int i = 0; i < AC_UNITS_MAX - 1; i++) {
+    struct AcDisplayReaderConfig config = AC_DISPLAY_READER_CONFIG_DEFAULTS;
+    config.clockPin = EXTRA_CLOCK_PINS[i];
+    config.inputPin = EXTRA_INPUT_PINS[i];
+    config.statusVar = config.statusVar + String(i + 1);
+    config.dataVar = config.dataVar + String(i + 1);
+    extraReaders[i].init(i + 1, config, &scheduler);
+  }
+  const int clockPins[AC_UNITS_MAX] = {AC_DISPLAY_READER_CONFIG_DEFAULTS.clockPin, EXTRA_CLOCK_PINS[0], EXTRA_CLOCK_PINS[1]};
+  const int inputPins[AC_UNITS_MAX] = {AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin, EXTRA_INPUT_PINS[0], EXTRA_INPUT_PINS[1]};
+
+  // Every unit clocking in at once, each edge goes through the pin's trampoline to its reader
+  uint8_t value = FRAME_V14[2];
+  for (int units = 1; units <= AC_UNITS_MAX; units++) {
+    int bit = 7;
+    int unit = 0;
+    uint64_t byteStart = HostHal::nowMicros();
+    char name[64];
+    sprintf(name, "clock ISR per edge, %d units", units);
+    Bench::Result result = Bench::run(name, 8000000, [&]() {
+      HostHal::setMicros(byteStart + (7 - bit) * BIT_MICROS);
+      HostHal::setPin(inputPins[unit], (value >> bit) & 1);
+      HostHal::triggerInterrupt(clockPins[unit]);
+      if (++unit == units) {
+        unit = 0;
+        if (--bit < 0) {
+          bit = 7;
+          byteStart += BYTE_MICROS;
+        }
+      }
+    });
+    // A display refresh is a frame of bytes and a gap, 8 clock edges a byte
+    double edgesPerSecond = 8.0 * sizeof(FRAME_V14) * 1000000 / (sizeof(FRAME_V14) * BYTE_MICROS + FRAME_GAP_MICROS);
+    printf("%-40s %12.3f%% of a core at %.0f edges/s per unit\n", name,
+      100.0 * result.nsPerOp * edgesPerSecond * units / 1e9, edgesPerSecond);
+  }
+}
+
+static void countTask(void* context) {}
+
+static void benchScheduler() {
+  AcManager::Scheduler sched;
+  sched.add(countTask, 1000);
+  sched.add(countTask, 250);
+  Bench::run("Scheduler::untilNext", 2000000, [&]() {
+    Bench::doNotOptimize(sched.untilNext());
+  });
+
+  // The firmware's own tasks, loop() with a display that has stopped refreshing
+  // The benches before never ran loop(), let everything overdue run first
+  HostHal::setPingSuccesses(8);
+  loop();
+  HostHal::clearPublished();
+  uint64_t start = HostHal::nowMicros();
+  unsigned long passesBefore = reader.getStats().passes;
+  while (HostHal::nowMicros() - start < 600000000ULL) {
+    loop();
+  }
+  printf("%-40s %12lu loop() passes\n", "600s without display data", reader.getStats().passes - passesBefore);
+  HostHal::clearPublished();
+}
+
+static void benchLinkMonitor() {
+  // An hour of a healthy link, each ping try takes 200ms
+  HostHal::setPingMicros(200000);
+  HostHal::setPingSuccesses(1);
+  HostHal::clearPublished();
+  unsigned long pingsBefore = HostHal::pingCount();
+  uint64_t start = HostHal::nowMicros();
+  uint64_t longestProbe = 0;
+  while (HostHal::nowMicros() - start < 3600000000ULL) {
+    uint64_t probeStart = HostHal::nowMicros();
+    unsigned long pings = HostHal::pingCount();
+    scheduler.run();
+    if (HostHal::pingCount() != pings) {
+      longestProbe = max(longestProbe, HostHal::nowMicros() - probeStart);
+    }
+    HostHal::advanceMicros(scheduler.untilNext() * 1000ULL);
+  }
+  size_t linkPublishes = HostHal::publishCount("PING") + HostHal::publishCount("LINK_UP") + HostHal::publishCount("LINK_DOWN") +
+    HostHal::publishCount("LINK_RECONNECT");
+  printf("%-40s %12lu pings/hour %8zu publishes %5llu ms longest probe\n", "healthy link",
+    HostHal::pingCount() - pingsBefore, linkPublishes, (unsigned long long) (longestProbe / 1000));
+
+  // The router stops answering
+  HostHal::setPingSuccesses(0);
+  HostHal::setConnected(true);
+  unsigned long resetsBefore = HostHal::resetCount();
+  start = HostHal::nowMicros();
+  uint64_t down = 0;
+  uint64_t reconnect = 0;
+  while (HostHal::resetCount() == resetsBefore) {
+    scheduler.run();
+    if (down == 0 && HostHal::publishCount("LINK_DOWN") > 0) {
+      down = HostHal::nowMicros() - start;
+    }
+    if (reconnect == 0 && HostHal::publishCount("LINK_RECONNECT") > 0) {
+      reconnect = HostHal::nowMicros() - start;
+    }
+    HostHal::advanceMicros(scheduler.untilNext() * 1000ULL);
+  }
+  printf("%-40s %12llu s to LINK_DOWN %5llu s to reconnect %5llu s to reset\n", "dead link",
+    (unsigned long long) (down / 1000000), (unsigned long long) (reconnect / 1000000),
+    (unsigned long long) ((HostHal::nowMicros() - start) / 1000000));
+
+  HostHal::setPingSuccesses(8);
+  HostHal::setPingMicros(0);
+  HostHal::clearPublished();
+  // Back to a healthy link before the benches that follow
+  while (!getLinkMonitor().isUp()) {
+    scheduler.run();
+    HostHal::advanceMicros(scheduler.untilNext() * 1000ULL);
+  }
+  HostHal::clearPublished();
+}
+
+// Runs after everything that uses unit 0, the cold replays leave it registered to a reader that is gone
+static void benchCaptureReplay() {
+  // A long synthetic capture, the temp changes every 1000 refreshes and every 500th refresh is garbled
+  const int refreshes = 200000;
+  const uint8_t garbled[] = {0x7F, 0x7F, 0xF8, 0x00, 0xED, 0xFF};
+  std::vector<uint8_t> capture(CAPTURE_HEADER_LEN + CAPTURE_RECORD_MAX * 2);
+  int len = AcManager::encodeCaptureHeader(capture.data(), 0);
+  len += AcManager::encodeCaptureTime(&capture[len], 0);
+  len += AcManager::encodeCaptureModel(&capture[len], V1_4);
+  capture.resize(len + refreshes * sizeof(FRAME_V14) * CAPTURE_RECORD_MAX);
+  for (int r = 0; r < refreshes; r++) {
+    const uint8_t* display = r % 500 == 499 ? garbled : (r / 1000) % 2 == 0 ? FRAME_V14 : FRAME_V14_73;
+    for (size_t b = 0; b < sizeof(FRAME_V14); b++) {
+      uint16_t sinceLast = b == 0 ? FRAME_GAP_MICROS + BYTE_MICROS : BYTE_MICROS;
+      len += AcManager::encodeCaptureByte(&capture[len], display[b], sinceLast);
+    }
+  }
+  capture.resize(len);
+
+  Replay::Report report;
+  Replay::replayCaptureCold(capture.data(), capture.size(), NULL, &report);
+  unsigned long parseErrors = 0;
+  for (const auto& error : report.parseErrors) {
+    parseErrors += error.second;
+  }
+  printf("%-40s %12.0f refreshes/s %12.0fx real time\n", "capture replay", report.refreshes / report.wallSeconds,
+    report.captureSeconds / report.wallSeconds);
+  printf("%-40s %12lu frames %12lu parse errors\n", "capture replay decoded", report.stats.parsedFrames, parseErrors);
+  printf("%-40s %12zu transitions %12d garbled refreshes\n", "capture replay voted", report.transitions.size(),
+    refreshes / 500);
+  HostHal::clearPublished();
+}
+
+// Runs last, see benchCaptureReplay
+static void benchEdgeReplay() {
+  // 2000 refreshes of clean edges, the temp goes from 72 to 73 half way
+  std::vector<uint8_t> edges;
+  EdgeTrace::appendHeader(&edges);
+  for (int r = 0; r < 2000; r++) {
+    const uint8_t* display = r < 1000 ? FRAME_V14 : FRAME_V14_73;
+    for (size_t b = 0; b < sizeof(FRAME_V14); b++) {
+      uint32_t gap = BYTE_MICROS - 7 * BIT_MICROS + (b == 0 ? FRAME_GAP_MICROS : 0);
+      EdgeTrace::appendByte(&edges, display[b], gap);
+    }
+  }
+  EdgeTrace::Trace trace(edges.data(), edges.size());
+
+  EdgeTrace::Report report;
+  EdgeTrace::replayEdgesCold(trace, "V1_4", EdgeTrace::NO_FAULTS, &report);
+  printf("%-40s %12lu edges %12.1f ns/edge\n", "edge replay", report.edges, report.decode.wallSeconds * 1e9 / report.edges);
+
+  // Framing only looks at gaps against UPDATE_TIME_MAX, bit edges stay within a byte until the
+  // jitter eats the margin between BYTE_MICROS and UPDATE_TIME_MAX
+  const uint32_t jitters[] = {100, 200, 300, 400};
+  for (uint32_t jitter : jitters) {
+    struct EdgeTrace::Faults faults = EdgeTrace::NO_FAULTS;
+    faults.jitterMicros = jitter;
+    EdgeTrace::replayEdgesCold(trace, "V1_4", faults, &report);
+    char name[64];
+    sprintf(name, "edge replay, %uus jitter", jitter);
+    printf("%-40s %11.2f%% decoded %8zu transitions\n", name,
+      100.0 * report.decode.stats.parsedFrames / max(report.decode.stats.parseAttempts, 1UL), report.decode.transitions.size());
+  }
+
+  // One edge in a thousand lost or doubled garbles a byte now and then, the vote keeps it out
+  struct EdgeTrace::Faults faults = EdgeTrace::NO_FAULTS;
+  faults.dropRate = 0.001;
+  faults.extraRate = 0.001;
+  EdgeTrace::replayEdgesCold(trace, "V1_4", faults, &report);
+  printf("%-40s %11.2f%% decoded %8lu dropped %8lu extra %5zu transitions\n", "edge replay, dropped and extra edges",
+    100.0 * report.decode.stats.parsedFrames / max(report.decode.stats.parseAttempts, 1UL), report.droppedEdges,
+    report.extraEdges, report.decode.transitions.size());
+  HostHal::clearPublished();
+}
+
+int main(int argc, char** argv) {
+  HostHal::reset();
+  HostHal::setMicros(1000000);
+
+  setup();
+
+  benchParseState();
+  benchClockInterrupt();
+  benchProcessAcDisplayData(false);
+  benchProcessAcDisplayData(true);
+  benchChangingDisplay();
+  benchUpdateStates();
+  benchStateFilterSweep();
+  benchModelDetection();
+  benchSendNECCode();
+  benchIrCarrier();
+  benchTempHold();
+  benchCommandPlanner();
+  benchScheduler();
+  benchLinkMonitor();
+  benchStatusLatency();
+  benchSetState();
+  benchAckPacing();
+  benchWarmRestart();
+  benchVirtualAc();
+  benchMultiUnit();
+  benchCaptureReplay();
+  benchEdgeReplay();
+
+  return 0;
+}
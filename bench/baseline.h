@@ -0,0 +1,101 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "bench.h"
+
+/**
+ * Benchmark results stored for comparing later runs against, one tab separated line per path so
+ * names can have spaces in them:
+ *
+ *   name <tab> ns/op <tab> cycles/op <tab> iterations
+ *
+ * Lines starting with # are comments. Only ns/op is compared, cycles/op is there for reading.
+ */
+namespace Bench {
+
+struct Recorded {
+  std::string name;
+  double nsPerOp;
+  double cyclesPerOp;
+  uint64_t iterations;
+};
+
+/**
+ * Results in the order they were measured, the names are copied so they can come from a buffer
+ */
+class ResultLog {
+  public:
+    void add(const Result& result) {
+      entries.push_back({result.name, result.nsPerOp, result.cyclesPerOp, result.iterations});
+    }
+    const std::vector<Recorded>& getEntries() const { return entries; }
+
+    bool write(const char* path) const {
+      FILE* out = fopen(path, "w");
+      if (out == NULL) {
+        return false;
+      }
+      fprintf(out, "# name\tns/op\tcycles/op\titerations\n");
+      for (const Recorded& entry : entries) {
+        fprintf(out, "%s\t%.2f\t%.2f\t%llu\n", entry.name.c_str(), entry.nsPerOp, entry.cyclesPerOp,
+          (unsigned long long) entry.iterations);
+      }
+      return fclose(out) == 0;
+    }
+
+  private:
+    std::vector<Recorded> entries;
+};
+
+/**
+ * Read the ns/op of every path in a results file, returns false if it couldn't be opened
+ */
+inline bool readBaseline(const char* path, std::map<std::string, double>* nsPerOp) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char* tab = strchr(line, '\t');
+    if (line[0] == '#' || tab == NULL) {
+      continue;
+    }
+    *tab = '\0';
+    (*nsPerOp)[line] = strtod(tab + 1, NULL);
+  }
+  fclose(in);
+  return true;
+}
+
+/**
+ * Print each result next to its baseline, returns how many are more than threshold (a fraction)
+ * slower. Paths the baseline doesn't have are reported but never fail
+ */
+inline int compare(const ResultLog& log, const std::map<std::string, double>& baseline, double threshold) {
+  int regressions = 0;
+  printf("%-40s %12s %12s %9s\n", "path", "ns/op", "baseline", "change");
+  for (const Recorded& entry : log.getEntries()) {
+    auto found = baseline.find(entry.name);
+    if (found == baseline.end() || found->second <= 0) {
+      printf("%-40s %12.1f %12s %9s\n", entry.name.c_str(), entry.nsPerOp, "-", "new");
+      continue;
+    }
+    double change = entry.nsPerOp / found->second - 1;
+    bool regressed = change > threshold;
+    regressions += regressed ? 1 : 0;
+    printf("%-40s %12.1f %12.1f %+8.1f%%%s\n", entry.name.c_str(), entry.nsPerOp, found->second, 100 * change,
+      regressed ? " REGRESSION" : "");
+  }
+  return regressions;
+}
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Minimal timing harness for the host benchmarks, no external dependencies so it builds anywhere
+ * the host HAL does.
+ */
+namespace Bench {
+
+// Keeps the optimizer from throwing away results that are only used for timing
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Result {
+  const char* name;
+  uint64_t iterations;
+  double nsPerOp;
+  double cyclesPerOp; // timestamp counter ticks, 0 where the counter isn't available
+};
+
+inline uint64_t cycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+inline void report(const Result& result) {
+  printf("%-40s %12llu iters %12.1f ns/op %12.1f cycles/op %14.0f ops/s\n", result.name,
+    (unsigned long long) result.iterations, result.nsPerOp, result.cyclesPerOp, 1e9 / result.nsPerOp);
+}
+
+/**
+ * Time fn() over the given number of iterations, after a short warm up pass, without reporting it
+ */
+template <typename F>
+Result measure(const char* name, uint64_t iterations, F fn) {
+  for (uint64_t i = 0; i < iterations / 10 + 1; i++) {
+    fn();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t startCycles = cycleCount();
+  for (uint64_t i = 0; i < iterations; i++) {
+    fn();
+  }
+  uint64_t endCycles = cycleCount();
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  Result result = {name, iterations, ns / iterations, (double) (endCycles - startCycles) / iterations};
+  return result;
+}
+
+/**
+ * Time fn() over the given number of iterations, after a short warm up pass
+ */
+template <typename F>
+Result run(const char* name, uint64_t iterations, F fn) {
+  Result result = measure(name, iterations, fn);
+  report(result);
+  return result;
+}
+
+/**
+ * The median of repeats measurements, steadier than one long run on a busy machine
+ */
+template <typename F>
+Result runMedian(const char* name, int repeats, uint64_t iterations, F fn) {
+  std::vector<Result> results;
+  for (int i = 0; i < repeats; i++) {
+    results.push_back(measure(name, iterations, fn));
+  }
+  std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) { return a.nsPerOp < b.nsPerOp; });
+  Result result = results[results.size() / 2];
+  report(result);
+  return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * Host stand-in for the SparkIntervalTimer library
+ *
+ * Same API as the hardware timer library used on the device. The timers run off the fake clock in
+ * host_hal.cpp, a callback fires at its deadline whenever fake time is moved past it and is held
+ * off like any other interrupt while interrupts are disabled.
+ */
+
+#ifndef SPARK_INTERVAL_TIMER_H
+#define SPARK_INTERVAL_TIMER_H
+
+#include "application.h"
+
+enum { hmSec, uSec }; // period scale, half milliseconds or microseconds
+enum action { INT_ENABLE, INT_DISABLE };
+enum TIMid { TIMER3, TIMER4, TIMER5, TIMER6, TIMER7, AUTO }; // the Photon's, AUTO takes the first free one
+
+typedef uint16_t intPeriod;
+
+class IntervalTimer {
+  public:
+    IntervalTimer() : callback(NULL), periodMicros(0), deadline(0), allocated(false), enabled(false), id(AUTO) {}
+    ~IntervalTimer() { end(); }
+
+    /**
+     * Start calling isrCallback every Period on hardware timer id, the first call is one Period
+     * from now. Returns false if that timer is taken, or with AUTO if they all are
+     */
+    bool begin(void (*isrCallback)(), intPeriod Period, bool scale, TIMid id = AUTO);
+    void end();
+
+    /**
+     * Change the period, the next call is one newPeriod from now
+     */
+    void resetPeriod_SIT(intPeriod newPeriod, bool scale);
+    void interrupt_SIT(action ACT);
+    int8_t isAllocated_SIT() { return allocated ? 1 : -1; }
+
+    // Host only, used by the fake clock to fire the callback
+    void (*callback)();
+    uint32_t periodMicros;
+    uint64_t deadline;
+    bool allocated;
+    bool enabled;
+    TIMid id; // hardware timer while allocated
+};
+
+#endif
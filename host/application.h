@@ -0,0 +1,224 @@
+/**
+ * Host stand-in for the Particle firmware application.h
+ *
+ * Provides just enough of the Wiring/Particle API for the ac_manager sources to build and run on
+ * Linux. Time, GPIO, interrupts, EEPROM and the cloud are all faked, see host_hal.h for the API
+ * used to drive and inspect them.
+ */
+
+#ifndef APPLICATION_H
+#define APPLICATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <type_traits>
+
+// Pin names, numbered the same way as the Photon
+enum {
+  D0, D1, D2, D3, D4, D5, D6, D7,
+  A0 = 10, A1, A2, A3, A4, A5, A6, A7,
+  TOTAL_PINS
+};
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define DEC 10
+#define HEX 16
+
+typedef enum PinMode {
+  INPUT,
+  OUTPUT,
+  INPUT_PULLUP,
+  INPUT_PULLDOWN
+} PinMode;
+
+typedef enum InterruptMode {
+  CHANGE,
+  RISING,
+  FALLING
+} InterruptMode;
+
+typedef enum {
+  BOOLEAN = 1,
+  INT = 2,
+  STRING = 4,
+  DOUBLE = 9
+} Spark_Data_TypeDef;
+
+/**
+ * Mixed type min/max, the firmware versions are macros so they happily compare signed and unsigned
+ * values. Templates keep the same semantics without breaking the standard library headers.
+ */
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+  return (a < b) ? a : b;
+}
+
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+  return (a > b) ? a : b;
+}
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+  return value < low ? (T) low : (value > high ? (T) high : value);
+}
+
+/**
+ * Subset of the Wiring String class backed by std::string
+ */
+class String {
+  public:
+    String() {}
+    String(const char* cstr) : str(cstr ? cstr : "") {}
+    String(const std::string& s) : str(s) {}
+    explicit String(char c) : str(1, c) {}
+    explicit String(int value, unsigned char base = DEC);
+    explicit String(unsigned int value, unsigned char base = DEC);
+    explicit String(long value, unsigned char base = DEC);
+    explicit String(unsigned long value, unsigned char base = DEC);
+    explicit String(double value, int decimalPlaces = 6);
+
+    unsigned int length() const { return str.length(); }
+    const char* c_str() const { return str.c_str(); }
+    char charAt(unsigned int index) const { return index < str.length() ? str[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool equals(const String& s) const { return str == s.str; }
+    bool operator==(const String& s) const { return str == s.str; }
+    bool operator==(const char* cstr) const { return str == (cstr ? cstr : ""); }
+    bool operator!=(const String& s) const { return str != s.str; }
+    bool operator!=(const char* cstr) const { return !(*this == cstr); }
+    bool startsWith(const String& prefix) const { return str.compare(0, prefix.str.length(), prefix.str) == 0; }
+
+    String& operator+=(const String& s) { str += s.str; return *this; }
+    String& operator+=(const char* cstr) { str += (cstr ? cstr : ""); return *this; }
+    String& operator+=(char c) { str += c; return *this; }
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs.str + rhs.str); }
+    friend String operator+(const String& lhs, const char* rhs) { return String(lhs.str + rhs); }
+
+    int indexOf(char c, unsigned int fromIndex = 0) const;
+    int indexOf(const String& s, unsigned int fromIndex = 0) const;
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+    long toInt() const { return atol(str.c_str()); }
+    float toFloat() const { return (float) atof(str.c_str()); }
+    void toCharArray(char* buf, unsigned int bufsize, unsigned int index = 0) const;
+
+  private:
+    std::string str;
+};
+
+class IPAddress {
+  public:
+    IPAddress() : address{0, 0, 0, 0} {}
+    IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) : address{b0, b1, b2, b3} {}
+    uint8_t operator[](int index) const { return address[index]; }
+    String toString() const;
+  private:
+    uint8_t address[4];
+};
+
+// Cloud
+class CloudClass {
+  public:
+    bool variable(const String& name, const void* var, Spark_Data_TypeDef type);
+    bool function(const String& name, int (*fn)(String));
+    bool publish(const String& eventName, const String& data = String());
+    bool connected();
+};
+extern CloudClass Spark;
+extern CloudClass Particle;
+
+// Time
+class TimeClass {
+  public:
+    time_t now();
+};
+extern TimeClass Time;
+
+// Emulated EEPROM, erased bytes read 0xFF like the flash backed version
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    size_t length();
+};
+extern EEPROMClass EEPROM;
+
+// Network
+class WiFiClass {
+  public:
+    int ping(IPAddress remoteIP, uint8_t nTries = 5);
+    bool ready();
+    void connect();
+    void disconnect();
+};
+extern WiFiClass WiFi;
+
+// Backup SRAM, the host process keeps every global across System.reset() so retained is a no-op
+#define retained
+
+// Runs code before setup(), from a static initializer on the host
+#define STARTUP_CONCAT(a, b) a##b
+#define STARTUP_NAME(line) STARTUP_CONCAT(startupDone, line)
+#define STARTUP(code) static bool STARTUP_NAME(__LINE__) = ((code), true)
+
+typedef enum HAL_Feature {
+  FEATURE_RETAINED_MEMORY
+} HAL_Feature;
+
+class SystemClass {
+  public:
+    void reset();
+    int enableFeature(HAL_Feature feature) { return 0; }
+};
+extern SystemClass System;
+
+// Serial output is captured in memory, see HostHal::serialOutput()
+class SerialClass {
+  public:
+    void begin(unsigned long baud) {}
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buffer, size_t size);
+    size_t print(const String& s);
+    size_t print(const char* s);
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(const IPAddress& ip);
+    size_t println();
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+    template <typename T>
+    size_t println(const T& value, int base) { return print(value, base) + println(); }
+};
+extern SerialClass Serial;
+
+// Timing
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// GPIO
+void pinMode(uint16_t pin, PinMode mode);
+int32_t digitalRead(uint16_t pin);
+void digitalWrite(uint16_t pin, uint8_t value);
+void analogWrite(uint16_t pin, uint16_t value, uint16_t frequency = 500); // PWM, value 0-255
+
+// Interrupts
+bool attachInterrupt(uint16_t pin, void (*handler)(), InterruptMode mode);
+void detachInterrupt(uint16_t pin);
+void noInterrupts();
+void interrupts();
+
+#endif
@@ -0,0 +1,745 @@
+#include "application.h"
+#include "host_hal.h"
+#include "SparkIntervalTimer.h"
+
+#include <map>
+
+CloudClass Spark;
+CloudClass Particle;
+TimeClass Time;
+EEPROMClass EEPROM;
+WiFiClass WiFi;
+SystemClass System;
+SerialClass Serial;
+
+namespace {
+
+#define EEPROM_SIZE 2047
+#define DEFAULT_EPOCH 1445000000 // Fri, 16 Oct 2015, keeps Time.now() in the same range as the device
+
+struct InterruptHandler {
+  void (*handler)();
+  InterruptMode mode;
+  bool pending; // an edge arrived while interrupts were off
+};
+
+struct PwmOutput {
+  bool running; // output is toggling, set by analogWrite with a value between 0 and 255
+  uint64_t startNanos; // fake clock time the current run started
+  uint64_t flushedNanos; // edges before this have been added to pinWrites
+  uint32_t frequency;
+  uint16_t value;
+};
+
+struct HalState {
+  uint64_t micros = 0;
+  time_t epoch = DEFAULT_EPOCH;
+  uint32_t microsPerRead = 0;
+  void (*delayCallback)(uint64_t untilMicros) = NULL;
+  bool inDelayCallback = false;
+
+  uint8_t pinLevels[TOTAL_PINS] = { 0 };
+  PinMode pinModes[TOTAL_PINS] = { INPUT };
+  bool recordWrites = false;
+  std::vector<HostHal::PinWrite> pinWrites;
+  PwmOutput pwm[TOTAL_PINS] = { };
+
+  bool interruptsEnabled = true;
+  unsigned long missedInterrupts = 0;
+  InterruptHandler handlers[TOTAL_PINS] = { };
+  std::vector<IntervalTimer*> timers; // every IntervalTimer that has been started
+  unsigned long timerCalls = 0;
+
+  uint8_t eeprom[EEPROM_SIZE];
+
+  std::vector<HostHal::PublishedEvent> published;
+  std::map<std::string, int (*)(String)> functions;
+  std::map<std::string, const void*> variables;
+  bool connected = true;
+
+  int pingSuccesses = 1;
+  uint32_t pingMicros = 0;
+  unsigned long pingCount = 0;
+  unsigned long resetCount = 0;
+  std::string serial;
+
+  HalState() {
+    memset(eeprom, 0xFF, sizeof(eeprom));
+  }
+};
+
+HalState& hal() {
+  static HalState state;
+  return state;
+}
+
+bool validPin(uint16_t pin) {
+  return pin < TOTAL_PINS;
+}
+
+void runHandler(uint16_t pin) {
+  InterruptHandler& ih = hal().handlers[pin];
+  if (!hal().interruptsEnabled) {
+    // The NVIC only latches a single pending edge, anything after that is lost
+    if (ih.pending) {
+      hal().missedInterrupts++;
+    }
+    ih.pending = true;
+    return;
+  }
+
+  hal().interruptsEnabled = false;
+  ih.handler();
+  hal().interruptsEnabled = true;
+}
+
+/**
+ * Move the fake clock forward to target, firing every timer deadline on the way in time order with
+ * the clock set to that deadline. Timers that come due while interrupts are off wait for
+ * interrupts() to turn them back on.
+ */
+void advanceClock(uint64_t target) {
+  while (hal().interruptsEnabled) {
+    IntervalTimer* next = NULL;
+    for (IntervalTimer* timer : hal().timers) {
+      if (timer->enabled && timer->deadline <= target && (next == NULL || timer->deadline < next->deadline)) {
+        next = timer;
+      }
+    }
+    if (next == NULL) {
+      break;
+    }
+
+    if (next->deadline > hal().micros) {
+      hal().micros = next->deadline;
+    }
+    // Periodic by default, resetPeriod_SIT from the callback replaces this
+    next->deadline += next->periodMicros;
+
+    hal().timerCalls++;
+    hal().interruptsEnabled = false;
+    next->callback();
+    hal().interruptsEnabled = true;
+  }
+
+  if (target > hal().micros) {
+    hal().micros = target;
+  }
+}
+
+void recordWrite(uint16_t pin, uint64_t micros, uint8_t level) {
+  if (hal().recordWrites && hal().pinLevels[pin] != level) {
+    hal().pinWrites.push_back({micros, pin, level});
+  }
+  hal().pinLevels[pin] = level;
+}
+
+/**
+ * Add the edges a running PWM output made since the last flush to pinWrites, nothing calls into
+ * the HAL while the hardware toggles the pin so they are worked out after the fact
+ */
+void flushPwm(uint16_t pin) {
+  PwmOutput& pwm = hal().pwm[pin];
+  if (!pwm.running) {
+    return;
+  }
+
+  uint64_t nowNanos = hal().micros * 1000;
+  uint64_t periodNanos = 1000000000ull / pwm.frequency;
+  uint64_t highNanos = periodNanos * pwm.value / 255;
+  uint64_t cycle = (pwm.flushedNanos - pwm.startNanos) / periodNanos;
+  while (true) {
+    uint64_t rise = pwm.startNanos + cycle * periodNanos;
+    uint64_t fall = rise + highNanos;
+    if (rise >= nowNanos) {
+      break;
+    }
+    if (rise >= pwm.flushedNanos) {
+      recordWrite(pin, rise / 1000, HIGH);
+    }
+    if (fall >= nowNanos) {
+      break;
+    }
+    recordWrite(pin, fall / 1000, LOW);
+    cycle++;
+  }
+  pwm.flushedNanos = nowNanos;
+}
+
+void stopPwm(uint16_t pin) {
+  flushPwm(pin);
+  hal().pwm[pin].running = false;
+}
+
+uint32_t scaledMicros(intPeriod period, bool scale) {
+  return scale == uSec ? period : (uint32_t) period * 500;
+}
+
+std::string formatNumber(unsigned long n, int base, bool negative) {
+  char buf[24];
+  sprintf(buf, base == HEX ? "%lX" : "%lu", n);
+  return negative ? std::string("-") + buf : std::string(buf);
+}
+
+}
+
+/*
+ * String
+ */
+String::String(int value, unsigned char base) : String((long) value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long) value, base) {}
+String::String(long value, unsigned char base) :
+  str(value < 0 && base == DEC ? formatNumber(-(unsigned long) value, base, true) : formatNumber(value, base, false)) {}
+String::String(unsigned long value, unsigned char base) : str(formatNumber(value, base, false)) {}
+
+String::String(double value, int decimalPlaces) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+  str = buf;
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const {
+  size_t pos = str.find(c, fromIndex);
+  return pos == std::string::npos ? -1 : (int) pos;
+}
+
+int String::indexOf(const String& s, unsigned int fromIndex) const {
+  size_t pos = str.find(s.str, fromIndex);
+  return pos == std::string::npos ? -1 : (int) pos;
+}
+
+String String::substring(unsigned int beginIndex) const {
+  return substring(beginIndex, str.length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+  if (beginIndex > endIndex) {
+    unsigned int tmp = beginIndex;
+    beginIndex = endIndex;
+    endIndex = tmp;
+  }
+  if (beginIndex >= str.length()) {
+    return String();
+  }
+  endIndex = min(endIndex, str.length());
+  return String(str.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::toCharArray(char* buf, unsigned int bufsize, unsigned int index) const {
+  if (bufsize == 0 || buf == NULL) {
+    return;
+  }
+  if (index >= str.length()) {
+    buf[0] = 0;
+    return;
+  }
+  size_t len = min(bufsize - 1, str.length() - index);
+  memcpy(buf, str.c_str() + index, len);
+  buf[len] = 0;
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  sprintf(buf, "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+  return String(buf);
+}
+
+/*
+ * Cloud
+ */
+bool CloudClass::variable(const String& name, const void* var, Spark_Data_TypeDef type) {
+  hal().variables[name.c_str()] = var;
+  return true;
+}
+
+bool CloudClass::function(const String& name, int (*fn)(String)) {
+  hal().functions[name.c_str()] = fn;
+  return true;
+}
+
+bool CloudClass::publish(const String& eventName, const String& data) {
+  hal().published.push_back({hal().micros, eventName.c_str(), data.c_str()});
+  return hal().connected;
+}
+
+bool CloudClass::connected() {
+  return hal().connected;
+}
+
+/*
+ * Time
+ */
+time_t TimeClass::now() {
+  return hal().epoch + (time_t) (hal().micros / 1000000);
+}
+
+unsigned long micros() {
+  unsigned long now = (uint32_t) hal().micros;
+  if (hal().microsPerRead > 0) {
+    advanceClock(hal().micros + hal().microsPerRead);
+  }
+  return now;
+}
+
+unsigned long millis() {
+  return (uint32_t) (hal().micros / 1000);
+}
+
+void delay(unsigned long ms) {
+  uint64_t target = hal().micros + (uint64_t) ms * 1000;
+  if (hal().delayCallback != NULL && !hal().inDelayCallback) {
+    hal().inDelayCallback = true;
+    hal().delayCallback(target);
+    hal().inDelayCallback = false;
+  }
+  advanceClock(target);
+}
+
+void delayMicroseconds(unsigned int us) {
+  advanceClock(hal().micros + us);
+}
+
+/*
+ * GPIO
+ */
+void pinMode(uint16_t pin, PinMode mode) {
+  if (validPin(pin)) {
+    hal().pinModes[pin] = mode;
+  }
+}
+
+int32_t digitalRead(uint16_t pin) {
+  return validPin(pin) ? hal().pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint16_t pin, uint8_t value) {
+  if (!validPin(pin)) {
+    return;
+  }
+  stopPwm(pin);
+  recordWrite(pin, hal().micros, value ? HIGH : LOW);
+}
+
+void analogWrite(uint16_t pin, uint16_t value, uint16_t frequency) {
+  if (!validPin(pin)) {
+    return;
+  }
+  stopPwm(pin);
+
+  PwmOutput& pwm = hal().pwm[pin];
+  pwm.value = value;
+  pwm.frequency = frequency;
+  if (value == 0 || value >= 255 || frequency == 0) {
+    recordWrite(pin, hal().micros, value == 0 || frequency == 0 ? LOW : HIGH);
+    return;
+  }
+
+  // Each run starts at the beginning of a period, with the output high
+  pwm.running = true;
+  pwm.startNanos = hal().micros * 1000;
+  pwm.flushedNanos = pwm.startNanos;
+}
+
+/*
+ * Interrupts
+ */
+bool attachInterrupt(uint16_t pin, void (*handler)(), InterruptMode mode) {
+  if (!validPin(pin)) {
+    return false;
+  }
+  hal().handlers[pin] = {handler, mode, false};
+  return true;
+}
+
+void detachInterrupt(uint16_t pin) {
+  if (validPin(pin)) {
+    hal().handlers[pin] = {NULL, CHANGE, false};
+  }
+}
+
+void noInterrupts() {
+  hal().interruptsEnabled = false;
+}
+
+void interrupts() {
+  hal().interruptsEnabled = true;
+
+  // Service anything that was latched while interrupts were off
+  for (int pin = 0; pin < TOTAL_PINS; pin++) {
+    InterruptHandler& ih = hal().handlers[pin];
+    if (ih.pending && ih.handler != NULL) {
+      ih.pending = false;
+      runHandler(pin);
+    }
+  }
+  advanceClock(hal().micros);
+}
+
+/*
+ * Hardware timers
+ */
+bool IntervalTimer::begin(void (*isrCallback)(), intPeriod Period, bool scale, TIMid id) {
+  if (!allocated) {
+    // Take the hardware timer asked for or the first free one, like the library
+    TIMid want = id;
+    for (int t = TIMER3; want == AUTO && t < AUTO; t++) {
+      want = HostHal::isTimerAllocated((TIMid) t) ? AUTO : (TIMid) t;
+    }
+    if (want == AUTO || HostHal::isTimerAllocated(want)) {
+      return false;
+    }
+    this->id = want;
+  }
+  callback = isrCallback;
+  periodMicros = scaledMicros(Period, scale);
+  deadline = hal().micros + periodMicros;
+  enabled = true;
+  if (!allocated) {
+    allocated = true;
+    hal().timers.push_back(this);
+  }
+  return true;
+}
+
+void IntervalTimer::end() {
+  enabled = false;
+  if (allocated) {
+    allocated = false;
+    id = AUTO;
+    std::vector<IntervalTimer*>& timers = hal().timers;
+    for (size_t i = 0; i < timers.size(); i++) {
+      if (timers[i] == this) {
+        timers.erase(timers.begin() + i);
+        break;
+      }
+    }
+  }
+}
+
+void IntervalTimer::resetPeriod_SIT(intPeriod newPeriod, bool scale) {
+  periodMicros = scaledMicros(newPeriod, scale);
+  deadline = hal().micros + periodMicros;
+}
+
+void IntervalTimer::interrupt_SIT(action ACT) {
+  enabled = allocated && ACT == INT_ENABLE;
+}
+
+/*
+ * EEPROM
+ */
+uint8_t EEPROMClass::read(int address) {
+  return (address >= 0 && address < EEPROM_SIZE) ? hal().eeprom[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address >= 0 && address < EEPROM_SIZE) {
+    hal().eeprom[address] = value;
+  }
+}
+
+size_t EEPROMClass::length() {
+  return EEPROM_SIZE;
+}
+
+/*
+ * Network and system
+ */
+int WiFiClass::ping(IPAddress remoteIP, uint8_t nTries) {
+  hal().pingCount++;
+  advanceClock(hal().micros + (uint64_t) hal().pingMicros * nTries);
+  return min(hal().pingSuccesses, (int) nTries);
+}
+
+bool WiFiClass::ready() {
+  return hal().connected;
+}
+
+void WiFiClass::connect() {
+  hal().connected = true;
+}
+
+void WiFiClass::disconnect() {
+  hal().connected = false;
+}
+
+void SystemClass::reset() {
+  hal().resetCount++;
+}
+
+size_t SerialClass::write(uint8_t b) {
+  hal().serial += (char) b;
+  return 1;
+}
+
+size_t SerialClass::write(const uint8_t* buffer, size_t size) {
+  hal().serial.append((const char*) buffer, size);
+  return size;
+}
+
+size_t SerialClass::print(const String& s) {
+  hal().serial += s.c_str();
+  return s.length();
+}
+
+size_t SerialClass::print(const char* s) {
+  return print(String(s));
+}
+
+size_t SerialClass::print(char c) {
+  return write((uint8_t) c);
+}
+
+size_t SerialClass::print(int n, int base) {
+  return print(String((long) n, (unsigned char) base));
+}
+
+size_t SerialClass::print(unsigned int n, int base) {
+  return print(String((unsigned long) n, (unsigned char) base));
+}
+
+size_t SerialClass::print(long n, int base) {
+  return print(String(n, (unsigned char) base));
+}
+
+size_t SerialClass::print(unsigned long n, int base) {
+  return print(String(n, (unsigned char) base));
+}
+
+size_t SerialClass::print(const IPAddress& ip) {
+  return print(ip.toString());
+}
+
+size_t SerialClass::println() {
+  return print("\r\n");
+}
+
+/*
+ * Host controls
+ */
+namespace HostHal {
+
+void reset() {
+  HalState& state = hal();
+  state.micros = 0;
+  state.epoch = DEFAULT_EPOCH;
+  state.microsPerRead = 0;
+  state.delayCallback = NULL;
+  memset(state.pinLevels, 0, sizeof(state.pinLevels));
+  memset(state.pwm, 0, sizeof(state.pwm));
+  state.recordWrites = false;
+  state.pinWrites.clear();
+  state.interruptsEnabled = true;
+  state.missedInterrupts = 0;
+  for (int pin = 0; pin < TOTAL_PINS; pin++) {
+    state.handlers[pin].pending = false;
+  }
+  for (IntervalTimer* timer : state.timers) {
+    timer->deadline = timer->periodMicros;
+  }
+  state.timerCalls = 0;
+  memset(state.eeprom, 0xFF, sizeof(state.eeprom));
+  state.published.clear();
+  state.connected = true;
+  state.pingSuccesses = 1;
+  state.pingMicros = 0;
+  state.pingCount = 0;
+  state.resetCount = 0;
+  state.serial.clear();
+}
+
+uint64_t nowMicros() {
+  return hal().micros;
+}
+
+void setMicros(uint64_t micros) {
+  if (micros >= hal().micros) {
+    advanceClock(micros);
+  } else {
+    hal().micros = micros;
+  }
+}
+
+void advanceMicros(uint64_t micros) {
+  advanceClock(hal().micros + micros);
+}
+
+void setEpoch(time_t seconds) {
+  hal().epoch = seconds;
+}
+
+void setMicrosPerRead(uint32_t step) {
+  hal().microsPerRead = step;
+}
+
+void setDelayCallback(void (*callback)(uint64_t untilMicros)) {
+  hal().delayCallback = callback;
+}
+
+void setPin(uint16_t pin, int level) {
+  if (!validPin(pin)) {
+    return;
+  }
+  uint8_t previous = hal().pinLevels[pin];
+  uint8_t next = level ? HIGH : LOW;
+  hal().pinLevels[pin] = next;
+
+  InterruptHandler& ih = hal().handlers[pin];
+  if (previous == next || ih.handler == NULL) {
+    return;
+  }
+  if (ih.mode == CHANGE || (ih.mode == RISING && next == HIGH) || (ih.mode == FALLING && next == LOW)) {
+    runHandler(pin);
+  }
+}
+
+int pinLevel(uint16_t pin) {
+  return digitalRead(pin);
+}
+
+PinMode pinModeOf(uint16_t pin) {
+  return validPin(pin) ? hal().pinModes[pin] : INPUT;
+}
+
+void recordPinWrites(bool enabled) {
+  hal().recordWrites = enabled;
+}
+
+const std::vector<PinWrite>& pinWrites() {
+  for (int pin = 0; pin < TOTAL_PINS; pin++) {
+    flushPwm(pin);
+  }
+  return hal().pinWrites;
+}
+
+uint16_t pwmValue(uint16_t pin) {
+  return validPin(pin) && hal().pwm[pin].running ? hal().pwm[pin].value : 0;
+}
+
+uint32_t pwmFrequency(uint16_t pin) {
+  return validPin(pin) && hal().pwm[pin].running ? hal().pwm[pin].frequency : 0;
+}
+
+void clearPinWrites() {
+  hal().pinWrites.clear();
+}
+
+void clockInByte(uint16_t clockPin, uint16_t dataPin, uint8_t value, uint32_t bitMicros) {
+  uint32_t halfBit = bitMicros / 2;
+  for (int i = 7; i >= 0; i--) {
+    setPin(dataPin, (value >> i) & 1);
+    advanceMicros(halfBit);
+    setPin(clockPin, HIGH);
+    advanceMicros(bitMicros - halfBit);
+    setPin(clockPin, LOW);
+  }
+}
+
+bool triggerInterrupt(uint16_t pin) {
+  if (!validPin(pin) || hal().handlers[pin].handler == NULL) {
+    return false;
+  }
+  bool enabled = hal().interruptsEnabled;
+  runHandler(pin);
+  return enabled;
+}
+
+bool interruptsEnabled() {
+  return hal().interruptsEnabled;
+}
+
+unsigned long missedInterrupts() {
+  return hal().missedInterrupts;
+}
+
+int activeTimers() {
+  int active = 0;
+  for (IntervalTimer* timer : hal().timers) {
+    if (timer->enabled) {
+      active++;
+    }
+  }
+  return active;
+}
+
+bool isTimerAllocated(TIMid id) {
+  for (IntervalTimer* timer : hal().timers) {
+    if (timer->id == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+unsigned long timerCalls() {
+  return hal().timerCalls;
+}
+
+uint8_t* eeprom() {
+  return hal().eeprom;
+}
+
+size_t eepromSize() {
+  return EEPROM_SIZE;
+}
+
+const std::vector<PublishedEvent>& published() {
+  return hal().published;
+}
+
+void clearPublished() {
+  hal().published.clear();
+}
+
+size_t publishCount(const std::string& name) {
+  size_t count = 0;
+  for (const PublishedEvent& event : hal().published) {
+    if (event.name == name) {
+      count++;
+    }
+  }
+  return count;
+}
+
+int callFunction(const std::string& name, const String& arg) {
+  auto fn = hal().functions.find(name);
+  if (fn == hal().functions.end()) {
+    return -1;
+  }
+  return fn->second(arg);
+}
+
+const void* variable(const std::string& name) {
+  auto var = hal().variables.find(name);
+  return var == hal().variables.end() ? NULL : var->second;
+}
+
+void setConnected(bool connected) {
+  hal().connected = connected;
+}
+
+void setPingSuccesses(int successes) {
+  hal().pingSuccesses = successes;
+}
+
+void setPingMicros(uint32_t micros) {
+  hal().pingMicros = micros;
+}
+
+unsigned long pingCount() {
+  return hal().pingCount;
+}
+
+unsigned long resetCount() {
+  return hal().resetCount;
+}
+
+const std::string& serialOutput() {
+  return hal().serial;
+}
+
+void clearSerialOutput() {
+  hal().serial.clear();
+}
+
+}
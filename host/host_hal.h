@@ -0,0 +1,93 @@
+#include "application.h"
+#include "SparkIntervalTimer.h"
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Controls for the fake Particle HAL used by the host build
+ *
+ * All time is simulated: micros(), millis() and Time.now() read a fake clock that only moves when
+ * advanced here or by delay()/delayMicroseconds(). Nothing ever really sleeps. IntervalTimer
+ * callbacks fire at their deadlines as the clock is moved forward past them.
+ */
+namespace HostHal {
+
+struct PinWrite {
+  uint64_t micros; // fake clock time of the write
+  uint16_t pin;
+  uint8_t level;
+};
+
+struct PublishedEvent {
+  uint64_t micros; // fake clock time of the publish
+  std::string name;
+  std::string data;
+};
+
+/**
+ * Restore every fake peripheral to its power-on state. Registered cloud variables, functions and
+ * interrupt handlers are kept since the code under test registers them once during init.
+ */
+void reset();
+
+// Fake clock
+uint64_t nowMicros();
+void setMicros(uint64_t micros);
+void advanceMicros(uint64_t micros);
+void setEpoch(time_t seconds); // Time.now() value when the fake clock reads 0
+void setMicrosPerRead(uint32_t step); // auto-advance on every micros() read, lets spin loops finish
+// Called at the start of every delay() with the time it sleeps until, lets a bench keep driving
+// inputs while the code under test sleeps. NULL to stop, reset() clears it
+void setDelayCallback(void (*callback)(uint64_t untilMicros));
+
+// GPIO
+void setPin(uint16_t pin, int level); // drive an input, fires any interrupt attached to the edge
+int pinLevel(uint16_t pin);
+PinMode pinModeOf(uint16_t pin);
+void recordPinWrites(bool enabled); // off by default, the IR carrier generates a lot of edges
+const std::vector<PinWrite>& pinWrites(); // includes the edges of running analogWrite outputs
+uint16_t pwmValue(uint16_t pin); // analogWrite value of a running PWM output, 0 if not running
+uint32_t pwmFrequency(uint16_t pin);
+void clearPinWrites();
+
+// Clock a byte MSB first into a shift register style reader, the data pin is set before each
+// rising edge of the clock pin and every bit takes bitMicros of fake time
+void clockInByte(uint16_t clockPin, uint16_t dataPin, uint8_t value, uint32_t bitMicros);
+
+// Interrupts
+bool triggerInterrupt(uint16_t pin); // run the attached ISR, false if masked or not attached
+bool interruptsEnabled();
+unsigned long missedInterrupts(); // edges dropped while interrupts were off
+
+// Hardware timers, see SparkIntervalTimer.h
+int activeTimers(); // IntervalTimers currently started and enabled
+bool isTimerAllocated(TIMid id); // some IntervalTimer holds hardware timer id
+unsigned long timerCalls(); // timer callbacks fired since reset()
+
+// EEPROM
+uint8_t* eeprom();
+size_t eepromSize();
+
+// Cloud
+const std::vector<PublishedEvent>& published();
+void clearPublished();
+size_t publishCount(const std::string& name);
+int callFunction(const std::string& name, const String& arg);
+const void* variable(const std::string& name);
+void setConnected(bool connected);
+
+// Network and system
+void setPingSuccesses(int successes); // returned by WiFi.ping(), capped by nTries
+void setPingMicros(uint32_t micros); // fake clock time each ping try blocks for
+unsigned long pingCount();
+unsigned long resetCount(); // times System.reset() was called
+const std::string& serialOutput();
+void clearSerialOutput();
+
+}
+
+#endif
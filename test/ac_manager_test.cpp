@@ -0,0 +1,1091 @@
+/**
+ * Host tests for ac_manager, run through the fake HAL
+ *
+ *   ac_manager_test [group...]
+ *
+ * Every group starts from a fresh setup() when ctest runs it in its own process, running several
+ * groups in one process works as long as the cold replays (capture, edge_trace) come last.
+ */
+
+#include "application.h"
+#include "host_hal.h"
+#include "ac_parser.h"
+#include "ac_display_reader.h"
+#include "ac_display_reader_p.h"
+#include "ac_ir_controller.h"
+#include "ac_ir_controller_p.h"
+#include "ac_ir_carrier.h"
+#include "ac_ir_measurement.h"
+#include "ac_link_monitor.h"
+#include "ac_manager.h"
+#include "ac_state_controller.h"
+#include "ac_warm_state.h"
+#include "wifi_keepalive.h"
+
+extern AcManager::DisplayReader displayReaders[];
+extern AcManager::IrTransmitter irTransmitters[];
+extern AcManager::StateController stateControllers[];
+extern AcManager::Scheduler scheduler;
+extern struct WarmState warmState;
+#include "test.h"
+#include "capture_replay.h"
+#include "edge_trace.h"
+#include "convergence.h"
+
+// Unit 0, set up by setup() like on the device
+static AcManager::DisplayReader& reader = displayReaders[0];
+static AcManager::IrTransmitter& transmitter = irTransmitters[0];
+static AcManager::StateController& stateController = stateControllers[0];
+
+#define BIT_MICROS 4 // time the AC controller takes to clock one bit into the register
+#define BYTE_MICROS 1000 // time between the start of each byte, must be over UPDATE_TIME_MAX
+#define FRAME_GAP_MICROS 5000 // extra quiet time between display refreshes, must be over FRAME_GAP_MIN
+
+// A valid 72 degree, cool, auto fan display frame for each model, and 73 degrees on V1_4
+static const uint8_t FRAME_V12[] = {0xFF, 0xF8, 0xA4, 0xDE, 0xEE};
+static const uint8_t FRAME_V14[] = {0x7F, 0x7F, 0xF8, 0xA4, 0xED, 0xFF};
+static const uint8_t FRAME_V18[] = {0xFF, 0xFF, 0xBC, 0xA2, 0xFB, 0xF7};
+static const uint8_t FRAME_V14_73[] = {0x7F, 0x7F, 0xF8, 0xB0, 0xED, 0xFF};
+
+static const char* MODEL_NAMES[] = {"V1_2", "V1_4", "V1_8"};
+
+static void clockInFrame(int clockPin, int inputPin, const uint8_t frame[], int frameLen) {
+  HostHal::advanceMicros(FRAME_GAP_MICROS);
+  for (int b = 0; b < frameLen; b++) {
+    uint64_t start = HostHal::nowMicros();
+    HostHal::clockInByte(clockPin, inputPin, frame[b], BIT_MICROS);
+    HostHal::setMicros(start + BYTE_MICROS);
+  }
+}
+
+static void clockInFrame(const uint8_t frame[], int frameLen) {
+  clockInFrame(AC_DISPLAY_READER_CONFIG_DEFAULTS.clockPin, AC_DISPLAY_READER_CONFIG_DEFAULTS.inputPin, frame, frameLen);
+}
+
+static void drainIrQueue() {
+  while (!transmitter.isIdle()) {
+    HostHal::advanceMicros(1000);
+  }
+}
+
+/**
+ * setState and run loop() against the virtual unit until the request ends, true if it is done
+ */
+static bool converge(VirtualAc* ac, const char* command) {
+  Convergence::activeAc = ac;
+  HostHal::setDelayCallback(Convergence::runActiveAc);
+  HostHal::clearPublished();
+  setState(command);
+  while (!Convergence::isFinished()) {
+    loop();
+  }
+  bool done = HostHal::publishCount("SET_STATE_DONE") > 0;
+  HostHal::setDelayCallback(NULL);
+  HostHal::clearPublished();
+  Convergence::activeAc = NULL;
+  return done;
+}
+
+TEST(ir, carrier_matches_waveform) {
+  // One frame with each carrier, measured off the LED pin
+  const int pins[] = {D6, D3};
+  for (int pin : pins) {
+    transmitter.init(0, "sendNEC", pin);
+    HostHal::recordPinWrites(true);
+    HostHal::clearPinWrites();
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+    drainIrQueue();
+
+    AcManager::IrMeasurement measurement(Carrier_Frequency);
+    for (const HostHal::PinWrite& write : HostHal::pinWrites()) {
+      if (write.pin == pin) {
+        measurement.addEdge(write.micros, write.level == HIGH);
+      }
+    }
+    HostHal::recordPinWrites(false);
+    HostHal::clearPinWrites();
+
+    const struct IrWaveform* waveform = getIrWaveform(AC_CMD_TEMP_TIMER_U);
+    struct AcManager::IrMeasurementReport report;
+    CHECK(measurement.compare(waveform->micros, waveform->length, &report));
+    CHECK_EQ(report.marks, report.expectedMarks);
+  }
+  transmitter.init(0, "sendNEC", D6);
+}
+
+TEST(ir, unit_timers) {
+  // Units 1 and 2 carry on TIM3's PWM, so no transmitter's IntervalTimer may take TIM3
+  CHECK_EQ(AcManager::pwmTimer(A4), 3);
+  CHECK_EQ(AcManager::pwmTimer(A5), 3);
+  CHECK_EQ(AcManager::pwmTimer(D6), 0);
+
+  static AcManager::IrTransmitter units[2];
+  units[0].init(1, "sendNEC", A4);
+  units[1].init(2, "sendNEC", A5);
+  CHECK(!transmitter.hasPwmCarrier());
+  CHECK(units[0].hasPwmCarrier());
+  CHECK(units[1].hasPwmCarrier());
+
+  transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  units[0].sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  units[1].sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  CHECK(HostHal::isTimerAllocated(TIMER7));
+  CHECK(HostHal::isTimerAllocated(TIMER6));
+  CHECK(HostHal::isTimerAllocated(TIMER5));
+  CHECK(!HostHal::isTimerAllocated(TIMER3));
+  while (!transmitter.isIdle() || !units[0].isIdle() || !units[1].isIdle()) {
+    HostHal::advanceMicros(1000);
+  }
+}
+
+TEST(ir, frame_across_micros_wrap) {
+  // micros() wraps every 71 minutes, a frame that starts just before must still go out on time
+  HostHal::setMicros(0x100000000ULL - 30000);
+  HostHal::recordPinWrites(true);
+  HostHal::clearPinWrites();
+  uint64_t start = HostHal::nowMicros();
+  transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  while (!transmitter.isIdle() && HostHal::nowMicros() - start < 1000000) {
+    HostHal::advanceMicros(1000);
+  }
+  CHECK(transmitter.isIdle());
+
+  AcManager::IrMeasurement measurement(Carrier_Frequency);
+  for (const HostHal::PinWrite& write : HostHal::pinWrites()) {
+    if (write.pin == D6) {
+      measurement.addEdge(write.micros, write.level == HIGH);
+    }
+  }
+  HostHal::recordPinWrites(false);
+  HostHal::clearPinWrites();
+  const struct IrWaveform* waveform = getIrWaveform(AC_CMD_TEMP_TIMER_U);
+  struct AcManager::IrMeasurementReport report;
+  CHECK(measurement.compare(waveform->micros, waveform->length, &report));
+}
+
+TEST(ir, display_while_sending) {
+  // The display keeps clocking in while frames go out, none of its edges may be lost
+  setAcModel("V1_4");
+  unsigned long missedBefore = HostHal::missedInterrupts();
+  for (int i = 0; i < 4; i++) {
+    transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+  }
+  while (!transmitter.isIdle()) {
+    clockInFrame(FRAME_V14, sizeof(FRAME_V14));
+    reader.processDisplayData();
+  }
+  CHECK_EQ(HostHal::missedInterrupts() - missedBefore, 0);
+  CHECK_EQ(reader.getTemp(), 72);
+  HostHal::clearPublished();
+}
+
+TEST(warm_state, restart) {
+  struct VirtualAcConfig config = VIRTUAL_AC_DEFAULTS;
+  VirtualAc ac(config);
+  Convergence::warmUp(&ac, "V1_4");
+  CHECK(converge(&ac, "72,MODE_COOL,FAN_AUTO"));
+  CHECK(converge(&ac, "75,MODE_COOL,FAN_HIGH"));
+  CHECK(isWarmStateValid());
+
+  // A controller booting after the reset picks up what was learned
+  static AcManager::StateController restarted;
+  restarted.init(&reader, &transmitter, "pacing");
+  CHECK(stateController.getPacing(V1_4).getSamples() > 0);
+  CHECK_EQ(restarted.getPacing(V1_4).getSamples(), stateController.getPacing(V1_4).getSamples());
+
+  // Boot with the unit still showing the saved state, it is served before any frame is voted on
+  Convergence::activeAc = &ac;
+  HostHal::setDelayCallback(Convergence::runActiveAc);
+  reader.lockAcModel(V1_4);
+  reader.restoreWarmAcState();
+  CHECK(reader.isAcStateProvisional());
+  CHECK_EQ(reader.getTemp(), 75);
+  while (reader.isAcStateProvisional()) {
+    loop();
+  }
+  CHECK_EQ(HostHal::publishCount("STATUS_CHANGE"), 0);
+
+  // The AC was off at the reset but someone turned it on since, OFF must not finish on the saved state
+  saveWarmDisplay(0, V1_4, AcState(0, 72, 0, FAN_OFF, MODE_OFF, false).display);
+  reader.lockAcModel(V1_4);
+  reader.restoreWarmAcState();
+  setState("OFF");
+  while (transmitter.isIdle() && stateController.isBusy()) {
+    loop();
+  }
+  CHECK(!transmitter.isIdle());
+  while (stateController.isBusy()) {
+    loop();
+  }
+  CHECK_EQ(ac.getState().getMode(), MODE_OFF);
+  HostHal::setDelayCallback(NULL);
+  Convergence::activeAc = NULL;
+
+  // Garbage in backup SRAM after a power cut is never served
+  warmState.units[0].display ^= 1;
+  CHECK(!isWarmStateValid());
+  HostHal::clearPublished();
+}
+
+// Extra units, unit 0 is the one setup() wires to the default pins
+static AcManager::DisplayReader extraReaders[AC_UNITS_MAX - 1];
+static const int EXTRA_CLOCK_PINS[AC_UNITS_MAX - 1] = {D4, D5};
+static const int EXTRA_INPUT_PINS[AC_UNITS_MAX - 1] = {D3, A2};
+
+TEST(multi_unit, independent_units) {
+  for (int i = 0; i < AC_UNITS_MAX - 1; i++) {
+    struct AcDisplayReaderConfig config = AC_DISPLAY_READER_CONFIG_DEFAULTS;
+    config.clockPin = EXTRA_CLOCK_PINS[i];
+    config.inputPin = EXTRA_INPUT_PINS[i];
+    config.statusVar = config.statusVar + String(i + 1);
+    config.dataVar = config.dataVar + String(i + 1);
+    extraReaders[i].init(i + 1, config, &scheduler);
+  }
+
+  // Unit 1 is a V1_8 and unit 2 a V1_2 next to unit 0's V1_4
+  setAcModel("V1_4");
+  setAcModel("1:V1_8");
+  setAcModel("2:V1_2");
+  for (int frame = 0; frame < 8; frame++) {
+    clockInFrame(EXTRA_CLOCK_PINS[0], EXTRA_INPUT_PINS[0], FRAME_V18, sizeof(FRAME_V18));
+    clockInFrame(EXTRA_CLOCK_PINS[1], EXTRA_INPUT_PINS[1], FRAME_V12, sizeof(FRAME_V12));
+    for (int i = 0; i < AC_UNITS_MAX - 1; i++) {
+      extraReaders[i].processDisplayData();
+    }
+  }
+  CHECK_EQ(extraReaders[0].getTemp(), 72);
+  CHECK_EQ(extraReaders[1].getTemp(), 72);
+  CHECK_EQ(reader.getAcModel(), V1_4);
+  CHECK(strstr((const char*) HostHal::variable("status1"), "\"unit\":1") != NULL);
+  CHECK_EQ(setState("1:72,MODE_COOL,FAN_AUTO"), 7);
+  HostHal::clearPublished();
+}
+
+TEST(display, parse_new_refreshes_once) {
+  // Two refreshes finish between passes, only they are parsed and the older ones in the buffer aren't.
+  // The last byte of a refresh is pushed when the next one starts, so the one before them finishes
+  // here and the second one clocked in doesn't
+  setAcModel("V1_4");
+  for (int i = 0; i < BUFFER_LEN / (int) sizeof(FRAME_V14) + 1; i++) {
+    clockInFrame(FRAME_V14, sizeof(FRAME_V14));
+  }
+  reader.processDisplayData();
+  struct AcDisplayReaderStats before = reader.getStats();
+  clockInFrame(FRAME_V14_73, sizeof(FRAME_V14_73));
+  clockInFrame(FRAME_V14_73, sizeof(FRAME_V14_73));
+  reader.processDisplayData();
+  struct AcDisplayReaderStats after = reader.getStats();
+  CHECK_EQ(after.parseAttempts - before.parseAttempts, 2);
+  CHECK_EQ(after.parsedFrames - before.parsedFrames, 2);
+
+  // A pass with nothing new parses nothing
+  reader.processDisplayData();
+  CHECK_EQ(reader.getStats().parseAttempts, after.parseAttempts);
+
+  // A display that changes every refresh is parsed once per refresh
+  for (int i = 0; i < 10; i++) {
+    clockInFrame(i % 2 == 0 ? FRAME_V14 : FRAME_V14_73, sizeof(FRAME_V14));
+    reader.processDisplayData();
+  }
+  CHECK_EQ(reader.getStats().parseAttempts - after.parseAttempts, 10);
+  HostHal::clearPublished();
+}
+
+TEST(display, filter_counts_refreshes) {
+  // Each refresh is one vote, so a new state takes quorum refreshes to win whatever the window
+  const char* filters[] = {"5,3", "10,6", "20,11", "30,16"};
+  const int quorums[] = {3, 6, 11, 16};
+  setAcModel("V1_4");
+  for (int f = 0; f < 4; f++) {
+    CHECK(reader.setStateFilter(filters[f]) > 0);
+    for (int i = 0; i < AcManager::StateFilter::MAX_WINDOW + 1; i++) {
+      clockInFrame(FRAME_V14, sizeof(FRAME_V14));
+      reader.processDisplayData();
+    }
+    CHECK_EQ(reader.getTemp(), 72);
+
+    // A refresh finishes when the next one starts, the first 73 clocked in finishes the last 72
+    int refreshes = -1;
+    while (reader.getTemp() != 73 && refreshes < AcManager::StateFilter::MAX_WINDOW) {
+      clockInFrame(FRAME_V14_73, sizeof(FRAME_V14_73));
+      reader.processDisplayData();
+      refreshes++;
+    }
+    CHECK_EQ(refreshes, quorums[f]);
+  }
+  reader.setStateFilter(String(AC_STATES_LEN) + "," + String(AC_STATES_QUORUM));
+  HostHal::clearPublished();
+}
+
+/**
+ * States whose probe runs start at slot, the first count found counting up from from
+ */
+static void collidingStates(int slot, uint32_t from, uint32_t dest[], int count) {
+  for (uint32_t packed = from; count > 0; packed++) {
+    if (AcManager::StateFilter::home(packed) == slot) {
+      *dest++ = packed;
+      count--;
+    }
+  }
+}
+
+TEST(filter, evicts_colliding_states) {
+  // Three states share the last slot so their run wraps around the table end, a fourth starts at
+  // slot 0 and is pushed past them. Evicting each of them shifts the rest back along the run
+  const int last = AcManager::StateFilter::TABLE_SIZE - 1;
+  uint32_t wrapped[3];
+  uint32_t first[1];
+  collidingStates(last, 1, wrapped, 3);
+  collidingStates(0, 1, first, 1);
+  const uint32_t other = wrapped[2] + 1;
+  CHECK(AcManager::StateFilter::home(other) != last && AcManager::StateFilter::home(other) != 0);
+
+  AcManager::StateFilter filter(4, 2);
+  uint32_t winner;
+  filter.add(wrapped[0], &winner);
+  filter.add(wrapped[1], &winner);
+  filter.add(wrapped[2], &winner);
+  filter.add(first[0], &winner);
+  CHECK_EQ(filter.countOf(wrapped[0]), 1);
+  CHECK_EQ(filter.countOf(first[0]), 1);
+
+  // Each add evicts the oldest, the states still in the window keep their counts
+  const uint32_t* window[] = {wrapped, wrapped + 1, wrapped + 2, first};
+  for (int evicted = 0; evicted < 4; evicted++) {
+    filter.add(other, &winner);
+    CHECK_EQ(filter.countOf(*window[evicted]), 0);
+    for (int i = evicted + 1; i < 4; i++) {
+      CHECK_EQ(filter.countOf(*window[i]), 1);
+    }
+  }
+  CHECK_EQ(filter.countOf(other), 4);
+  CHECK(filter.add(other, &winner));
+  CHECK_EQ(winner, other);
+}
+
+TEST(filter, quorum_boundary) {
+  AcManager::StateFilter filter(5, 3);
+  uint32_t winner = 0;
+  CHECK(!filter.add(1, &winner));
+  CHECK(!filter.add(1, &winner));
+  CHECK(filter.add(1, &winner));
+  CHECK_EQ(winner, 1);
+
+  // A newer state with one short of quorum doesn't take over, the one that reaches it does
+  CHECK(filter.add(2, &winner));
+  CHECK(filter.add(2, &winner));
+  CHECK_EQ(winner, 1);
+  CHECK(filter.add(2, &winner));
+  CHECK_EQ(winner, 2);
+
+  // The winner is dropped once eviction takes it under quorum and nothing else has it
+  CHECK(filter.configure(4, 3));
+  filter.add(1, &winner);
+  filter.add(1, &winner);
+  CHECK(filter.add(1, &winner));
+  CHECK(filter.add(2, &winner));
+  CHECK_EQ(winner, 1);
+  CHECK(!filter.add(2, &winner));
+  CHECK(filter.add(2, &winner));
+  CHECK_EQ(winner, 2);
+
+  CHECK(!filter.configure(4, 5));
+  CHECK(!filter.configure(4, 0));
+  CHECK(!filter.configure(AcManager::StateFilter::MAX_WINDOW + 1, 1));
+  CHECK_EQ(filter.getWindow(), 4);
+  CHECK_EQ(filter.getQuorum(), 3);
+}
+
+TEST(filter, matches_recount) {
+  // Every window size with a quorum of one, about half and all of it, against counting the window
+  // over again. States come from a few neighbouring slots so they collide and wrap
+  const int slots[] = {AcManager::StateFilter::TABLE_SIZE - 2, AcManager::StateFilter::TABLE_SIZE - 1, 0, 1};
+  const int perSlot = 10;
+  uint32_t states[4 * perSlot];
+  for (int s = 0; s < 4; s++) {
+    collidingStates(slots[s], 1, &states[s * perSlot], perSlot);
+  }
+
+  uint32_t random = 1;
+  for (int window = 1; window <= AcManager::StateFilter::MAX_WINDOW; window++) {
+    const int quorums[] = {1, window / 2 + 1, window};
+    for (int quorum : quorums) {
+      AcManager::StateFilter filter(window, quorum);
+      CHECK_EQ(filter.getWindow(), window);
+      std::vector<uint32_t> added;
+      bool hadWinner = false;
+      uint32_t lastWinner = 0;
+      for (int i = 0; i < 4 * AcManager::StateFilter::MAX_WINDOW; i++) {
+        random = random * 1103515245 + 12345;
+        // Mostly a few states so some reach quorum, the rest spread over all of them
+        int pick = (random >> 16) % 8 < 5 ? (random >> 20) % 3 : (random >> 20) % (4 * perSlot);
+        uint32_t packed = states[pick];
+        added.push_back(packed);
+        uint32_t winner = 0;
+        bool won = filter.add(packed, &winner);
+
+        int start = max(0, (int) added.size() - window);
+        int newest = 0;
+        int previous = 0;
+        for (int a = start; a < (int) added.size(); a++) {
+          newest += added[a] == packed ? 1 : 0;
+          previous += hadWinner && added[a] == lastWinner ? 1 : 0;
+        }
+        for (uint32_t state : states) {
+          int count = 0;
+          for (int a = start; a < (int) added.size(); a++) {
+            count += added[a] == state ? 1 : 0;
+          }
+          if (!CHECK_EQ(filter.countOf(state), count)) {
+            return;
+          }
+        }
+        bool expectWin = newest >= quorum || previous >= quorum;
+        CHECK(won == expectWin);
+        if (won) {
+          CHECK_EQ(winner, newest >= quorum ? packed : lastWinner);
+          lastWinner = winner;
+        }
+        hadWinner = won;
+      }
+    }
+  }
+}
+
+static const uint8_t* const MODEL_FRAMES[] = {FRAME_V12, FRAME_V14, FRAME_V18};
+static const int MODEL_FRAME_LENS[] = {sizeof(FRAME_V12), sizeof(FRAME_V14), sizeof(FRAME_V18)};
+static const int MODEL_FLAGS[] = {12, 14, 18};
+
+/**
+ * Clock in model's frame until the reader stops probing, returns the refreshes it took
+ */
+static int feedUntilDetected(int model) {
+  int refreshes = 0;
+  while (reader.isDetectingAcModel() && refreshes < 100) {
+    clockInFrame(MODEL_FRAMES[model], MODEL_FRAME_LENS[model]);
+    reader.processDisplayData();
+    refreshes++;
+  }
+  return refreshes;
+}
+
+TEST(display, detects_models) {
+  // Under AUTO the reader locks onto whichever model's frames the display sends and saves it
+  for (int m = 0; m < 3; m++) {
+    setAcModel("AUTO");
+    CHECK(reader.isDetectingAcModel());
+    HostHal::clearPublished();
+    feedUntilDetected(m);
+    CHECK(!reader.isDetectingAcModel());
+    CHECK_EQ(reader.getAcModel(), m);
+    CHECK_EQ(EEPROM.read(1), MODEL_FLAGS[m]);
+    CHECK_EQ(HostHal::publishCount("MODEL_DETECTED"), 1);
+
+    // And decodes with it from then on
+    for (int i = 0; i < AC_STATES_LEN; i++) {
+      clockInFrame(MODEL_FRAMES[m], MODEL_FRAME_LENS[m]);
+      reader.processDisplayData();
+    }
+    CHECK_EQ(reader.getTemp(), 72);
+  }
+  setAcModel("V1_4");
+  HostHal::clearPublished();
+}
+
+TEST(display, reprobes_on_errors) {
+  // The display switches to another model's frames mid-stream, the run of failed decodes starts a
+  // new probe that locks onto the new model
+  setAcModel("V1_4");
+  for (int i = 0; i < 10; i++) {
+    clockInFrame(FRAME_V14, sizeof(FRAME_V14));
+    reader.processDisplayData();
+  }
+  CHECK(!reader.isDetectingAcModel());
+  CHECK_EQ(reader.getTemp(), 72);
+
+  unsigned long probesBefore = reader.getStats().modelProbes;
+  int refreshes = 0;
+  while (!reader.isDetectingAcModel() && refreshes < 100) {
+    clockInFrame(FRAME_V18, sizeof(FRAME_V18));
+    reader.processDisplayData();
+    refreshes++;
+  }
+  CHECK(reader.isDetectingAcModel());
+  CHECK(refreshes <= AcManager::ModelDetector::LOCKED_WINDOW);
+  CHECK_EQ(reader.getStats().modelProbes, probesBefore + 1);
+
+  HostHal::clearPublished();
+  feedUntilDetected(V1_8);
+  CHECK(!reader.isDetectingAcModel());
+  CHECK_EQ(reader.getAcModel(), V1_8);
+  CHECK_EQ(EEPROM.read(1), 18);
+  CHECK_EQ(HostHal::publishCount("MODEL_DETECTED"), 1);
+  setAcModel("V1_4");
+  HostHal::clearPublished();
+}
+
+/**
+ * Micros from the first frame of a temperature move starting to the last code finishing
+ */
+static uint64_t moveMicros(int steps, bool held, const AcManager::HoldCalibration& hold) {
+  drainIrQueue();
+  HostHal::advanceMicros(IR_FRAME_SPACING_MAX);
+  uint64_t start = HostHal::nowMicros();
+  if (held) {
+    transmitter.holdIrCommand(AC_CMD_TEMP_TIMER_U, hold.repeatsFor(steps));
+  } else {
+    for (int i = 0; i < steps; i++) {
+      transmitter.sendIrCommand(AC_CMD_TEMP_TIMER_U);
+    }
+  }
+  drainIrQueue();
+  return HostHal::nowMicros() - start;
+}
+
+/**
+ * Micros a temperature move is on air, its frames and repeat codes without the gaps between them
+ */
+static unsigned long airMicros(int steps, bool held, const AcManager::HoldCalibration& hold) {
+  const struct IrWaveform* waveform = getIrWaveform(AC_CMD_TEMP_TIMER_U);
+  unsigned long frame = 0;
+  for (int i = 0; i < waveform->length; i++) {
+    frame += waveform->micros[i];
+  }
+  unsigned long repeat = 0;
+  for (int i = 0; i < IR_REPEAT_WAVEFORM.length; i++) {
+    repeat += IR_REPEAT_WAVEFORM.micros[i];
+  }
+  return held ? frame + hold.repeatsFor(steps) * repeat : steps * frame;
+}
+
+TEST(hold, less_airtime) {
+  // A move is only held when it is on air for less time and its repeat codes go out in the time
+  // given, across time limits and calibrations
+  const unsigned long limits[] = {1000000, AcManager::StateController::MAX_HOLD_MICROS, 10000000};
+  const int stepCounts[] = {2, 3, 5, 10, 13, 20};
+  int heldMoves = 0;
+  for (int calibrated = 0; calibrated < 2; calibrated++) {
+    // Calibrated to step on every repeat code
+    AcManager::HoldCalibration hold;
+    for (int i = 0; calibrated && i < 20; i++) {
+      hold.record(AcManager::HoldCalibration::DELAY_REPEATS + 9, 10);
+    }
+    for (unsigned long limit : limits) {
+      for (int steps : stepCounts) {
+        if (hold.shouldHold(steps, limit)) {
+          CHECK(airMicros(steps, true, hold) < airMicros(steps, false, hold));
+          CHECK(moveMicros(steps, true, hold) <= limit + NEC_RPT_PERIOD);
+          heldMoves++;
+        }
+      }
+    }
+  }
+  CHECK(heldMoves > 0);
+
+  // Two repeat codes a step: 10 degrees is held for under half the presses' airtime, 2 degrees
+  // would be on air longer and 20 take longer than the state controller allows
+  AcManager::HoldCalibration hold;
+  CHECK(hold.shouldHold(10, AcManager::StateController::MAX_HOLD_MICROS));
+  CHECK(2 * airMicros(10, true, hold) < airMicros(10, false, hold));
+  CHECK(!hold.shouldHold(2, AcManager::StateController::MAX_HOLD_MICROS));
+  CHECK(!hold.shouldHold(20, AcManager::StateController::MAX_HOLD_MICROS));
+}
+
+TEST(virtual_ac, displayable_states) {
+  // The virtual unit's refreshes decode to what it was told to show, V1_4 has no medium fan segment
+  const int showable[] = {372, 279, 372};
+  for (int m = 0; m < 3; m++) {
+    struct VirtualAcConfig config = VIRTUAL_AC_DEFAULTS;
+    config.model = (AcModels) m;
+    VirtualAc ac(config);
+    int shown = 0;
+    for (int temp = VIRTUAL_AC_MIN_TEMP; temp <= VIRTUAL_AC_MAX_TEMP; temp++) {
+      for (int mode = MODE_FAN; mode <= MODE_COOL; mode++) {
+        for (int speed = FAN_LOW; speed <= FAN_AUTO; speed++) {
+          shown += ac.canShow(AcState(0, temp, 0, (FanSpeeds) speed, (AcModes) mode, false)) ? 1 : 0;
+        }
+      }
+    }
+    CHECK_EQ(shown, showable[m]);
+  }
+}
+
+TEST(virtual_ac, converges) {
+  // setState against each model from whatever it shows, done always means the unit got there
+  for (int m = 0; m < 3; m++) {
+    struct VirtualAcConfig config = VIRTUAL_AC_DEFAULTS;
+    config.model = (AcModels) m;
+    VirtualAc ac(config);
+    Convergence::warmUp(&ac, MODEL_NAMES[m]);
+    Convergence::Result result;
+    Convergence::run(&ac, 100, m + 1, &result);
+    CHECK_EQ(result.requests, 100);
+    CHECK_EQ(result.wrong, 0);
+    CHECK_EQ(result.timeouts, 0);
+    // Only V1_4 has targets it can't show, about a quarter of the ones that aren't off
+    CHECK(m == V1_4 ? result.rejected > 0 : result.rejected == 0);
+  }
+  setAcModel("V1_4");
+}
+
+TEST(virtual_ac, unreachable_refused) {
+  // V1_4 has no medium fan, setState refuses it up front instead of replanning until it times out
+  AcManager::CommandPlanner v14(V1_4);
+  enum AcCommands presses[AcManager::CommandPlanner::MAX_FAN_PRESSES];
+  CHECK_EQ(v14.planFanSpeed(FAN_LOW, FAN_HIGH, presses, AcManager::CommandPlanner::MAX_FAN_PRESSES), 1);
+  CHECK_EQ(v14.planFanSpeed(FAN_HIGH, FAN_MEDIUM, presses, AcManager::CommandPlanner::MAX_FAN_PRESSES), -1);
+  CHECK(!v14.canReach(AcState(0, 72, 0, FAN_MEDIUM, MODE_COOL, false)));
+  CHECK(AcManager::CommandPlanner(V1_2).canReach(AcState(0, 72, 0, FAN_MEDIUM, MODE_COOL, false)));
+
+  VirtualAc ac(VIRTUAL_AC_DEFAULTS);
+  Convergence::warmUp(&ac, "V1_4");
+  HostHal::clearPublished();
+  CHECK_EQ(setState("72,MODE_COOL,FAN_MEDIUM"), 8);
+  CHECK_EQ(HostHal::publishCount("STATE_UNREACHABLE"), 1);
+  CHECK(!stateController.isBusy());
+  CHECK(converge(&ac, "72,MODE_COOL,FAN_HIGH"));
+  HostHal::clearPublished();
+}
+
+TEST(virtual_ac, hold_calibrates) {
+  // The virtual unit steps every 3 repeat codes, not the default 2, large moves are held and the
+  // display feedback moves the calibration towards it
+  VirtualAc ac(VIRTUAL_AC_DEFAULTS);
+  Convergence::warmUp(&ac, "V1_4");
+  unsigned long repeatsBefore = ac.getRepeats();
+  for (int i = 0; i < 4; i++) {
+    CHECK(converge(&ac, i % 2 == 0 ? "65,MODE_COOL,FAN_AUTO" : "75,MODE_COOL,FAN_AUTO"));
+  }
+  CHECK(ac.getRepeats() > repeatsBefore);
+  int repeatsPerStep16 = stateController.getHoldCalibration(V1_4).getRepeatsPerStep16();
+  CHECK(repeatsPerStep16 > AcManager::HoldCalibration::DEFAULT_REPEATS_PER_STEP * 16);
+  CHECK(repeatsPerStep16 <= VIRTUAL_AC_DEFAULTS.holdRepeatsPerStep * 16);
+}
+
+TEST(virtual_ac, ack_across_micros_wrap) {
+  // A batch that goes out just before micros() wraps is acked just after, the learned ack stays sane
+  VirtualAc ac(VIRTUAL_AC_DEFAULTS);
+  Convergence::warmUp(&ac, "V1_4");
+  HostHal::setMicros((((HostHal::nowMicros() >> 32) + 1) << 32) - 100000);
+  int temp = ac.getState().getTemp() < VIRTUAL_AC_MAX_TEMP ? ac.getState().getTemp() + 1 : VIRTUAL_AC_MIN_TEMP;
+  CHECK(converge(&ac, Convergence::commandFor(AcState(0, temp, 0, FAN_AUTO, MODE_COOL, false)).c_str()));
+  CHECK(stateController.getPacing(V1_4).getAckMillis() < 2000);
+}
+
+static int schedulerRuns[2];
+static uint64_t schedulerRunMicros[2];
+static void countTaskA(void* context) { schedulerRuns[0]++; schedulerRunMicros[0] = HostHal::nowMicros(); }
+static void countTaskB(void* context) { schedulerRuns[1]++; schedulerRunMicros[1] = HostHal::nowMicros(); }
+
+static void runSchedulerFor(AcManager::Scheduler* sched, unsigned long millis) {
+  for (unsigned long i = 0; i < millis; i++) {
+    HostHal::advanceMicros(1000);
+    sched->run();
+  }
+}
+
+TEST(scheduler, periods) {
+  AcManager::Scheduler sched;
+  schedulerRuns[0] = schedulerRuns[1] = 0;
+  uint64_t start = HostHal::nowMicros();
+  CHECK_EQ(sched.add(countTaskA, 1000), 0);
+  CHECK_EQ(sched.add(countTaskB, 250), 1);
+  CHECK_EQ(sched.getPeriod(0), 1000);
+
+  // The first run is a period after add
+  runSchedulerFor(&sched, 999);
+  CHECK_EQ(schedulerRuns[0], 0);
+  CHECK_EQ(schedulerRuns[1], 3);
+  runSchedulerFor(&sched, 1);
+  CHECK_EQ(schedulerRuns[0], 1);
+  CHECK_EQ(schedulerRunMicros[0] - start, 1000000);
+
+  runSchedulerFor(&sched, 9000);
+  CHECK_EQ(schedulerRuns[0], 10);
+  CHECK_EQ(schedulerRuns[1], 40);
+  CHECK_EQ(schedulerRunMicros[0] - start, 10000000);
+
+  // A new period starts from now
+  sched.setPeriod(0, 500);
+  runSchedulerFor(&sched, 2000);
+  CHECK_EQ(schedulerRuns[0], 14);
+}
+
+TEST(scheduler, full_table) {
+  AcManager::Scheduler sched;
+  for (int i = 0; i < AcManager::Scheduler::MAX_TASKS; i++) {
+    CHECK_EQ(sched.add(countTaskA, 1000), i);
+  }
+  CHECK_EQ(sched.add(countTaskA, 1000), -1);
+
+  // The -1 a full table returns, or any other id add never gave out, changes nothing
+  schedulerRuns[0] = 0;
+  sched.setPeriod(-1, 10);
+  sched.defer(-1);
+  sched.setPeriod(AcManager::Scheduler::MAX_TASKS, 10);
+  sched.defer(AcManager::Scheduler::MAX_TASKS);
+  CHECK_EQ(sched.getPeriod(-1), 0);
+  for (int i = 0; i < AcManager::Scheduler::MAX_TASKS; i++) {
+    CHECK_EQ(sched.getPeriod(i), 1000);
+  }
+  runSchedulerFor(&sched, 1000);
+  CHECK_EQ(schedulerRuns[0], AcManager::Scheduler::MAX_TASKS);
+}
+
+TEST(scheduler, deferral) {
+  AcManager::Scheduler sched;
+  schedulerRuns[0] = 0;
+  int a = sched.add(countTaskA, 1000);
+
+  // Deferring before every deadline keeps the task from ever running
+  for (int i = 0; i < 20; i++) {
+    runSchedulerFor(&sched, 500);
+    sched.defer(a);
+  }
+  CHECK_EQ(schedulerRuns[0], 0);
+  CHECK_EQ(sched.untilNext(), 1000);
+
+  // Once the deferrals stop it runs a full period after the last one
+  uint64_t lastDefer = HostHal::nowMicros();
+  runSchedulerFor(&sched, 1000);
+  CHECK_EQ(schedulerRuns[0], 1);
+  CHECK_EQ(schedulerRunMicros[0] - lastDefer, 1000000);
+}
+
+TEST(scheduler, catch_up) {
+  AcManager::Scheduler sched;
+  schedulerRuns[0] = 0;
+  sched.add(countTaskA, 1000);
+
+  // A little late keeps the cadence, the next run is still on the original grid
+  HostHal::advanceMicros(1100000);
+  CHECK_EQ(sched.run(), 1);
+  CHECK_EQ(sched.untilNext(), 900);
+
+  // Ten periods late runs once, then carries on a period from now
+  HostHal::advanceMicros(10000000);
+  CHECK_EQ(sched.untilNext(), 0);
+  CHECK_EQ(sched.run(), 1);
+  CHECK_EQ(sched.run(), 0);
+  CHECK_EQ(schedulerRuns[0], 2);
+  CHECK_EQ(sched.untilNext(), 1000);
+}
+
+TEST(scheduler, until_next) {
+  AcManager::Scheduler sched;
+  CHECK_EQ(sched.untilNext(), 0xFFFFFFFF);
+  sched.add(countTaskA, 1000);
+  sched.add(countTaskB, 250);
+  CHECK_EQ(sched.untilNext(), 250);
+  HostHal::advanceMicros(100000);
+  CHECK_EQ(sched.untilNext(), 150);
+  HostHal::advanceMicros(150000);
+  CHECK_EQ(sched.untilNext(), 0);
+  sched.run();
+  CHECK_EQ(sched.untilNext(), 250);
+}
+
+TEST(scheduler, millis_wrap) {
+  // Deadlines past millis() wrapping around still come due on time
+  HostHal::setMicros((0x100000000ULL - 300) * 1000);
+  AcManager::Scheduler sched;
+  schedulerRuns[0] = 0;
+  sched.add(countTaskA, 1000);
+  CHECK_EQ(sched.untilNext(), 1000);
+  runSchedulerFor(&sched, 999);
+  CHECK_EQ(schedulerRuns[0], 0);
+  CHECK_EQ(sched.untilNext(), 1);
+  runSchedulerFor(&sched, 1);
+  CHECK_EQ(schedulerRuns[0], 1);
+  CHECK_EQ(sched.untilNext(), 1000);
+}
+
+// A reader on its own scheduler with short intervals, unit 2 so unit 0 is left alone
+static AcManager::Scheduler intervalScheduler;
+static AcManager::DisplayReader intervalReader;
+
+TEST(scheduler, reader_intervals) {
+  struct AcDisplayReaderConfig config = AC_DISPLAY_READER_CONFIG_DEFAULTS;
+  config.clockPin = D5;
+  config.inputPin = A2;
+  config.refreshInterval = 10;
+  config.staleInterval = 4;
+  config.statusVar = config.statusVar + "2";
+  config.dataVar = config.dataVar + "2";
+  // multi_unit may have left 72 for unit 2 in retained memory, restore something else so the
+  // first vote below is a state change
+  saveWarmDisplay(2, V1_4, AcState(0, 80, 0, FAN_LOW, MODE_FAN, false).display);
+  intervalReader.init(2, config, &intervalScheduler);
+  intervalReader.setAcModel("V1_4");
+  const char* stale = config.statusStaleEventName.c_str();
+  const char* refresh = config.statusRefreshEventName.c_str();
+
+  // Nothing on the display, stale every staleInterval and refresh every refreshInterval
+  HostHal::clearPublished();
+  for (int i = 0; i < 60000; i++) {
+    HostHal::advanceMicros(1000);
+    intervalScheduler.run();
+  }
+  CHECK_EQ(HostHal::publishCount(stale), 60 / config.staleInterval);
+  CHECK_EQ(HostHal::publishCount(refresh), 60 / config.refreshInterval);
+
+  // A display that keeps refreshing is never stale, its first state change pushes the refresh back
+  HostHal::clearPublished();
+  while (HostHal::publishCount(config.statusChangeEventName.c_str()) == 0) {
+    clockInFrame(config.clockPin, config.inputPin, FRAME_V14, sizeof(FRAME_V14));
+    intervalReader.processDisplayData();
+    intervalScheduler.run();
+  }
+  HostHal::clearPublished();
+  uint64_t start = HostHal::nowMicros();
+  while (HostHal::nowMicros() - start < 55000000) {
+    clockInFrame(config.clockPin, config.inputPin, FRAME_V14, sizeof(FRAME_V14));
+    intervalReader.processDisplayData();
+    intervalScheduler.run();
+  }
+  CHECK_EQ(HostHal::publishCount(stale), 0);
+  CHECK_EQ(HostHal::publishCount(refresh), 55 / config.refreshInterval);
+  HostHal::clearPublished();
+}
+
+/**
+ * Wait the monitor's interval on the fake clock and record one probe
+ */
+static AcManager::LinkMonitor::Action probeLink(AcManager::LinkMonitor* monitor, bool success) {
+  HostHal::advanceMicros(monitor->getInterval() * 1000ULL);
+  return monitor->record(success, millis());
+}
+
+TEST(link, backoff) {
+  // The interval doubles with every answer up to maxInterval and drops to minInterval on a failure
+  AcManager::LinkMonitor monitor(AcManager::LINK_MONITOR_CONFIG_DEFAULTS);
+  monitor.reset(millis());
+  const unsigned long intervals[] = {10000, 20000, 40000, 80000, 80000};
+  for (unsigned long interval : intervals) {
+    CHECK_EQ(probeLink(&monitor, true), AcManager::LinkMonitor::ACTION_NONE);
+    CHECK_EQ(monitor.getInterval(), interval);
+  }
+  CHECK_EQ(probeLink(&monitor, false), AcManager::LinkMonitor::ACTION_NONE);
+  CHECK_EQ(monitor.getInterval(), 5000);
+  CHECK(monitor.isUp());
+  probeLink(&monitor, true);
+  CHECK_EQ(monitor.getInterval(), 10000);
+}
+
+TEST(link, escalation) {
+  // Every probe fails from a reset: down and reconnect on the third failure 15s in, reset only
+  // once nothing has answered for resetMillis, on the twelfth failure 60s in
+  AcManager::LinkMonitor monitor(AcManager::LINK_MONITOR_CONFIG_DEFAULTS);
+  unsigned long start = millis();
+  monitor.reset(start);
+  int reconnects = 0;
+  unsigned long reconnectAt = 0;
+  unsigned long resetAt = 0;
+  int failures = 0;
+  while (resetAt == 0 && failures < 20) {
+    AcManager::LinkMonitor::Action action = probeLink(&monitor, false);
+    failures++;
+    CHECK_EQ(monitor.getFailuresInARow(), failures);
+    CHECK(monitor.isUp() == (failures < AcManager::LINK_MONITOR_CONFIG_DEFAULTS.downFailures));
+    if (action == AcManager::LinkMonitor::ACTION_RECONNECT) {
+      reconnects++;
+      reconnectAt = millis() - start;
+      CHECK_EQ(failures, 3);
+    } else if (action == AcManager::LinkMonitor::ACTION_RESET) {
+      resetAt = millis() - start;
+      CHECK_EQ(failures, 12);
+    }
+  }
+  CHECK_EQ(reconnects, 1);
+  CHECK_EQ(reconnectAt, 15000);
+  CHECK_EQ(resetAt, 60000);
+
+  // One answer brings it back up, nothing in a row has failed any more
+  CHECK_EQ(probeLink(&monitor, true), AcManager::LinkMonitor::ACTION_NONE);
+  CHECK(monitor.isUp());
+  CHECK_EQ(monitor.getFailuresInARow(), 0);
+  CHECK_EQ(monitor.getInterval(), 10000);
+}
+
+TEST(link, failure_window) {
+  // Failures that never run three in a row still take the link down once the window has three,
+  // without a reconnect, and age out of the window after eight probes
+  AcManager::LinkMonitor monitor(AcManager::LINK_MONITOR_CONFIG_DEFAULTS);
+  monitor.reset(millis());
+  for (int i = 0; i < 3; i++) {
+    CHECK(monitor.isUp());
+    CHECK_EQ(probeLink(&monitor, false), AcManager::LinkMonitor::ACTION_NONE);
+    CHECK_EQ(monitor.getWindowFailures(), i + 1);
+    if (i < 2) {
+      CHECK_EQ(probeLink(&monitor, true), AcManager::LinkMonitor::ACTION_NONE);
+    }
+  }
+  CHECK(!monitor.isUp());
+  CHECK_EQ(probeLink(&monitor, true), AcManager::LinkMonitor::ACTION_NONE);
+  CHECK(monitor.isUp());
+  for (int i = 0; i < 6; i++) {
+    probeLink(&monitor, true);
+  }
+  CHECK_EQ(monitor.getWindowFailures(), 1);
+  probeLink(&monitor, true);
+  CHECK_EQ(monitor.getWindowFailures(), 0);
+}
+
+TEST(link, events) {
+  // setup()'s connection check against a router that stops answering, then comes back
+  HostHal::setPingSuccesses(0);
+  HostHal::clearPublished();
+  unsigned long resetsBefore = HostHal::resetCount();
+  while (HostHal::resetCount() == resetsBefore) {
+    scheduler.run();
+    HostHal::advanceMicros(scheduler.untilNext() * 1000ULL);
+  }
+  CHECK_EQ(HostHal::publishCount("LINK_DOWN"), 1);
+  CHECK_EQ(HostHal::publishCount("LINK_RECONNECT"), 1);
+  CHECK(!getLinkMonitor().isUp());
+
+  HostHal::setPingSuccesses(8);
+  HostHal::clearPublished();
+  while (!getLinkMonitor().isUp()) {
+    scheduler.run();
+    HostHal::advanceMicros(scheduler.untilNext() * 1000ULL);
+  }
+  CHECK_EQ(HostHal::publishCount("LINK_UP"), 1);
+  HostHal::clearPublished();
+}
+
+TEST(scheduler, reader_without_room) {
+  // A reader whose events don't fit in the scheduler says so, and still reads the display
+  static AcManager::Scheduler fullScheduler;
+  static AcManager::DisplayReader fullReader;
+  for (int i = 0; i < AcManager::Scheduler::MAX_TASKS - 1; i++) {
+    fullScheduler.add(countTaskA, 1000);
+  }
+  struct AcDisplayReaderConfig config = AC_DISPLAY_READER_CONFIG_DEFAULTS;
+  config.clockPin = D5;
+  config.inputPin = A2;
+  config.statusVar = config.statusVar + "2";
+  config.dataVar = config.dataVar + "2";
+  CHECK(!fullReader.init(2, config, &fullScheduler));
+  fullReader.setAcModel("V1_4");
+  for (int i = 0; i < AC_STATES_LEN + 1; i++) {
+    clockInFrame(config.clockPin, config.inputPin, FRAME_V14_73, sizeof(FRAME_V14_73));
+    fullReader.processDisplayData();
+    fullScheduler.run();
+  }
+  CHECK_EQ(fullReader.getTemp(), 73);
+  HostHal::clearPublished();
+}
+
+// The cold replays leave unit 0 registered to a reader that is gone, these groups run last
+
+TEST(capture, record_and_replay) {
+  // Record unit 0 going from 72 to 73 off the Serial stream, bytes still in the ring would be recorded too
+  setAcModel("V1_4");
+  clockInFrame(FRAME_V14, sizeof(FRAME_V14));
+  reader.processDisplayData();
+  HostHal::clearSerialOutput();
+  CHECK_EQ(HostHal::callFunction("capture", "on"), 1);
+  for (int frame = 0; frame < 20; frame++) {
+    clockInFrame(frame < 10 ? FRAME_V14 : FRAME_V14_73, sizeof(FRAME_V14));
+    reader.processDisplayData();
+  }
+  CHECK_EQ(HostHal::callFunction("capture", "off"), 0);
+  std::string recorded = HostHal::serialOutput();
+  CHECK_EQ(reader.getTemp(), 73);
+
+  // The recording decodes to the same states, the cold reader also reports the first one. The byte
+  // left in the shift register before capture on is pushed in, the very last one isn't
+  Replay::Report report;
+  CHECK(Replay::replayCaptureCold((const uint8_t*) recorded.data(), recorded.size(), NULL, &report));
+  CHECK(!report.truncated);
+  CHECK_EQ(report.bytes, 20 * sizeof(FRAME_V14));
+  CHECK_EQ(report.transitions.size(), 2);
+  CHECK(!report.transitions.empty() && report.transitions.back().status.find("\"temp\":73") != std::string::npos);
+  HostHal::clearPublished();
+}
+
+TEST(capture, synthetic_noise_voted_out) {
+  // The temp changes every 1000 refreshes and every 500th refresh is garbled
+  const int refreshes = 20000;
+  const uint8_t garbled[] = {0x7F, 0x7F, 0xF8, 0x00, 0xED, 0xFF};
+  std::vector<uint8_t> capture(CAPTURE_HEADER_LEN + CAPTURE_RECORD_MAX * 2);
+  int len = AcManager::encodeCaptureHeader(capture.data(), 0);
+  len += AcManager::encodeCaptureTime(&capture[len], 0);
+  len += AcManager::encodeCaptureModel(&capture[len], V1_4);
+  capture.resize(len + refreshes * sizeof(FRAME_V14) * CAPTURE_RECORD_MAX);
+  for (int r = 0; r < refreshes; r++) {
+    const uint8_t* display = r % 500 == 499 ? garbled : (r / 1000) % 2 == 0 ? FRAME_V14 : FRAME_V14_73;
+    for (size_t b = 0; b < sizeof(FRAME_V14); b++) {
+      uint16_t sinceLast = b == 0 ? FRAME_GAP_MICROS + BYTE_MICROS : BYTE_MICROS;
+      len += AcManager::encodeCaptureByte(&capture[len], display[b], sinceLast);
+    }
+  }
+  capture.resize(len);
+
+  Replay::Report report;
+  CHECK(Replay::replayCaptureCold(capture.data(), capture.size(), NULL, &report));
+  unsigned long parseErrors = 0;
+  for (const auto& error : report.parseErrors) {
+    parseErrors += error.second;
+  }
+  CHECK_EQ(report.transitions.size(), refreshes / 1000);
+  CHECK(parseErrors >= (unsigned long) refreshes / 500);
+  HostHal::clearPublished();
+}
+
+static std::vector<uint8_t> edgeTrace72To73() {
+  // 2000 refreshes of clean edges, the temp goes from 72 to 73 half way
+  std::vector<uint8_t> edges;
+  edges.reserve(EDGE_TRACE_HEADER_LEN + 2000 * sizeof(FRAME_V14) * 8 * 4);
+  EdgeTrace::appendHeader(&edges);
+  for (int r = 0; r < 2000; r++) {
+    const uint8_t* display = r < 1000 ? FRAME_V14 : FRAME_V14_73;
+    for (size_t b = 0; b < sizeof(FRAME_V14); b++) {
+      uint32_t gap = BYTE_MICROS - 7 * BIT_MICROS + (b == 0 ? FRAME_GAP_MICROS : 0);
+      EdgeTrace::appendByte(&edges, display[b], gap);
+    }
+  }
+  return edges;
+}
+
+TEST(edge_trace, clean_edges) {
+  std::vector<uint8_t> edges = edgeTrace72To73();
+  EdgeTrace::Trace trace(edges.data(), edges.size());
+  EdgeTrace::Report report;
+  CHECK(EdgeTrace::replayEdgesCold(trace, "V1_4", EdgeTrace::NO_FAULTS, &report));
+  CHECK_EQ(report.edges, 2000 * sizeof(FRAME_V14) * 8);
+  CHECK_EQ(report.decode.parseErrors.size(), 0);
+  CHECK_EQ(report.decode.transitions.size(), 2);
+  HostHal::clearPublished();
+}
+
+TEST(edge_trace, faults) {
+  std::vector<uint8_t> edges = edgeTrace72To73();
+  EdgeTrace::Trace trace(edges.data(), edges.size());
+
+  // Framing holds while the jitter stays inside the margin between BYTE_MICROS and UPDATE_TIME_MAX
+  struct EdgeTrace::Faults faults = EdgeTrace::NO_FAULTS;
+  faults.jitterMicros = 200;
+  EdgeTrace::Report report;
+  EdgeTrace::replayEdgesCold(trace, "V1_4", faults, &report);
+  CHECK_EQ(report.decode.transitions.size(), 2);
+
+  // One edge in a thousand lost or doubled garbles a byte now and then, the vote keeps it out
+  faults = EdgeTrace::NO_FAULTS;
+  faults.dropRate = 0.001;
+  faults.extraRate = 0.001;
+  EdgeTrace::replayEdgesCold(trace, "V1_4", faults, &report);
+  CHECK(report.droppedEdges > 0 && report.extraEdges > 0);
+  CHECK_EQ(report.decode.transitions.size(), 2);
+  HostHal::clearPublished();
+}
+
+int main(int argc, char** argv) {
+  HostHal::reset();
+  HostHal::setMicros(1000000);
+  HostHal::setPingSuccesses(8);
+  setup();
+
+  return Test::run(argc, argv);
+}
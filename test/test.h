@@ -0,0 +1,92 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * Minimal test harness for the host tests, no external dependencies so it builds anywhere the
+ * host HAL does. Tests register themselves with TEST(group, name) in the order they are defined,
+ * run() runs the groups named on the command line or every group, and fails if any check did.
+ */
+namespace Test {
+
+typedef void (*TestFunction)();
+
+struct Case {
+  const char* group;
+  const char* name;
+  TestFunction function;
+};
+
+inline std::vector<Case>& cases() {
+  static std::vector<Case> all;
+  return all;
+}
+
+// Checks that failed in the test running now
+inline int& failedChecks() {
+  static int failed = 0;
+  return failed;
+}
+
+struct Registrar {
+  Registrar(const char* group, const char* name, TestFunction function) {
+    cases().push_back({group, name, function});
+  }
+};
+
+inline bool check(const char* file, int line, const char* expression, bool passed) {
+  if (!passed) {
+    printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+    failedChecks()++;
+  }
+  return passed;
+}
+
+inline bool checkEqual(const char* file, int line, const char* expression, long long got, long long expected) {
+  if (got != expected) {
+    printf("%s:%d: %s is %lld, expected %lld\n", file, line, expression, got, expected);
+    failedChecks()++;
+  }
+  return got == expected;
+}
+
+/**
+ * Run every test in the groups named in argv, all of them if there are none. Returns the exit
+ * status, 1 if any test failed or a group has no tests
+ */
+inline int run(int argc, char** argv) {
+  int failed = 0;
+  int ran = 0;
+  for (const Case& test : cases()) {
+    bool selected = argc <= 1;
+    for (int i = 1; i < argc; i++) {
+      selected = selected || strcmp(argv[i], test.group) == 0;
+    }
+    if (!selected) {
+      continue;
+    }
+
+    failedChecks() = 0;
+    test.function();
+    ran++;
+    failed += failedChecks() > 0 ? 1 : 0;
+    printf("%-8s %s.%s\n", failedChecks() > 0 ? "FAILED" : "ok", test.group, test.name);
+  }
+  printf("%d of %d tests failed\n", failed, ran);
+  return failed > 0 || ran == 0 ? 1 : 0;
+}
+
+}
+
+#define TEST(group, name) \
+  static void test_##group##_##name(); \
+  static Test::Registrar registrar_##group##_##name(#group, #name, test_##group##_##name); \
+  static void test_##group##_##name()
+
+#define CHECK(condition) Test::check(__FILE__, __LINE__, #condition, (condition))
+#define CHECK_EQ(got, expected) Test::checkEqual(__FILE__, __LINE__, #got, (long long) (got), (long long) (expected))
+
+#endif
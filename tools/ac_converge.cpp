@@ -0,0 +1,77 @@
+/**
+ * Benchmarks setState against a virtual AC unit (see virtual_ac.h)
+ *
+ *   ac_converge [-m V1_2|V1_4|V1_8] [-n requests] [-l millis] [-N noise] [-x miss] [-g millis] [-s seed]
+ *
+ *  -m  only this model, default every model in turn
+ *  -n  random targets requested per model, default 1000
+ *  -l  unit response latency, from receiving a press to the display showing it
+ *  -N  fraction of display refreshes with a flipped bit
+ *  -x  fraction of IR frames the unit misses
+ *  -g  presses closer than this to the last one are ignored by the unit
+ *  -s  seed for the targets and the unit's noise
+ *
+ * Prints time to converge and presses per request for each model. Some targets are ones the model
+ * can't show, setState has to refuse those. Exits non zero if any request reported done with the
+ * unit somewhere else or setState refused a target the unit can show.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "convergence.h"
+
+static const char* MODEL_NAMES[] = {"V1_2", "V1_4", "V1_8"};
+
+int main(int argc, char** argv) {
+  struct VirtualAcConfig config = VIRTUAL_AC_DEFAULTS;
+  int onlyModel = -1;
+  int requests = 1000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:l:N:x:g:s:")) != -1) {
+    switch (opt) {
+      case 'm':
+        for (int m = 0; m < 3; m++) {
+          onlyModel = strcmp(optarg, MODEL_NAMES[m]) == 0 ? m : onlyModel;
+        }
+        break;
+      case 'n': requests = atoi(optarg); break;
+      case 'l': config.responseMicros = strtoul(optarg, NULL, 10) * 1000; break;
+      case 'N': config.frameNoise = atof(optarg); break;
+      case 'x': config.missRate = atof(optarg); break;
+      case 'g': config.pressGapMicros = strtoul(optarg, NULL, 10) * 1000; break;
+      case 's': config.seed = strtoul(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-m V1_2|V1_4|V1_8] [-n requests] [-l millis] [-N noise] [-x miss] [-g millis] [-s seed]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  HostHal::reset();
+  HostHal::setMicros(1000000);
+  HostHal::setPingSuccesses(8);
+  setup();
+
+  printf("%-6s %8s %8s %8s %8s %8s %10s %10s %10s %10s %10s %10s\n", "model", "requests", "done", "timeout",
+    "rejected", "wrong", "p50 s", "p95 s", "max s", "frames/req", "repeats/req", "host s");
+  int wrong = 0;
+  for (int m = 0; m < 3; m++) {
+    if (onlyModel != -1 && m != onlyModel) {
+      continue;
+    }
+    config.model = (AcModels) m;
+    VirtualAc ac(config);
+
+    Convergence::warmUp(&ac, MODEL_NAMES[m]);
+    Convergence::Result result;
+    Convergence::run(&ac, requests, config.seed + m, &result);
+    printf("%-6s %8d %8d %8d %8d %8d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", MODEL_NAMES[m], result.requests,
+      result.done, result.timeouts, result.rejected, result.wrong, result.percentile(0.5), result.percentile(0.95),
+      result.percentile(1.0), (double) result.frames / result.accepted(), (double) result.repeats / result.accepted(),
+      result.wallSeconds);
+    wrong += result.wrong;
+  }
+  return wrong > 0 ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * Drives the display clock ISR with an edge trace (see edge_trace.h) through the fake HAL
+ *
+ *   ac_edge_replay [-c] [-o edges] [-m MODEL] [-j micros] [-d rate] [-x rate] [-s seed] [-S] trace
+ *
+ *  -c  trace is a display capture (see ac_capture.h), expanded to edges first
+ *  -o  write the expanded edges to a file, for replaying them later without -c
+ *  -m  AUTO, V1_2, V1_4 or V1_8, defaults to the capture's model or AUTO
+ *  -j  move each edge up to this many micros either way
+ *  -d  fraction of edges to drop
+ *  -x  fraction of edges followed by a spurious one
+ *  -s  seed for the injected faults
+ *  -S  sweep the jitter from 0 to twice UPDATE_TIME_MAX, -d and -x apply to every step
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "edge_trace.h"
+
+static const char* MODEL_NAMES[] = {"V1_2", "V1_4", "V1_8"};
+
+static unsigned long countParseErrors(const Replay::Report& decode) {
+  unsigned long errors = 0;
+  for (const auto& error : decode.parseErrors) {
+    errors += error.second;
+  }
+  return errors;
+}
+
+static void printRow(unsigned long jitter, const EdgeTrace::Report& report) {
+  const struct AcDisplayReaderStats& stats = report.decode.stats;
+  printf("%8lu %12lu %9.2f%% %12.2f %12zu %10.1f\n", jitter, report.edges,
+    stats.parseAttempts > 0 ? 100.0 * stats.parsedFrames / stats.parseAttempts : 0.0,
+    stats.parseAttempts > 0 ? 1000.0 * countParseErrors(report.decode) / stats.parseAttempts : 0.0,
+    report.decode.transitions.size(), report.decode.wallSeconds * 1e9 / report.edges);
+}
+
+static void printReport(const char* path, const EdgeTrace::Report& report) {
+  const struct AcDisplayReaderStats& stats = report.decode.stats;
+  printf("%s: %.1f s of display\n", path, report.decode.captureSeconds);
+  printf("  %lu edges fed, %lu dropped, %lu extra\n", report.edges, report.droppedEdges, report.extraEdges);
+  printf("  %lu of %lu parse attempts decoded, %lu model probes\n", stats.parsedFrames, stats.parseAttempts,
+    stats.modelProbes);
+  printf("  replayed in %.3f s, %.1f ns/edge\n", report.decode.wallSeconds,
+    report.decode.wallSeconds * 1e9 / report.edges);
+  printf("  parse errors:%s\n", report.decode.parseErrors.empty() ? " none" : "");
+  for (const auto& error : report.decode.parseErrors) {
+    printf("    %-24s %10lu\n", error.first.c_str(), error.second);
+  }
+  printf("  state transitions: %zu\n", report.decode.transitions.size());
+}
+
+int main(int argc, char** argv) {
+  bool fromCapture = false;
+  bool sweep = false;
+  const char* outPath = NULL;
+  const char* modelName = NULL;
+  struct EdgeTrace::Faults faults = EdgeTrace::NO_FAULTS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "co:m:j:d:x:s:S")) != -1) {
+    switch (opt) {
+      case 'c': fromCapture = true; break;
+      case 'o': outPath = optarg; break;
+      case 'm': modelName = optarg; break;
+      case 'j': faults.jitterMicros = strtoul(optarg, NULL, 10); break;
+      case 'd': faults.dropRate = atof(optarg); break;
+      case 'x': faults.extraRate = atof(optarg); break;
+      case 's': faults.seed = strtoul(optarg, NULL, 10); break;
+      case 'S': sweep = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-c] [-o edges] [-m MODEL] [-j micros] [-d rate] [-x rate] [-s seed] [-S] trace\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-c] [-o edges] [-m MODEL] [-j micros] [-d rate] [-x rate] [-s seed] [-S] trace\n", argv[0]);
+    return 2;
+  }
+  const char* path = argv[optind];
+
+  EdgeTrace::MappedFile file(path);
+  if (file.getData() == NULL) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  // Captures are expanded in memory, traces are replayed straight from the mapping
+  std::vector<uint8_t> expanded;
+  EdgeTrace::Trace trace(file.getData(), file.size());
+  if (fromCapture) {
+    int model = EdgeTrace::fromCapture(file.getData(), file.size(), &expanded);
+    if (modelName == NULL && model >= 0 && model < 3) {
+      modelName = MODEL_NAMES[model];
+    }
+    trace = EdgeTrace::Trace(expanded.data(), expanded.size());
+  }
+  if (!trace.isValid() || trace.edges() == 0) {
+    fprintf(stderr, "%s: no edges, not a version %d %s\n", path, fromCapture ? CAPTURE_VERSION : EDGE_TRACE_VERSION,
+      fromCapture ? "capture" : "edge trace");
+    return 1;
+  }
+  if (outPath != NULL) {
+    FILE* out = fopen(outPath, "wb");
+    if (out == NULL || fwrite(expanded.data(), 1, expanded.size(), out) != expanded.size() || fclose(out) != 0) {
+      fprintf(stderr, "%s: %s\n", outPath, strerror(errno));
+      return 1;
+    }
+  }
+  if (modelName == NULL) {
+    modelName = "AUTO";
+  }
+
+  EdgeTrace::Report report;
+  if (!sweep) {
+    EdgeTrace::replayEdgesCold(trace, modelName, faults, &report);
+    printReport(path, report);
+    return 0;
+  }
+
+  printf("%8s %12s %10s %12s %12s %10s\n", "jitter", "edges", "decoded", "errors/1k", "transitions", "ns/edge");
+  for (unsigned long jitter = 0; jitter <= 2 * UPDATE_TIME_MAX; jitter += UPDATE_TIME_MAX / 10) {
+    faults.jitterMicros = jitter;
+    EdgeTrace::replayEdgesCold(trace, modelName, faults, &report);
+    printRow(jitter, report);
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Replays display captures recorded with the capture cloud function through the display pipeline
+ *
+ *   ac_replay [-v] [-m AUTO|V1_2|V1_4|V1_8] capture...
+ *
+ * Prints how fast each capture decoded, the parse errors it hit and how many state transitions it
+ * reported, -v lists every transition. -m decodes with a model other than the one recorded. Exits
+ * non zero if any capture couldn't be read or was cut short.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "capture_replay.h"
+
+static bool readFile(const char* path, std::vector<uint8_t>* data) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  uint8_t chunk[65536];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data->insert(data->end(), chunk, chunk + len);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+static void printReport(const char* path, const Replay::Report& report, bool verbose) {
+  printf("%s: unit %d, %.1f s of display\n", path, report.unit, report.captureSeconds);
+  printf("  %lu bytes, %lu refreshes, %lu of %lu parse attempts decoded\n", report.bytes,
+    report.refreshes, report.stats.parsedFrames, report.stats.parseAttempts);
+  printf("  replayed in %.3f s, %.0f refreshes/s, %.0fx real time\n", report.wallSeconds,
+    report.refreshes / report.wallSeconds, report.captureSeconds / report.wallSeconds);
+
+  printf("  parse errors:%s\n", report.parseErrors.empty() ? " none" : "");
+  for (const auto& error : report.parseErrors) {
+    printf("    %-24s %10lu\n", error.first.c_str(), error.second);
+  }
+
+  printf("  state transitions: %zu\n", report.transitions.size());
+  if (verbose) {
+    for (const Replay::Transition& transition : report.transitions) {
+      printf("    %12.3f s  %s\n", transition.seconds, transition.status.c_str());
+    }
+  }
+  if (report.truncated) {
+    printf("  capture is cut short, replayed up to the first bad record\n");
+  }
+}
+
+int main(int argc, char** argv) {
+  bool verbose = false;
+  const char* modelName = NULL;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (strcmp(argv[arg], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+      modelName = argv[++arg];
+    } else {
+      break;
+    }
+  }
+  if (arg >= argc || argv[arg][0] == '-') {
+    fprintf(stderr, "usage: %s [-v] [-m AUTO|V1_2|V1_4|V1_8] capture...\n", argv[0]);
+    return 2;
+  }
+
+  int failed = 0;
+  double wallSeconds = 0;
+  unsigned long refreshes = 0;
+  for (; arg < argc; arg++) {
+    std::vector<uint8_t> data;
+    Replay::Report report;
+    if (!readFile(argv[arg], &data)) {
+      fprintf(stderr, "%s: %s\n", argv[arg], strerror(errno));
+      failed++;
+      continue;
+    }
+    if (!Replay::replayCaptureCold(data.data(), data.size(), modelName, &report)) {
+      fprintf(stderr, "%s: not a version %d capture\n", argv[arg], CAPTURE_VERSION);
+      failed++;
+      continue;
+    }
+    printReport(argv[arg], report, verbose);
+    wallSeconds += report.wallSeconds;
+    refreshes += report.refreshes;
+    failed += report.truncated ? 1 : 0;
+  }
+
+  if (refreshes > 0) {
+    printf("total: %lu refreshes in %.3f s, %.0f refreshes/s\n", refreshes, wallSeconds, refreshes / wallSeconds);
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#ifndef CAPTURE_REPLAY_H
+#define CAPTURE_REPLAY_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "application.h"
+#include "host_hal.h"
+#include "ac_capture.h"
+#include "ac_display_reader.h"
+#include "ac_display_reader_p.h"
+#include "ac_warm_state.h"
+
+extern struct WarmState warmState;
+
+/**
+ * Runs display captures (see ac_capture.h) through a DisplayReader on the host as fast as it will
+ * go. Bytes go in through DisplayReader::replayByte so framing, decoding and the state vote are the
+ * firmware's own code, only the clock interrupt is skipped.
+ */
+namespace Replay {
+
+struct Transition {
+  double seconds; // capture time, from the last time record
+  std::string status; // the STATUS_CHANGE event data
+};
+
+struct Report {
+  int unit; // unit the capture was recorded on
+  unsigned long bytes;
+  unsigned long refreshes; // bytes that started after a FRAME_GAP_MIN gap
+  unsigned long passes; // processDisplayData calls
+  struct AcDisplayReaderStats stats;
+  std::map<std::string, unsigned long> parseErrors; // PARSE_ERROR events by message up to any ':'
+  std::vector<Transition> transitions;
+  double captureSeconds; // device time the capture spans
+  double wallSeconds; // time the replay took
+  bool truncated; // the capture ended in or hit a record that couldn't be decoded
+};
+
+/**
+ * Tally what the reader published since the last pass and forget it, so captures of any length
+ * replay in constant memory
+ */
+inline void collectEvents(Report* report, double seconds) {
+  for (const HostHal::PublishedEvent& event : HostHal::published()) {
+    if (event.name == "PARSE_ERROR") {
+      report->parseErrors[event.data.substr(0, event.data.find(':'))]++;
+    } else if (event.name == "STATUS_CHANGE") {
+      report->transitions.push_back({seconds, event.data});
+    }
+  }
+  HostHal::clearPublished();
+}
+
+/**
+ * Replay a whole capture into reader, which must be initialised and only used for this capture.
+ * modelName overrides the capture's model records, "AUTO" detects the model like a fresh device.
+ * Returns false if data isn't a capture
+ */
+inline bool replayCapture(const uint8_t data[], size_t len, AcManager::DisplayReader* reader,
+    const char* modelName, Report* report) {
+  AcManager::CaptureDecoder decoder(data, len);
+  if (!decoder.isValid()) {
+    return false;
+  }
+  *report = Report();
+  report->unit = decoder.getUnit();
+  if (modelName != NULL) {
+    reader->setAcModel(modelName);
+  }
+  HostHal::clearPublished();
+
+  uint64_t firstMicros = 0;
+  uint64_t captureMicros = 0;
+  bool timed = false;
+  int pending = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  struct AcManager::CaptureRecord record;
+  while (decoder.next(&record)) {
+    switch (record.type) {
+      case AcManager::CAPTURE_TIME:
+        captureMicros = record.millis * 1000ULL;
+        if (!timed) {
+          firstMicros = captureMicros;
+          timed = true;
+        }
+        break;
+      case AcManager::CAPTURE_MODEL:
+        if (modelName == NULL && (reader->isDetectingAcModel() || reader->getAcModel() != record.value)) {
+          reader->lockAcModel((AcModels) record.value);
+        }
+        break;
+      case AcManager::CAPTURE_BYTE:
+        if (record.sinceLast != CAPTURE_GAP_UNKNOWN) {
+          captureMicros += record.sinceLast;
+        }
+        if (record.sinceLast > FRAME_GAP_MIN) {
+          report->refreshes++;
+        }
+        report->bytes++;
+        reader->replayByte(record.value, record.sinceLast);
+
+        // Pass as often as loop() would, on every refresh it wakes for and before readBuffer could
+        // miss anything
+        if (reader->isFrameReady() || ++pending >= BUFFER_LEN / 2) {
+          reader->processDisplayData();
+          report->passes++;
+          pending = 0;
+          collectEvents(report, (captureMicros - firstMicros) / 1e6);
+        }
+        break;
+    }
+  }
+  if (pending > 0) {
+    reader->processDisplayData();
+    report->passes++;
+    collectEvents(report, (captureMicros - firstMicros) / 1e6);
+  }
+
+  report->wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  report->captureSeconds = (captureMicros - firstMicros) / 1e6;
+  report->stats = reader->getStats();
+  report->truncated = decoder.isTruncated();
+  return true;
+}
+
+/**
+ * Replay into a fresh reader as unit 0 with its own scheduler, nothing carries over from anything
+ * replayed before. The reader is gone afterwards but stays registered as unit 0, don't call the
+ * cloud functions or waitForAcDisplayFrame after this
+ */
+inline bool replayCaptureCold(const uint8_t data[], size_t len, const char* modelName, Report* report) {
+  // A warm state or model left by an earlier replay would be picked up at init
+  memset(&warmState, 0, sizeof(warmState));
+  HostHal::eeprom()[1] = 0xFF;
+
+  AcManager::Scheduler scheduler;
+  AcManager::DisplayReader reader;
+  reader.init(0, AC_DISPLAY_READER_CONFIG_DEFAULTS, &scheduler);
+  return replayCapture(data, len, &reader, modelName, report);
+}
+
+}
+
+#endif
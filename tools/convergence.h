@@ -0,0 +1,157 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include <algorithm>
+#include <vector>
+#include "application.h"
+#include "host_hal.h"
+#include "ac_manager.h"
+#include "ac_display_reader_p.h"
+#include "ac_state_controller.h"
+#include "virtual_ac.h"
+
+/**
+ * setState's closed loop against a VirtualAc: random targets are requested one after the other and
+ * loop() runs until each is done or times out. The firmware must be set up with the virtual unit
+ * on unit 0's pins.
+ */
+namespace Convergence {
+
+struct Result {
+  int requests;
+  int done; // SET_STATE_DONE
+  int timeouts; // SET_STATE_TIMEOUT
+  int rejected; // setState refused the target as one the model can't show, not in seconds
+  int wrong; // SET_STATE_DONE but the unit isn't at the target, or setState got reachability wrong
+  std::vector<double> seconds; // fake time from setState to the result, one per request
+  unsigned long frames; // NEC frames the unit received
+  unsigned long repeats; // NEC repeat codes the unit received
+  double wallSeconds;
+
+  int accepted() const { return requests - rejected; }
+
+  // Fraction p of the way through the sorted times
+  double percentile(double p) const {
+    if (seconds.empty()) {
+      return 0;
+    }
+    std::vector<double> sorted(seconds);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+  }
+};
+
+static VirtualAc* activeAc = NULL;
+
+static void runActiveAc(uint64_t untilMicros) {
+  activeAc->run(untilMicros);
+}
+
+/**
+ * Any mode, fan speed and temperature, including ones the unit's display can't show (FAN_MEDIUM
+ * on V1_4) that setState has to refuse. One in ten turn it off
+ */
+inline struct AcState randomTarget(uint32_t* random) {
+  if (EdgeTrace::nextRandom(random) % 10 == 0) {
+    return AcState(0, 0, 0, FAN_OFF, MODE_OFF, false);
+  }
+  static const enum AcModes MODES[] = {MODE_COOL, MODE_ECO, MODE_FAN};
+  int temp = VIRTUAL_AC_MIN_TEMP + EdgeTrace::nextRandom(random) % (VIRTUAL_AC_MAX_TEMP - VIRTUAL_AC_MIN_TEMP + 1);
+  enum AcModes mode = MODES[EdgeTrace::nextRandom(random) % 3];
+  enum FanSpeeds speed = (FanSpeeds) (FAN_LOW + EdgeTrace::nextRandom(random) % 4);
+  return AcState(0, temp, 0, speed, mode, false);
+}
+
+/**
+ * True once setState's request has published how it ended
+ */
+inline bool isFinished() {
+  return HostHal::publishCount("SET_STATE_DONE") > 0 || HostHal::publishCount("SET_STATE_TIMEOUT") > 0 ||
+    HostHal::publishCount("SET_STATE_UNREACHABLE") > 0;
+}
+
+inline bool isAt(const struct AcState& state, const struct AcState& target) {
+  if (target.getMode() == MODE_OFF) {
+    return state.getMode() == MODE_OFF;
+  }
+  return state.getMode() == target.getMode() && state.getSpeed() == target.getSpeed() &&
+    (target.getMode() == MODE_FAN || state.getTemp() == target.getTemp());
+}
+
+inline String commandFor(const struct AcState& target) {
+  static const char* MODE_NAMES[] = {"MODE_OFF", "MODE_FAN", "MODE_ECO", "MODE_COOL"};
+  static const char* SPEED_NAMES[] = {"FAN_OFF", "FAN_LOW", "FAN_MEDIUM", "FAN_HIGH", "FAN_AUTO"};
+  if (target.getMode() == MODE_OFF) {
+    return "OFF";
+  }
+  char command[48];
+  snprintf(command, sizeof(command), "%d,%s,%s", target.getTemp(), MODE_NAMES[target.getMode()],
+    SPEED_NAMES[target.getSpeed()]);
+  return command;
+}
+
+/**
+ * Lock unit 0's reader onto the virtual unit's model and let it vote in what the unit shows
+ */
+inline void warmUp(VirtualAc* ac, const char* modelName) {
+  activeAc = ac;
+  HostHal::setDelayCallback(runActiveAc);
+  setAcModel(modelName);
+  uint64_t end = HostHal::nowMicros() + 1000000;
+  while (HostHal::nowMicros() < end) {
+    loop();
+  }
+  HostHal::setDelayCallback(NULL);
+  HostHal::clearPublished();
+  activeAc = NULL;
+}
+
+/**
+ * Request count random targets in a row, the unit starts wherever the last run left it
+ */
+inline void run(VirtualAc* ac, int count, uint32_t seed, Result* result) {
+  *result = Result();
+  uint32_t random = seed != 0 ? seed : 1;
+  activeAc = ac;
+  HostHal::setDelayCallback(runActiveAc);
+  unsigned long framesBefore = ac->getFrames();
+  unsigned long repeatsBefore = ac->getRepeats();
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < count; i++) {
+    struct AcState target = randomTarget(&random);
+    HostHal::clearPublished();
+    uint64_t start = HostHal::nowMicros();
+    result->requests++;
+    if (setState(commandFor(target)) < AcManager::StateController::FIRST_REQUEST_ID) {
+      result->rejected++;
+      result->wrong += ac->canShow(target) ? 1 : 0;
+      continue;
+    }
+    while (!isFinished()) {
+      loop();
+    }
+
+    result->seconds.push_back((HostHal::nowMicros() - start) / 1e6);
+    if (HostHal::publishCount("SET_STATE_DONE") > 0) {
+      result->done++;
+      result->wrong += isAt(ac->getState(), target) ? 0 : 1;
+    } else if (HostHal::publishCount("SET_STATE_TIMEOUT") > 0) {
+      result->timeouts++;
+    } else {
+      // Accepted and then found unreachable, the model didn't change so setState should have refused it
+      result->wrong++;
+    }
+  }
+
+  result->frames = ac->getFrames() - framesBefore;
+  result->repeats = ac->getRepeats() - repeatsBefore;
+  result->wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  HostHal::setDelayCallback(NULL);
+  HostHal::clearPublished();
+  activeAc = NULL;
+}
+
+}
+
+#endif
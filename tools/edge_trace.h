@@ -0,0 +1,256 @@
+#ifndef EDGE_TRACE_H
+#define EDGE_TRACE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include "application.h"
+#include "host_hal.h"
+#include "ac_capture.h"
+#include "ac_display_reader.h"
+#include "ac_display_reader_p.h"
+#include "capture_replay.h"
+
+/**
+ * Edge traces: every rising edge on a display's clock pin with the level of its data pin, for
+ * driving the real DisplayReader::onClock through the fake HAL with the timing noise the framing
+ * has to put up with on the device.
+ *
+ *  header  'A' 'C' 'E' 'T' version 0
+ *  edge    uint32 little endian, bit 0 the data level, the rest micros since the edge before
+ *
+ * Edges are fixed size so a trace of any length is replayed straight out of a memory mapped file.
+ */
+#define EDGE_TRACE_VERSION 1
+#define EDGE_TRACE_HEADER_LEN 6
+#define EDGE_TRACE_BIT_MICROS 4 // time the AC controller takes to clock one bit into the register
+
+namespace EdgeTrace {
+
+inline void appendHeader(std::vector<uint8_t>* trace) {
+  const uint8_t header[EDGE_TRACE_HEADER_LEN] = {'A', 'C', 'E', 'T', EDGE_TRACE_VERSION, 0};
+  trace->insert(trace->end(), header, header + EDGE_TRACE_HEADER_LEN);
+}
+
+inline void appendEdge(std::vector<uint8_t>* trace, uint32_t sinceLast, int level) {
+  uint32_t edge = (sinceLast << 1) | (level & 1);
+  for (int i = 0; i < 4; i++) {
+    trace->push_back((edge >> (i * 8)) & 0xFF);
+  }
+}
+
+/**
+ * Append the 8 clock edges of a shift register byte, MSB first, the first sinceLast micros after
+ * the last edge of the byte before
+ */
+inline void appendByte(std::vector<uint8_t>* trace, uint8_t value, uint32_t sinceLast) {
+  for (int bit = 7; bit >= 0; bit--) {
+    appendEdge(trace, bit == 7 ? sinceLast : EDGE_TRACE_BIT_MICROS, (value >> bit) & 1);
+  }
+}
+
+/**
+ * Expand a display capture (see ac_capture.h) into the edges that clocked its bytes in. Returns
+ * the capture's first model record or -1 if it has none or isn't a capture
+ */
+inline int fromCapture(const uint8_t capture[], size_t len, std::vector<uint8_t>* trace) {
+  AcManager::CaptureDecoder decoder(capture, len);
+  appendHeader(trace);
+  int model = -1;
+  bool first = true;
+  struct AcManager::CaptureRecord record;
+  while (decoder.next(&record)) {
+    if (record.type == AcManager::CAPTURE_MODEL && model == -1) {
+      model = record.value;
+    } else if (record.type == AcManager::CAPTURE_BYTE) {
+      // sinceLast runs start to start, the byte before took 7 bit times to clock in
+      uint32_t sinceLast = first ? 0 : record.sinceLast - min((uint32_t) record.sinceLast, 7u * EDGE_TRACE_BIT_MICROS);
+      appendByte(trace, record.value, sinceLast);
+      first = false;
+    }
+  }
+  return model;
+}
+
+/**
+ * Read only view of a trace in memory
+ */
+class Trace {
+  public:
+    Trace(const uint8_t data[], size_t len) : data(data), len(len) {}
+
+    bool isValid() const {
+      return len >= EDGE_TRACE_HEADER_LEN && memcmp(data, "ACET", 4) == 0 && data[4] == EDGE_TRACE_VERSION;
+    }
+    size_t edges() const { return isValid() ? (len - EDGE_TRACE_HEADER_LEN) / 4 : 0; }
+    uint32_t edge(size_t i) const {
+      const uint8_t* at = &data[EDGE_TRACE_HEADER_LEN + i * 4];
+      return at[0] | (at[1] << 8) | (at[2] << 16) | ((uint32_t) at[3] << 24);
+    }
+
+  private:
+    const uint8_t* data;
+    size_t len;
+};
+
+/**
+ * A whole file mapped read only, empty if it couldn't be opened
+ */
+class MappedFile {
+  public:
+    explicit MappedFile(const char* path) : data(NULL), len(0) {
+      int fd = open(path, O_RDONLY);
+      struct stat st;
+      if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+          data = (const uint8_t*) mapped;
+          len = st.st_size;
+          madvise(mapped, len, MADV_SEQUENTIAL);
+        }
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+    ~MappedFile() {
+      if (data != NULL) {
+        munmap((void*) data, len);
+      }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* getData() const { return data; }
+    size_t size() const { return len; }
+
+  private:
+    const uint8_t* data;
+    size_t len;
+};
+
+/**
+ * Noise added while replaying, all rates are per edge
+ */
+struct Faults {
+  uint32_t jitterMicros; // each edge moves up to this far either way, never before the edge before
+  double dropRate; // edges the ISR never sees
+  double extraRate; // spurious edges with a random data level right after a real one
+  uint32_t seed; // the same seed injects the same faults
+};
+
+const struct Faults NO_FAULTS = {.jitterMicros = 0, .dropRate = 0, .extraRate = 0, .seed = 1};
+
+struct Report {
+  unsigned long edges; // edges fed to the ISR, extra ones included
+  unsigned long droppedEdges;
+  unsigned long extraEdges;
+  Replay::Report decode; // what the reader made of them, bytes and refreshes aren't counted
+};
+
+/**
+ * xorshift32, only here so fault injection is repeatable across platforms
+ */
+inline uint32_t nextRandom(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+inline bool chance(uint32_t* state, double rate) {
+  return rate > 0 && nextRandom(state) < rate * 4294967296.0;
+}
+
+/**
+ * Feed every edge of trace to reader's clock ISR through the fake HAL with faults injected,
+ * passing the data to processDisplayData as often as loop() would. Returns false if trace isn't
+ * valid
+ */
+inline bool replayEdges(const Trace& trace, AcManager::DisplayReader* reader, const struct AcDisplayReaderConfig& config,
+    const struct Faults& faults, Report* report) {
+  if (!trace.isValid()) {
+    return false;
+  }
+  *report = Report();
+  HostHal::clearPublished();
+
+  uint32_t random = faults.seed != 0 ? faults.seed : 1;
+  uint64_t start = HostHal::nowMicros();
+  uint64_t edgeMicros = start; // where the trace puts the edge
+  uint64_t fedMicros = start; // when the last edge actually reached the ISR
+  int sinceProcess = 0;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  size_t edges = trace.edges();
+  for (size_t i = 0; i < edges; i++) {
+    uint32_t edge = trace.edge(i);
+    edgeMicros += edge >> 1;
+    if (chance(&random, faults.dropRate)) {
+      report->droppedEdges++;
+      continue;
+    }
+
+    int fed = 1;
+    int level = edge & 1;
+    uint64_t at = edgeMicros;
+    if (faults.jitterMicros > 0) {
+      at += nextRandom(&random) % (2 * faults.jitterMicros + 1);
+      at = at > faults.jitterMicros ? at - faults.jitterMicros : 0;
+    }
+    if (chance(&random, faults.extraRate)) {
+      fed = 2;
+    }
+
+    for (int f = 0; f < fed; f++) {
+      fedMicros = max(fedMicros, at);
+      HostHal::setMicros(fedMicros);
+      HostHal::setPin(config.inputPin, level);
+      HostHal::triggerInterrupt(config.clockPin);
+      report->edges++;
+
+      // The spurious edge lands within a bit time of the real one
+      at = fedMicros + nextRandom(&random) % EDGE_TRACE_BIT_MICROS;
+      level = nextRandom(&random) & 1;
+    }
+    report->extraEdges += fed - 1;
+
+    if (reader->isFrameReady() || ++sinceProcess >= BUFFER_LEN / 2 * 8) {
+      reader->processDisplayData();
+      report->decode.passes++;
+      sinceProcess = 0;
+      Replay::collectEvents(&report->decode, (fedMicros - start) / 1e6);
+    }
+  }
+  reader->processDisplayData();
+  report->decode.passes++;
+  Replay::collectEvents(&report->decode, (fedMicros - start) / 1e6);
+
+  report->decode.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  report->decode.captureSeconds = (fedMicros - start) / 1e6;
+  report->decode.stats = reader->getStats();
+  return true;
+}
+
+/**
+ * Replay into a fresh reader as unit 0 on the default pins, see Replay::replayCaptureCold for what
+ * that leaves behind. modelName is the model to decode with, "AUTO" to detect it
+ */
+inline bool replayEdgesCold(const Trace& trace, const char* modelName, const struct Faults& faults, Report* report) {
+  memset(&warmState, 0, sizeof(warmState));
+  HostHal::eeprom()[1] = 0xFF;
+
+  AcManager::Scheduler scheduler;
+  AcManager::DisplayReader reader;
+  reader.init(0, AC_DISPLAY_READER_CONFIG_DEFAULTS, &scheduler);
+  reader.setAcModel(modelName);
+  return replayEdges(trace, &reader, AC_DISPLAY_READER_CONFIG_DEFAULTS, faults, report);
+}
+
+}
+
+#endif
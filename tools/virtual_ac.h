@@ -0,0 +1,390 @@
+#ifndef VIRTUAL_AC_H
+#define VIRTUAL_AC_H
+
+#include <deque>
+#include "application.h"
+#include "host_hal.h"
+#include "ac_display_reader.h"
+#include "ac_ir_commands.h"
+#include "ac_ir_controller_p.h"
+#include "ac_parser.h"
+#include "ac_parser_v12.h"
+#include "ac_parser_v14.h"
+#include "ac_parser_v18.h"
+#include "ac_display_reader_p.h"
+#include "edge_trace.h"
+
+#define VIRTUAL_AC_BYTE_MICROS 1000 // start of one display byte to the next
+#define VIRTUAL_AC_FRAME_GAP_MICROS 5000 // quiet time between refreshes, over FRAME_GAP_MIN
+#define VIRTUAL_AC_CARRIER_GAP_MICROS 100 // no carrier edge for this long ends a mark, a few carrier periods
+#define VIRTUAL_AC_FRAME_MAX 6 // longest display frame of any model
+#define VIRTUAL_AC_MIN_TEMP 60
+#define VIRTUAL_AC_MAX_TEMP 90
+
+struct VirtualAcConfig {
+  enum AcModels model;
+  int clockPin;
+  int dataPin;
+  int irPin; // the firmware's IR LED output
+  uint32_t responseMicros; // from the end of a received IR frame to the display showing it
+  double frameNoise; // fraction of display refreshes sent with one bit flipped
+  double missRate; // fraction of IR frames the unit never sees, their repeat codes go with them
+  uint32_t pressGapMicros; // frames this soon after the last accepted one are ignored, 0 takes every frame
+  int holdDelayRepeats; // repeat codes before a held temperature button starts stepping again
+  int holdRepeatsPerStep; // repeat codes per extra step once it does, 0 if it doesn't auto repeat
+  uint32_t seed;
+};
+
+const struct VirtualAcConfig VIRTUAL_AC_DEFAULTS = {
+  .model = V1_4,
+  .clockPin = D2,
+  .dataPin = D1,
+  .irPin = D6,
+  .responseMicros = 300000,
+  .frameNoise = 0,
+  .missRate = 0,
+  .pressGapMicros = 0,
+  .holdDelayRepeats = 4,
+  .holdRepeatsPerStep = 3,
+  .seed = 1
+};
+
+/**
+ * A Frigidaire window unit on the host, for running setState's closed loop without one.
+ *
+ * The unit watches the firmware's IR LED pin through the fake HAL's pin write log, demodulates the
+ * carrier into marks and spaces and decodes NEC frames and repeat codes from them like the real
+ * receiver. Buttons act on the unit's state the way the CommandPlanner's tables describe, and the
+ * display refreshes are clocked out on the reader's pins with the model's own display bytes.
+ */
+class VirtualAc {
+  public:
+    explicit VirtualAc(const struct VirtualAcConfig& config) :
+      config(config), state(0, 72, 0, FAN_AUTO, MODE_COOL, false), onState(state), lastManualSpeed(FAN_LOW),
+      random(config.seed != 0 ? config.seed : 1), nextRefresh(0), inMark(false), markStart(0), lastEdge(0),
+      lastMarkLen(0), lastMarkEnd(0), necState(RX_IDLE), necBits(0), necCode(0), held(AC_CMD_COUNT),
+      heldRepeats(0), lastAccepted(0), frames(0), repeats(0), missed(0) {
+      HostHal::recordPinWrites(true);
+      HostHal::clearPinWrites();
+    }
+    ~VirtualAc() {
+      HostHal::recordPinWrites(false);
+      HostHal::clearPinWrites();
+    }
+    VirtualAc(const VirtualAc&) = delete;
+    VirtualAc& operator=(const VirtualAc&) = delete;
+
+    /**
+     * What the panel shows, e.g. someone pressed the buttons on the unit itself
+     */
+    void setState(const struct AcState& newState) {
+      state = newState;
+      if (state.getMode() != MODE_OFF) {
+        onState = state;
+      }
+    }
+    const struct AcState& getState() const { return state; }
+
+    unsigned long getFrames() const { return frames; } // NEC frames received, missed ones included
+    unsigned long getRepeats() const { return repeats; } // NEC repeat codes received
+    unsigned long getMissed() const { return missed; }
+
+    /**
+     * Refresh the display and take in IR until the fake clock reaches untilMicros, fits
+     * HostHal::setDelayCallback through a trampoline
+     */
+    void run(uint64_t untilMicros) {
+      while (HostHal::nowMicros() < untilMicros) {
+        if (HostHal::nowMicros() >= nextRefresh) {
+          uint64_t start = HostHal::nowMicros();
+          sendRefresh();
+          nextRefresh = start + VIRTUAL_AC_FRAME_MAX * VIRTUAL_AC_BYTE_MICROS + VIRTUAL_AC_FRAME_GAP_MICROS;
+        } else {
+          HostHal::setMicros(min(untilMicros, nextRefresh));
+        }
+        receiveIr();
+        applyPresses();
+      }
+    }
+
+    /**
+     * The refresh the model's display controller clocks out for s, returns its length
+     */
+    int encodeFrame(const struct AcState& s, uint8_t frame[]) const {
+      switch (config.model) {
+        case V1_2: {
+          static const uint8_t REFRESH[] = {0xFF, 0xF8, 0xA4, 0xDE, 0xEE};
+          return encodeFrame<AcManager::V12Traits>(s, REFRESH, frame);
+        }
+        case V1_4: {
+          static const uint8_t REFRESH[] = {0x7F, 0x7F, 0xF8, 0xA4, 0xED, 0xFF};
+          return encodeFrame<AcManager::V14Traits>(s, REFRESH, frame);
+        }
+        default: {
+          static const uint8_t REFRESH[] = {0xFF, 0xFF, 0xBC, 0xA2, 0xFB, 0xF7};
+          return encodeFrame<AcManager::V18Traits>(s, REFRESH, frame);
+        }
+      }
+    }
+
+    /**
+     * True if the model's display has segments for s, checked with the firmware's own parser
+     */
+    bool canShow(const struct AcState& s) const {
+      uint8_t frame[VIRTUAL_AC_FRAME_MAX];
+      int len = encodeFrame(s, frame);
+      struct AcState parsed;
+      return getAcParserFor(config.model)->parseState(&parsed, frame, len, false) && parsed.display == s.display;
+    }
+
+  private:
+    enum NecState {
+      RX_IDLE,
+      RX_HEADER, // the last mark was a header mark
+      RX_BITS // reading the 32 data bits
+    };
+
+    struct Press {
+      uint64_t at; // when the display shows it
+      enum AcCommands command;
+    };
+
+    struct VirtualAcConfig config;
+    struct AcState state;
+    struct AcState onState; // what ON_OFF turns back on to
+    enum FanSpeeds lastManualSpeed; // what the fan buttons go back to from auto
+    uint32_t random;
+    uint64_t nextRefresh;
+    std::deque<Press> presses;
+
+    // Carrier demodulation and NEC decoding
+    bool inMark;
+    uint64_t markStart;
+    uint64_t lastEdge;
+    uint64_t lastMarkLen;
+    uint64_t lastMarkEnd;
+    NecState necState;
+    int necBits;
+    uint32_t necCode;
+    enum AcCommands held; // button the repeat codes hold, AC_CMD_COUNT if none
+    int heldRepeats;
+    uint64_t lastAccepted;
+
+    unsigned long frames;
+    unsigned long repeats;
+    unsigned long missed;
+
+    template <typename Traits>
+    static int encodeFrame(const struct AcState& s, const uint8_t refresh[], uint8_t frame[]) {
+      memcpy(frame, refresh, Traits::DATA_LENGTH);
+      if (s.getMode() == MODE_OFF || s.getSpeed() == FAN_OFF) {
+        memset(&frame[Traits::HEADER_LENGTH], 0xFF, Traits::DATA_LENGTH - Traits::HEADER_LENGTH);
+        return Traits::DATA_LENGTH;
+      }
+
+      int temp = constrain(s.getTemp(), 0, 99);
+      frame[Traits::HEADER_LENGTH] = Traits::NUMBER_BYTES[temp / 10];
+      frame[Traits::HEADER_LENGTH + 1] = Traits::NUMBER_BYTES[temp % 10];
+
+      // The byte tables are in {COOL, ECO, FAN} and {LOW, MEDIUM, HIGH, AUTO} order, see ac_parser_tables.h
+      static const int MODE_INDEX[MODE_INVALID] = {0, 2, 1, 0};
+      uint8_t modeBits = Traits::AC_MODE_BYTES[MODE_INDEX[s.getMode()]];
+      uint8_t fanBits = Traits::FAN_SPEED_BYTES[constrain(s.getSpeed(), FAN_LOW, FAN_AUTO) - FAN_LOW];
+      frame[Traits::AC_MODE_BYTE_INDEX] = modeBits;
+      if (Traits::FAN_SPEED_BYTE_INDEX == Traits::AC_MODE_BYTE_INDEX) {
+        // Mode and fan share a byte, each table only looks at its own active low bits
+        frame[Traits::FAN_SPEED_BYTE_INDEX] &= fanBits;
+      } else {
+        frame[Traits::FAN_SPEED_BYTE_INDEX] = fanBits;
+      }
+      return Traits::DATA_LENGTH;
+    }
+
+    void sendRefresh() {
+      uint8_t frame[VIRTUAL_AC_FRAME_MAX];
+      int len = encodeFrame(state, frame);
+      if (EdgeTrace::chance(&random, config.frameNoise)) {
+        uint32_t bit = EdgeTrace::nextRandom(&random) % (len * 8);
+        frame[bit / 8] ^= 1 << (bit % 8);
+      }
+      for (int i = 0; i < len; i++) {
+        uint64_t start = HostHal::nowMicros();
+        HostHal::clockInByte(config.clockPin, config.dataPin, frame[i], EDGE_TRACE_BIT_MICROS);
+        HostHal::setMicros(start + VIRTUAL_AC_BYTE_MICROS);
+      }
+      HostHal::setMicros(HostHal::nowMicros() + VIRTUAL_AC_FRAME_GAP_MICROS);
+    }
+
+    /**
+     * Turn the IR LED's carrier edges since the last call into marks, a mark ends once the carrier
+     * has been quiet for VIRTUAL_AC_CARRIER_GAP_MICROS
+     */
+    void receiveIr() {
+      for (const HostHal::PinWrite& write : HostHal::pinWrites()) {
+        if (write.pin != config.irPin) {
+          continue;
+        }
+        if (inMark && write.micros - lastEdge > VIRTUAL_AC_CARRIER_GAP_MICROS) {
+          onMark(markStart, lastEdge);
+          inMark = false;
+        }
+        if (!inMark) {
+          inMark = true;
+          markStart = write.micros;
+        }
+        lastEdge = write.micros;
+      }
+      HostHal::clearPinWrites();
+
+      if (inMark && HostHal::nowMicros() - lastEdge > VIRTUAL_AC_CARRIER_GAP_MICROS) {
+        onMark(markStart, lastEdge);
+        inMark = false;
+      }
+    }
+
+    static bool near(uint64_t micros, uint32_t expected) {
+      return micros + expected / 4 >= expected && micros <= expected + expected / 4;
+    }
+
+    /**
+     * NEC from the marks alone: the space before each mark says what the mark before it started
+     */
+    void onMark(uint64_t start, uint64_t end) {
+      uint64_t space = start - lastMarkEnd;
+      if (necState == RX_HEADER) {
+        if (near(space, NEC_HDR_SPACE)) {
+          necState = RX_BITS;
+          necBits = 0;
+          necCode = 0;
+        } else {
+          if (near(space, NEC_RPT_SPACE)) {
+            onRepeat();
+          }
+          necState = RX_IDLE;
+        }
+      } else if (necState == RX_BITS) {
+        if (near(lastMarkLen, NEC_BIT_MARK) && (near(space, NEC_ONE_SPACE) || near(space, NEC_ZERO_SPACE))) {
+          necCode = (necCode << 1) | (near(space, NEC_ONE_SPACE) ? 1 : 0);
+          if (++necBits == NEC_BITS) {
+            onCode(necCode, end);
+            necState = RX_IDLE;
+          }
+        } else {
+          necState = RX_IDLE;
+        }
+      }
+
+      lastMarkLen = end - start;
+      lastMarkEnd = end;
+      if (near(lastMarkLen, NEC_HDR_MARK)) {
+        necState = RX_HEADER;
+      }
+    }
+
+    void onCode(uint32_t code, uint64_t at) {
+      frames++;
+      held = AC_CMD_COUNT;
+      enum AcCommands command = AC_CMD_COUNT;
+      for (int i = 0; i < AC_CMD_COUNT; i++) {
+        if (AC_COMMAND_CODES[i] == code) {
+          command = (AcCommands) i;
+        }
+      }
+      bool tooSoon = config.pressGapMicros > 0 && lastAccepted != 0 && at - lastAccepted < config.pressGapMicros;
+      if (command == AC_CMD_COUNT || tooSoon || EdgeTrace::chance(&random, config.missRate)) {
+        missed++;
+        return;
+      }
+      lastAccepted = at;
+      held = command;
+      heldRepeats = 0;
+      presses.push_back({at + config.responseMicros, command});
+    }
+
+    /**
+     * A held temperature button steps again every holdRepeatsPerStep repeat codes after the delay,
+     * the HoldCalibration model
+     */
+    void onRepeat() {
+      repeats++;
+      if (held != AC_CMD_TEMP_TIMER_U && held != AC_CMD_TEMP_TIMER_D) {
+        return;
+      }
+      heldRepeats++;
+      int pastDelay = heldRepeats - config.holdDelayRepeats;
+      if (config.holdRepeatsPerStep > 0 && pastDelay > 0 && pastDelay % config.holdRepeatsPerStep == 0) {
+        presses.push_back({lastMarkEnd + config.responseMicros, held});
+      }
+    }
+
+    void applyPresses() {
+      while (!presses.empty() && presses.front().at <= HostHal::nowMicros()) {
+        press(presses.front().command);
+        presses.pop_front();
+      }
+    }
+
+    void press(enum AcCommands command) {
+      bool on = state.getMode() != MODE_OFF;
+      if (command == AC_CMD_ON_OFF) {
+        setState(on ? AcState(0, 0, 0, FAN_OFF, MODE_OFF, false) : onState);
+        return;
+      }
+      if (!on) {
+        return;
+      }
+
+      int temp = state.getTemp();
+      enum FanSpeeds speed = state.getSpeed();
+      enum AcModes mode = state.getMode();
+      switch (command) {
+        case AC_CMD_TEMP_TIMER_U:
+        case AC_CMD_TEMP_TIMER_D:
+          if (mode != MODE_FAN) {
+            temp = constrain(temp + (command == AC_CMD_TEMP_TIMER_U ? 1 : -1), VIRTUAL_AC_MIN_TEMP, VIRTUAL_AC_MAX_TEMP);
+          }
+          break;
+        case AC_CMD_FAN_SPEED_U:
+        case AC_CMD_FAN_SPEED_D:
+          speed = nextManualSpeed(speed, command == AC_CMD_FAN_SPEED_U ? 1 : -1);
+          break;
+        case AC_CMD_AUTO_FAN:
+          speed = FAN_AUTO;
+          break;
+        case AC_CMD_COOL:
+          mode = MODE_COOL;
+          break;
+        case AC_CMD_ENERGY_SAVER:
+          mode = MODE_ECO;
+          break;
+        case AC_CMD_FAN_ONLY:
+          mode = MODE_FAN;
+          break;
+        default:
+          // Timer and sleep aren't modelled
+          break;
+      }
+      if (speed != FAN_AUTO) {
+        lastManualSpeed = speed;
+      }
+      setState(AcState(0, temp, 0, speed, mode, false));
+    }
+
+    /**
+     * Up and down step through low, medium and high and stop at the ends, leaving auto goes back to
+     * the last manual speed. Speeds the model's display can't show are skipped
+     */
+    enum FanSpeeds nextManualSpeed(enum FanSpeeds speed, int direction) const {
+      if (speed == FAN_AUTO) {
+        return lastManualSpeed;
+      }
+      for (int next = speed + direction; next >= FAN_LOW && next <= FAN_HIGH; next += direction) {
+        if (canShow(AcState(0, state.getTemp(), 0, (FanSpeeds) next, state.getMode(), false))) {
+          return (FanSpeeds) next;
+        }
+      }
+      return speed;
+    }
+};
+
+#endif